@@ -4,56 +4,239 @@
  * @author Wonseok Seo, Kevin Cushing - advised from Kevin Lundeen @SU
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <endian.h>
+#include <memory>
+#include <sstream>
 #include "SQLExec.h"
+#include "page_codec.h"
+#include "prefetch.h"
+#include "thread_pool.h"
 using namespace std;
 using namespace hsql;
 
 // define static data
 Tables* SQLExec::tables = nullptr;
 Indices* SQLExec::indices = nullptr;
+once_flag SQLExec::schema_once;
+RWLock SQLExec::catalog_lock;
+thread_local map<Identifier, SQLParserResult*> SQLExec::prepared;
+thread_local map<string, string> SQLExec::options;
 
 // make query result be printable
-ostream &operator<<(ostream &out, const QueryResult &qres) {
-    if (qres.column_names != nullptr) {
-        for (auto const &column_name: *qres.column_names)
-            out << column_name << " ";
-        out << endl << "+";
-        for (unsigned int i = 0; i < qres.column_names->size(); i++)
-            out << "----------+";
-        out << endl;
-        for (auto const &row: *qres.rows) {
-            for (auto const &column_name: *qres.column_names) {
-                Value value = row->at(column_name);
-                switch (value.data_type) {
-                    case ColumnAttribute::INT:
-                        out << value.n;
-                        break;
-                    case ColumnAttribute::TEXT:
-                        out << "\"" << value.s << "\"";
-                        break;
-                    default:
-                        out << "???";
-                }
-                out << " ";
-            }
-            out << endl;
-        }
-    }
-    out << qres.message;
+ostream &operator<<(ostream &out, QueryResult &qres) {
+    qres.write(out, QueryResult::TABLE);
     return out;
 }
 
+/**
+ * Cursor over handles into a relation, holding the relation and the row versions until it is read
+ */
+QueryResult::QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, DbRelation *relation,
+                         Handles *handles, string message)
+        : column_names(column_names), column_attributes(column_attributes), rows(nullptr), relation(relation),
+          handles(handles), next_row(0), holding(true), held_horizon(0), message(message) {
+    relation->get_table_lock().lock(LOCK_IS);
+    this->held_horizon = TransactionManager::retain(Transaction::current_id());
+}
+
 // checks pointer variables to prevent memory leak
 QueryResult::~QueryResult() {
+    release();
     if (column_names != nullptr)
         delete column_names;
     if (column_attributes != nullptr)
         delete column_attributes;
     if (rows != nullptr) {
-        for (auto row: *rows)
-            delete row;
+        // rows already handed out by fetch() belong to the caller
+        for (size_t i = next_row; i < rows->size(); i++)
+            delete (*rows)[i];
         delete rows;
     }
+    if (handles != nullptr)
+        delete handles;
+}
+
+// Hand out the next batch of rows, projecting them if this is a cursor
+bool QueryResult::fetch(ValueDicts &batch, uint max_rows) {
+    batch.clear();
+    if (rows != nullptr) {
+        while (next_row < rows->size() && batch.size() < max_rows)
+            batch.push_back((*rows)[next_row++]);
+    } else if (handles != nullptr) {
+        while (next_row < handles->size() && batch.size() < max_rows)
+            batch.push_back(relation->project((*handles)[next_row++], column_names));
+        if (next_row == handles->size())
+            release();
+    }
+    return !batch.empty();
+}
+
+// Let go of the relation and the row versions once the cursor is done with them
+void QueryResult::release() {
+    if (!holding)
+        return;
+    holding = false;
+    TransactionManager::release(held_horizon);
+    relation->get_table_lock().unlock(LOCK_IS);
+}
+
+// Output buffer size for QueryResult::write
+static const size_t WRITE_BUFFER_SZ = 64 * 1024;
+
+// Append a TEXT field quoted for CSV: embedded quotes are doubled
+static void append_csv(string &buffer, const string &s) {
+    if (s.find_first_of(",\"\r\n") == string::npos) {
+        buffer += s;
+        return;
+    }
+    buffer += '"';
+    for (char c : s) {
+        if (c == '"')
+            buffer += '"';
+        buffer += c;
+    }
+    buffer += '"';
+}
+
+// Append a TEXT field escaped for TSV
+static void append_tsv(string &buffer, const string &s) {
+    for (char c : s) {
+        switch (c) {
+        case '\t':
+            buffer += "\\t";
+            break;
+        case '\n':
+            buffer += "\\n";
+            break;
+        case '\\':
+            buffer += "\\\\";
+            break;
+        default:
+            buffer += c;
+        }
+    }
+}
+
+// BINARY length of a NULL field
+static const uint32_t NULL_SZ = UINT32_MAX - 1;
+
+// Append a 4-byte value for BINARY, little-endian whatever the host's byte order
+static void append_u32(string &buffer, uint32_t value) {
+    uint32_t little = htole32(value);
+    buffer.append((const char *)&little, sizeof(little));
+}
+
+// Append a length-prefixed field for BINARY
+static void append_binary(string &buffer, const void *data, uint32_t size) {
+    append_u32(buffer, size);
+    buffer.append((const char *)data, size);
+}
+
+// Write the column names and remaining rows in the given format
+void QueryResult::write(ostream &out, Format format) {
+    string buffer;
+    buffer.reserve(WRITE_BUFFER_SZ);
+    if (column_names != nullptr) {
+        // header
+        char separator = format == TSV ? '\t' : ',';
+        bool first = true;
+        for (auto const &column_name: *column_names) {
+            switch (format) {
+            case TABLE:
+                buffer += column_name + " ";
+                break;
+            case BINARY:
+                append_binary(buffer, column_name.data(), column_name.size());
+                break;
+            default:
+                if (!first)
+                    buffer += separator;
+                buffer += column_name;
+            }
+            first = false;
+        }
+        if (format == TABLE) {
+            buffer += "\n+";
+            for (unsigned int i = 0; i < column_names->size(); i++)
+                buffer += "----------+";
+        }
+        if (format != BINARY)
+            buffer += '\n';
+
+        // rows, a batch at a time
+        ValueDicts batch;
+        while (fetch(batch)) {
+            for (auto const &row: batch) {
+                first = true;
+                for (auto const &column_name: *column_names) {
+                    const Value &value = row->at(column_name);
+                    if (!first && format != TABLE && format != BINARY)
+                        buffer += separator;
+                    first = false;
+                    if (value.is_null) {
+                        if (format == TABLE)
+                            buffer += "NULL";
+                        else if (format == TSV)
+                            buffer += "\\N";
+                        else if (format == BINARY)
+                            append_u32(buffer, NULL_SZ);
+                        if (format == TABLE)
+                            buffer += " ";
+                        continue;
+                    }
+                    switch (value.data_type) {
+                        case ColumnAttribute::INT:
+                            if (format == BINARY) {
+                                append_u32(buffer, sizeof(value.n));
+                                append_u32(buffer, (uint32_t)value.n);
+                            } else
+                                buffer += to_string(value.n);
+                            break;
+                        case ColumnAttribute::TEXT:
+                            if (format == TABLE)
+                                buffer += "\"" + value.s + "\"";
+                            else if (format == CSV)
+                                append_csv(buffer, value.s);
+                            else if (format == TSV)
+                                append_tsv(buffer, value.s);
+                            else
+                                append_binary(buffer, value.s.data(), value.s.size());
+                            break;
+                        case ColumnAttribute::BOOLEAN:
+                            if (format == BINARY) {
+                                char b = value.n != 0;
+                                append_binary(buffer, &b, 1);
+                            } else {
+                                buffer += value.n != 0 ? "true" : "false";
+                            }
+                            break;
+                        default:
+                            if (format == BINARY)
+                                append_binary(buffer, nullptr, 0);
+                            else
+                                buffer += "???";
+                    }
+                    if (format == TABLE)
+                        buffer += " ";
+                }
+                if (format != BINARY)
+                    buffer += '\n';
+                delete row;
+            }
+            if (buffer.size() >= WRITE_BUFFER_SZ) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        if (format == BINARY)
+            append_u32(buffer, UINT32_MAX);
+    }
+    if (format == TABLE)
+        buffer += message;
+    out.write(buffer.data(), buffer.size());
 }
 
 /**
@@ -64,20 +247,38 @@ QueryResult::~QueryResult() {
  */
 QueryResult *SQLExec::execute(const SQLStatement *statement)
                               throw(SQLExecError) {
-    if (SQLExec::tables == nullptr)
-        SQLExec::tables = new Tables();
-    if (SQLExec::indices == nullptr)
-        SQLExec::indices = new Indices();
+    open_catalog();
 
     try {
         // for now, we only have three cases, create, drop, and show
         switch (statement->type()) {
-        case kStmtCreate:
-            return create((const CreateStatement *) statement);
-        case kStmtDrop:
-            return drop((const DropStatement *) statement);
-        case kStmtShow:
+        // each statement is a transaction, begun once the catalog lock is
+        // held so that its snapshot sees the last committed CREATE or DROP
+        case kStmtCreate: {
+            ExclusiveGuard guard(SQLExec::catalog_lock);
+            Transaction transaction;
+            unique_ptr<QueryResult> result(create((const CreateStatement *) statement));
+            transaction.commit();  // a failure is the statement's error
+            return result.release();
+        }
+        case kStmtDrop: {
+            if (((const DropStatement *) statement)->type == DropStatement::kPreparedStatement)
+                return deallocate((const DropStatement *) statement);
+            ExclusiveGuard guard(SQLExec::catalog_lock);
+            Transaction transaction;
+            unique_ptr<QueryResult> result(drop((const DropStatement *) statement));
+            transaction.commit();
+            return result.release();
+        }
+        case kStmtShow: {
+            SharedGuard guard(SQLExec::catalog_lock);
+            Transaction transaction;
             return show((const ShowStatement *) statement);
+        }
+        case kStmtPrepare:
+            return prepare((const PrepareStatement *) statement);
+        case kStmtExecute:
+            return execute_prepared((const ExecuteStatement *) statement);
         default:
             return new QueryResult("not implemented");
         }
@@ -86,6 +287,14 @@ QueryResult *SQLExec::execute(const SQLStatement *statement)
     }
 }
 
+// Instantiate the catalog tables the first time any thread needs them
+void SQLExec::open_catalog() {
+    call_once(SQLExec::schema_once, []() {
+        SQLExec::tables = new Tables();
+        SQLExec::indices = new Indices();
+    });
+}
+
 // Pull out column name and attrivutes from AST's column definition clause
 void SQLExec::column_definition(const ColumnDefinition *col,
                                 Identifier& column_name,
@@ -141,6 +350,30 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
     ValueDict row;
     // insert pair values (key: "table_name", value: table_name)
     row["table_name"] = table_name;
+    row["storage"] = get_option("storage", "heap");
+    row["page_size"] = Value(stoi(get_option("page_size", to_string(DbBlock::BLOCK_SZ))));
+    row["layout"] = get_option("layout", "row");
+    string bloom = get_option("bloom", "");
+    istringstream bloom_columns(bloom);
+    string bloom_column;
+    while (getline(bloom_columns, bloom_column, ','))
+        if (find(column_names.begin(), column_names.end(), bloom_column) == column_names.end())
+            throw SQLExecError("no column " + bloom_column + " to keep a Bloom filter of");
+    row["bloom"] = bloom;
+    string dictionary = get_option("dictionary", "");
+    istringstream dictionary_columns(dictionary);
+    string dictionary_column;
+    while (getline(dictionary_columns, dictionary_column, ',')) {
+        auto position = find(column_names.begin(), column_names.end(), dictionary_column);
+        if (position == column_names.end())
+            throw SQLExecError("no column " + dictionary_column + " to encode");
+        if (column_attributes[position - column_names.begin()].get_data_type() != ColumnAttribute::TEXT)
+            throw SQLExecError("column " + dictionary_column + " is not TEXT, so cannot be encoded");
+    }
+    row["dictionary"] = dictionary;
+    row["compression"] = get_option("compression", "none");
+    if (row["compression"].s != "none" && row["storage"].s != "heap")
+        throw SQLExecError("only heap storage can be compressed");
     // insert the row in tables and create temporally handle for table for
     // deletion in case of exception
     Handle temp_table_handle = SQLExec::tables->insert(&row);
@@ -416,16 +649,8 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     // the number of columns
     u_long row_size = handles->size();
 
-    // to hold all columns
-    ValueDicts* rows = new ValueDicts;
-    for (auto const& handle: *handles) {
-        ValueDict* row = columns.project(handle, name_keys);
-        rows->push_back(row);
-    }
-
-    // handle memory leak
-    delete handles;
-    return new QueryResult(name_keys, attribute_key, rows,
+    // rows are projected as the result is read
+    return new QueryResult(name_keys, attribute_key, &columns, handles,
                            "successfully returned " + to_string(row_size) +
                            " rows");
 }
@@ -460,17 +685,206 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement) {
     // the number of columns
     u_long row_size = handles->size();
 
-    // to hold all columns
-    ValueDicts* rows = new ValueDicts;
-    for (auto const& handle: *handles) {
-        ValueDict* row = SQLExec::indices->project(handle, name_keys);
-        rows->push_back(row);
+    // rows are projected as the result is read
+    return new QueryResult(name_keys, attribute_keys, SQLExec::indices, handles,
+                           "successfully returned " + to_string(row_size) +
+                           " rows");
+}
+
+// Gather the counters of each subsystem
+string SQLExec::statistics() {
+    return LockStats::report() + WriteAheadLog::report() + ThreadPool::shared().report()
+           + Prefetcher::shared().report() + ZoneMap::report() + PageCodec::report();
+}
+
+/**
+ * Garbage-collect dead row versions in every table, catalog included, and
+ * compact and shrink each table's file
+ * @param   uint &blocks_freed  returned: blocks given back
+ * @return  uint                number of row versions removed
+ */
+uint SQLExec::vacuum(uint &blocks_freed) {
+    open_catalog();
+    SharedGuard guard(SQLExec::catalog_lock);
+    // every transaction before this has finished, so its traces are all in the tables listed below
+    TxnID horizon = TransactionManager::horizon();
+    std::vector<Identifier> table_names;
+    {
+        Transaction transaction;
+        Handles *handles = SQLExec::tables->select();
+        for (auto const &handle: *handles) {
+            ValueDict *row = SQLExec::tables->project(handle);
+            table_names.push_back(row->at("table_name").s);
+            delete row;
+        }
+        delete handles;
+    }
+    uint removed = 0;
+    blocks_freed = 0;
+    for (auto const &table_name: table_names) {
+        DbRelation &table = table_name == Indices::TABLE_NAME ? *SQLExec::indices : Tables::get_table(table_name);
+        removed += table.vacuum();
+        HandleMoves moves;
+        if (table.compact(moves) > 0) {
+            for (auto const &index_name: SQLExec::indices->get_index_names(table_name)) {
+                DbIndex &index = SQLExec::indices->get_index(table_name, index_name);
+                for (auto const &move: moves) {
+                    index.insert(move.second);
+                    index.del(move.first);
+                }
+            }
+            // the rows left behind are dead already unless an older snapshot is still running
+            removed += table.vacuum();
+        }
+        blocks_freed += table.shrink();
     }
+    TransactionManager::forget_aborted(horizon);
+    return removed;
+}
 
-    // handle memory leak
-    delete handles;
+// Vacuum now and say what came of it
+string SQLExec::vacuum_command() {
+    try {
+        uint blocks_freed;
+        uint removed = SQLExec::vacuum(blocks_freed);
+        return "vacuumed: " + to_string(removed) + " row versions removed, " + to_string(blocks_freed) +
+               " blocks freed";
+    } catch (exception &e) {
+        return string("Error: ") + e.what();
+    }
+}
 
-    return new QueryResult(name_keys, attribute_keys, rows,
-                           "successfully returned " + to_string(row_size) +
-                           " rows");
+// Free this thread's prepared statements and forget its options
+void SQLExec::end_session() {
+    for (auto const &entry: SQLExec::prepared)
+        delete entry.second;
+    SQLExec::prepared.clear();
+    SQLExec::options.clear();
+}
+
+/**
+ * Set one of this session's options
+ * @param   string line  "set <option> <value>"
+ * @return  string       confirmation
+ */
+string SQLExec::set_option(const string &line) throw(SQLExecError) {
+    istringstream in(line);
+    string set, option, value, extra;
+    in >> set >> option >> value;
+    if (set != "set" || option.empty() || value.empty() || in >> extra)
+        throw SQLExecError("expected: set <option> <value>");
+    if (option == "storage") {
+        if (value != "heap" && value != "mmap" && value != "uring" && value != "column")
+            throw SQLExecError("storage must be heap, mmap, uring or column");
+    } else if (option == "page_size") {
+        // bytes, or kilobytes with a K
+        char *end;
+        unsigned long size = strtoul(value.c_str(), &end, 10);
+        if (*end == 'K' || *end == 'k') {
+            size *= 1024;
+            end++;
+        }
+        if (*end != '\0' || size > UINT32_MAX || !PageFile::valid_block_size((uint)size))
+            throw SQLExecError("page_size must be 4K, 8K, 16K, 32K or 64K");
+        value = to_string(size);
+    } else if (option == "layout") {
+        if (value != "row" && value != "pax")
+            throw SQLExecError("layout must be row or pax");
+    } else if (option == "bloom") {
+        // comma-separated column names, checked when the table is created
+        if (value == "none")
+            value = "";
+        else if (value.front() == ',' || value.back() == ',' || value.find(",,") != string::npos)
+            throw SQLExecError("bloom must be none or column names separated by commas");
+    } else if (option == "dictionary") {
+        // comma-separated TEXT column names, checked when the table is created
+        if (value == "none")
+            value = "";
+        else if (value.front() == ',' || value.back() == ',' || value.find(",,") != string::npos)
+            throw SQLExecError("dictionary must be none or column names separated by commas");
+    } else if (option == "compression") {
+        if (value != "none" && value != "zlib")
+            throw SQLExecError("compression must be none or zlib");
+    } else {
+        throw SQLExecError("unknown option " + option);
+    }
+    SQLExec::options[option] = value;
+    return option + " set to " + value;
+}
+
+// Value of one of this session's options
+string SQLExec::get_option(const string &option, const string &default_value) {
+    auto entry = SQLExec::options.find(option);
+    return entry == SQLExec::options.end() ? default_value : entry->second;
+}
+
+// Execute PREPARE statement: parse the query once and keep its AST by name
+QueryResult *SQLExec::prepare(const PrepareStatement *statement) {
+    Identifier name = statement->name;
+    SQLParserResult *parse = SQLParser::parseSQLString(statement->query);
+    if (!parse->isValid()) {
+        string message = parse->errorMsg();
+        delete parse;
+        throw SQLExecError("invalid SQL in prepared statement: " + message);
+    }
+    if (parse->size() != 1) {
+        delete parse;
+        throw SQLExecError("can only prepare a single statement");
+    }
+    // re-preparing a name replaces the old statement
+    auto found = SQLExec::prepared.find(name);
+    if (found != SQLExec::prepared.end()) {
+        delete found->second;
+        SQLExec::prepared.erase(found);
+    }
+    SQLExec::prepared[name] = parse;
+    return new QueryResult("prepared " + name);
+}
+
+// Execute EXECUTE statement: bind the arguments and run the prepared AST
+QueryResult *SQLExec::execute_prepared(const ExecuteStatement *statement) {
+    Identifier name = statement->name;
+    auto found = SQLExec::prepared.find(name);
+    if (found == SQLExec::prepared.end())
+        throw SQLExecError("no prepared statement named " + name);
+    SQLParserResult *parse = found->second;
+
+    // to hold placeholders in the order they appear in the query
+    const vector<Expr*> &placeholders = parse->parameters();
+    size_t n_args = statement->parameters == nullptr ? 0 : statement->parameters->size();
+    if (n_args != placeholders.size())
+        throw SQLExecError(name + " expects " + to_string(placeholders.size()) +
+                           " parameters, got " + to_string(n_args));
+    for (size_t i = 0; i < n_args; i++)
+        bind_parameter(placeholders[i], (*statement->parameters)[i]);
+    return execute(parse->getStatement(0));
+}
+
+// Execute DEALLOCATE PREPARE statement
+QueryResult *SQLExec::deallocate(const DropStatement *statement) {
+    Identifier name = statement->name;
+    auto found = SQLExec::prepared.find(name);
+    if (found == SQLExec::prepared.end())
+        throw SQLExecError("no prepared statement named " + name);
+    delete found->second;
+    SQLExec::prepared.erase(found);
+    return new QueryResult("deallocated " + name);
+}
+
+// Copy a literal argument into a placeholder expression
+void SQLExec::bind_parameter(Expr *placeholder, const Expr *value) {
+    switch (value->type) {
+    case kExprLiteralInt:
+    case kExprLiteralFloat:
+    case kExprLiteralString:
+        break;
+    default:
+        throw SQLExecError("prepared statement parameters must be literals");
+    }
+    placeholder->type = value->type;
+    placeholder->ival = value->ival;
+    placeholder->fval = value->fval;
+    // the AST frees name with free(), so the copy must come from malloc
+    free(placeholder->name);
+    placeholder->name = value->name == nullptr ? nullptr : strdup(value->name);
 }
@@ -6,8 +6,11 @@
 #pragma once
 
 #include <exception>
+#include <map>
+#include <mutex>
 #include <string>
 #include "SQLParser.h"
+#include "locks.h"
 #include "schema_tables.h"
 
 /**
@@ -21,30 +24,97 @@ public:
 
 /**
  * @class QueryResult - data structure to hold all the returned data for a query execution
+ *
+ * Rows are read through fetch(), a batch at a time. A result either owns a
+ * fully built list of rows or is a cursor over handles into a relation, in
+ * which case each batch is projected only when it is fetched, so memory
+ * follows the batch size rather than the result size.
+ *
+ * A cursor outlives the statement that made it, so until it is exhausted
+ * (or deleted) it holds the relation's lock in IS mode, keeping the relation
+ * from being dropped, and holds the vacuum horizon where the statement's
+ * transaction held it, so that neither vacuum nor compact removes a row
+ * version the statement's snapshot selected.
  */
 class QueryResult {
 public:
-    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+    /**
+     * Output formats for write()
+     */
+    enum Format {
+        TABLE,   // human readable, as printed by the shell
+        CSV,     // RFC 4180 comma separated values with a header line
+        TSV,     // tab separated values with a header line, \t \n \\ escaped
+        BINARY   // length-prefixed fields, see write()
+    };
+
+    /**
+     * Rows projected per fetch() by default
+     */
+    static const uint BATCH_SZ = 256;
+
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), relation(nullptr),
+                    handles(nullptr), next_row(0), holding(false), held_horizon(0), message("") {}
 
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
-                                       message(message) {}
+                                       relation(nullptr), handles(nullptr), next_row(0), holding(false),
+                                       held_horizon(0), message(message) {}
 
     QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
-            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
+            : column_names(column_names), column_attributes(column_attributes), rows(rows), relation(nullptr),
+              handles(nullptr), next_row(0), holding(false), held_horizon(0), message(message) {}
+
+    /**
+     * Cursor over rows of a relation (takes ownership of handles, not of relation).
+     * Made inside the statement's transaction, from whose snapshot the handles were selected.
+     */
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, DbRelation *relation,
+                Handles *handles, std::string message);
 
     virtual ~QueryResult();
+    QueryResult(const QueryResult& other) = delete;
+    QueryResult& operator=(const QueryResult& other) = delete;
 
     ColumnNames *get_column_names() const { return column_names; }
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
     ValueDicts *get_rows() const { return rows; }
     const std::string &get_message() const { return message; }
-    friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
+
+    /**
+     * Get the next batch of rows.
+     * @param batch     cleared, then filled with up to max_rows rows (freed by caller)
+     * @param max_rows  batch size
+     * @returns         false once there are no more rows
+     */
+    virtual bool fetch(ValueDicts &batch, uint max_rows=BATCH_SZ);
+
+    /**
+     * Serialize the remaining rows through a buffer that is handed to the
+     * stream in large chunks (never flushed per row).
+     * BINARY writes each field as a 4-byte little-endian length followed by the
+     * bytes (INT fields are 4 bytes little-endian, BOOLEAN 1, a NULL is a length of
+     * 0xfffffffe alone), starting with one field per column name and ending
+     * with a length of 0xffffffff. A NULL is an empty CSV field and \N in TSV.
+     * Only TABLE includes the message.
+     * @param out     stream to write to
+     * @param format  output format
+     */
+    virtual void write(std::ostream &out, Format format=TABLE);
+
+    friend std::ostream &operator<<(std::ostream &stream, QueryResult &qres);
 
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
     ValueDicts *rows;
+    DbRelation *relation;
+    Handles *handles;
+    size_t next_row;
+    bool holding;         // relation lock and vacuum horizon held for the cursor
+    TxnID held_horizon;
     std::string message;
+
+    virtual void release();
 };
 
 
@@ -60,10 +130,72 @@ public:
      */
     static QueryResult *execute(const hsql::SQLStatement *statement) throw(SQLExecError);
 
+    /**
+     * Release the calling session's prepared statements.
+     * Statements may be executed from several threads at once, one session per
+     * thread at a time.
+     */
+    static void end_session();
+
+    /**
+     * Handle a "set <option> <value>" line, which sets an option of the
+     * calling session for the tables it goes on to create:
+     *     set storage heap|mmap|uring    HeapTable backend (default heap)
+     *     set storage column             ColumnTable instead
+     *     set page_size 4K|8K|...|64K    bytes in each block (default 4K)
+     *     set layout row|pax             HeapTable blocks a row or a column at a time
+     *                                    (default row)
+     *     set bloom none|<col>,<col>...  HeapTable columns with a Bloom filter per block
+     *                                    (default none)
+     *     set dictionary none|<col>,...  HeapTable TEXT columns kept as dictionary codes
+     *                                    (default none)
+     *     set compression none|zlib      heap storage blocks compressed on disk (default none)
+     * @param line  the whole line
+     * @returns     message for the user
+     * @throws      SQLExecError for an unknown option or value
+     */
+    static std::string set_option(const std::string &line) throw(SQLExecError);
+
+    /**
+     * Engine counters for the shell's "stats" command.
+     * @returns  human-readable report, one counter per line
+     */
+    static std::string statistics();
+
+    /**
+     * Remove the row versions no transaction can see any more, in every table,
+     * then move the rows out of each table's last blocks into the room left in
+     * earlier ones (their indices following them) and give back the blocks
+     * emptied at the end. Then forget the aborted transactions that no table
+     * refers to any more. Safe to run while other sessions execute statements.
+     * @param blocks_freed  returned by reference: blocks given back
+     * @returns             number of row versions removed
+     */
+    static uint vacuum(uint &blocks_freed);
+
+    /**
+     * Vacuum every table now, for the shell's "vacuum" command.
+     * @returns  what was done, one line
+     */
+    static std::string vacuum_command();
+
 protected:
     // the one place in the system that holds the _tables table
     static Tables *tables;
     static Indices *indices;
+    static std::once_flag schema_once;
+
+    // CREATE and DROP hold this exclusively, everything else shares it
+    static RWLock catalog_lock;
+
+    // prepared statements by name for this session, each parsed once at PREPARE time
+    static thread_local std::map<Identifier, hsql::SQLParserResult *> prepared;
+
+    // this session's "set" options
+    static thread_local std::map<std::string, std::string> options;
+    static std::string get_option(const std::string &option, const std::string &default_value);
+
+    static void open_catalog();
 
     // recursive decent into the AST
     static QueryResult *create(const hsql::CreateStatement *statement);
@@ -76,6 +208,9 @@ protected:
     static QueryResult *show_tables();
     static QueryResult *show_columns(const hsql::ShowStatement *statement);
     static QueryResult *show_index(const hsql::ShowStatement *statement);
+    static QueryResult *prepare(const hsql::PrepareStatement *statement);
+    static QueryResult *execute_prepared(const hsql::ExecuteStatement *statement);
+    static QueryResult *deallocate(const hsql::DropStatement *statement);
 
     /**
      * Pull out column name and attributes from AST's column definition clause
@@ -84,4 +219,11 @@ protected:
      * @param column_attributes  returned by reference
      */
     static void column_definition(const hsql::ColumnDefinition *col, Identifier &column_name, ColumnAttribute &column_attribute);
+
+    /**
+     * Copy a literal EXECUTE argument into a placeholder of a prepared AST
+     * @param placeholder  placeholder expression in the prepared statement
+     * @param value        literal argument from the EXECUTE statement
+     */
+    static void bind_parameter(hsql::Expr *placeholder, const hsql::Expr *value);
 };
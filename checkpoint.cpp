@@ -0,0 +1,59 @@
+/**
+ * @file checkpoint.cpp - implementation of Checkpointer
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <chrono>
+#include <iostream>
+#include "checkpoint.h"
+#include "wal.h"
+using namespace std;
+
+/**
+ * Start the background thread
+ * @param   uint interval  seconds between checkpoints
+ * @param   uint log_mb    log megabytes that trigger a checkpoint
+ */
+Checkpointer::Checkpointer(uint interval, uint log_mb) : interval(interval), log_mb(log_mb), stopping(false) {
+    if (this->interval > 0 || this->log_mb > 0)
+        this->worker = thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer() {
+    stop();
+}
+
+/**
+ * Wake the thread up and wait for it to exit
+ */
+void Checkpointer::stop() {
+    {
+        lock_guard<mutex> guard(this->stop_mutex);
+        this->stopping = true;
+        this->stop_requested.notify_all();
+    }
+    if (this->worker.joinable())
+        this->worker.join();
+}
+
+// Check the clock and the log size every poll until stopped
+void Checkpointer::run() {
+    auto last = chrono::steady_clock::now();
+    unique_lock<mutex> lock(this->stop_mutex);
+    while (!this->stop_requested.wait_for(lock, chrono::milliseconds(POLL_MS),
+                                          [this]() {return this->stopping;})) {
+        bool due = this->interval > 0 && chrono::steady_clock::now() - last >= chrono::seconds(this->interval);
+        bool full = this->log_mb > 0 && WriteAheadLog::since_checkpoint() >= (LSN)this->log_mb * 1024 * 1024;
+        if (!due && !full)
+            continue;
+        lock.unlock();
+        uint spread = this->interval * 1000 / 2;
+        try {
+            WriteAheadLog::checkpoint(spread < MAX_SPREAD_MS ? spread : MAX_SPREAD_MS);
+        } catch (exception &e) {
+            cerr << "(sql5300: checkpoint: " << e.what() << ")" << endl;
+        }
+        last = chrono::steady_clock::now();
+        lock.lock();
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * @file checkpoint.h - background checkpoints of the write-ahead log
+ * Checkpointer
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * @class Checkpointer - thread that keeps crash recovery short
+ *
+ * Takes a WriteAheadLog checkpoint once an interval has passed since the last
+ * one, or sooner once the log recovery would replay has grown past a limit.
+ * Dirty blocks are written back over half the interval (at most MAX_SPREAD_MS)
+ * so that sessions do not see a burst of I/O.
+ */
+class Checkpointer {
+public:
+    /**
+     * Default seconds between checkpoints
+     */
+    static const uint DEFAULT_INTERVAL = 300;
+
+    /**
+     * Default megabytes of log that trigger an early checkpoint
+     */
+    static const uint DEFAULT_LOG_MB = 64;
+
+    /**
+     * @param interval  seconds between checkpoints (0 for no time limit)
+     * @param log_mb    megabytes of log since the last checkpoint that
+     *                  trigger the next one (0 for no size limit)
+     */
+    Checkpointer(uint interval=DEFAULT_INTERVAL, uint log_mb=DEFAULT_LOG_MB);
+    virtual ~Checkpointer();
+    Checkpointer(const Checkpointer& other) = delete;
+    Checkpointer(Checkpointer&& temp) = delete;
+    Checkpointer& operator=(const Checkpointer& other) = delete;
+    Checkpointer& operator=(Checkpointer&& temp) = delete;
+
+    /**
+     * Stop the thread, waiting for a checkpoint in progress to finish.
+     */
+    virtual void stop();
+
+protected:
+    static const uint POLL_MS = 1000;         // how often the log size is checked
+    static const uint MAX_SPREAD_MS = 10000;  // longest a checkpoint spreads its writes
+    uint interval;
+    uint log_mb;
+    bool stopping;
+    std::mutex stop_mutex;
+    std::condition_variable stop_requested;
+    std::thread worker;
+
+    virtual void run();
+};
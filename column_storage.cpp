@@ -0,0 +1,675 @@
+/**
+ * @file column_storage.cpp - implementation of ColumnTable
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include "column_storage.h"
+using namespace std;
+
+typedef u_int16_t u16;
+
+// a closed chunk of a column, decoded by the thread that last read it
+struct DecodedChunk {
+    u_int64_t generation;
+    uint column;
+    BlockID block_id;
+    vector<Value> values;
+};
+
+// closed chunks this thread has decoded lately (they never change)
+static thread_local deque<DecodedChunk> decoded_chunks;
+static const size_t DECODED_CHUNKS = 16;
+
+// Append raw bytes of a fixed-size value to a chunk
+template<typename T>
+static void append_value(string &bytes, T value) {
+    bytes.append((const char *)&value, sizeof(value));
+}
+
+// Read a fixed-size value from a chunk, advancing the offset
+template<typename T>
+static T read_value(const char *bytes, size_t &offset) {
+    T value;
+    memcpy(&value, bytes + offset, sizeof(value));
+    offset += sizeof(value);
+    return value;
+}
+
+atomic<u_int64_t> ColumnTable::generations(0);
+
+/**
+ * One file for the row versions and one per column
+ * @param   table_name         relation name
+ * @param   column_names       column name list
+ * @param   column_attributes  column attribute list
+ * @param   page_size          bytes in each block
+ * @param   layout             "row" (the rest of the HeapTable options are refused too)
+ * @param   bloom_columns      none
+ * @param   dictionary_columns none
+ * @param   compression        "none"
+ */
+ColumnTable::ColumnTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                         uint page_size, const string &layout, const ColumnNames &bloom_columns,
+                         const ColumnNames &dictionary_columns, const string &compression) :
+                         DbRelation(table_name, column_names, column_attributes), versions(nullptr) {
+    // chunks are already kept a column at a time and encoded by their values
+    if (layout != "row")
+        throw DbRelationError("column storage has no layout option");
+    if (!bloom_columns.empty())
+        throw DbRelationError("column storage has no bloom option");
+    if (!dictionary_columns.empty())
+        throw DbRelationError("column storage has no dictionary option");
+    if (compression != "none")
+        throw DbRelationError("column storage has no compression option");
+    if (!PageFile::valid_block_size(page_size))
+        throw DbRelationError("page size must be a power of two from " + to_string(PageFile::MIN_BLOCK_SZ) +
+                              " to " + to_string(PageFile::MAX_BLOCK_SZ));
+    for (ColumnAttribute ca: this->column_attributes)
+        if (ca.get_data_type() != ColumnAttribute::INT && ca.get_data_type() != ColumnAttribute::TEXT)
+            throw DbRelationError("column storage only stores INT and TEXT columns");
+    this->versions = new HeapFile(table_name, page_size);
+    for (auto const &column_name: this->column_names)
+        this->columns.push_back(new HeapFile(table_name + "." + column_name, page_size));
+    this->generation = ++ColumnTable::generations;
+}
+
+ColumnTable::~ColumnTable() {
+    delete this->versions;
+    for (auto const &file: this->columns)
+        delete file;
+}
+
+/**
+ * Execute CREATE TABLE <table_name> ( <columns> )
+ */
+void ColumnTable::create() {
+    this->versions->create();
+    for (auto const &file: this->columns)
+        file->create();
+}
+
+/**
+ * Execute CREATE TABLE IF NOT EXISTS <table_name> ( <columns> )
+ */
+void ColumnTable::create_if_not_exists() {
+    try {
+        open();
+    } catch (DbException &e) {
+        create();
+    }
+}
+
+/**
+ * Execute DROP TABLE <table_name>
+ */
+void ColumnTable::drop() {
+    TableLockGuard lock(this->table_lock, LOCK_X);
+    this->versions->drop();
+    for (auto const &file: this->columns)
+        file->drop();
+    this->generation = ++ColumnTable::generations;
+}
+
+/**
+ * Open existing table. Enables: insert, delete, select, project
+ */
+void ColumnTable::open() {
+    this->versions->open();
+    for (auto const &file: this->columns)
+        file->open();
+    align();
+}
+
+/**
+ * Close the table. Disables: insert, delete, select, project
+ */
+void ColumnTable::close() {
+    this->versions->close();
+    for (auto const &file: this->columns)
+        file->close();
+}
+
+/**
+ * Execute INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> )
+ * The row goes into the last group, or a new one if it does not fit there.
+ * Every column needs a value: a row with a NULL, or without one of them, is refused.
+ * @param   row     the key and value pair to insert
+ * @return  handle  the handle of the inserted row
+ */
+Handle ColumnTable::insert(const ValueDict *row) {
+    open();
+    Transaction transaction;
+    vector<unique_ptr<Dbt>> values;
+    for (uint column = 0; column < this->column_names.size(); column++) {
+        auto value = row->find(this->column_names[column]);
+        if (value == row->end() || value->second.is_null)
+            throw DbRelationError("column storage cannot store NULL in '" + this->column_names[column] + "'");
+        values.push_back(unique_ptr<Dbt>(encode_value(column, value->second)));
+    }
+    TxnID version[2] = {transaction.get_id(), 0};
+    Dbt version_data(version, SlottedPage::VERSION_SZ);
+    Handle handle;
+    bool appended;
+    {
+        TableLockGuard lock(this->table_lock, LOCK_IX);
+        lock_guard<mutex> guard(this->append_mutex);
+        BlockID block_id = this->versions->get_last_block_id();
+        appended = append(block_id, version_data, values, handle);
+        if (!appended) {
+            // close the group and start the next one, version file first
+            seal(block_id);
+            delete this->versions->get_new();
+            for (auto const &file: this->columns)
+                delete file->get_new();
+            appended = append(block_id + 1, version_data, values, handle);
+        }
+    }
+    for (auto const &value: values)
+        delete[] (char *)value->get_data();
+    if (!appended)
+        throw DbRelationError("row too big for a " + to_string(this->versions->get_block_size()) + " byte page");
+    return handle;
+}
+
+// Not implemented
+void ColumnTable::update(const Handle handle, const ValueDict *new_values) {
+    throw DbRelationError("Not implemented");
+}
+
+/**
+ * Execute DELETE FROM <table_name> WHERE <handle>
+ * @param   handle  the row to be deleted
+ * @throw   DbRelationError  another transaction has deleted the row
+ */
+void ColumnTable::del(const Handle handle) {
+    open();
+    Transaction transaction;
+    TableLockGuard lock(this->table_lock, LOCK_IX);
+    BlockID block_id = handle.first;
+    RecordID record_id = handle.second;
+    ExclusiveGuard latch(this->versions->latch(block_id));
+    SlottedPage *block = this->versions->get_for_update(block_id);
+    TxnID xmin, xmax;
+    block->get_version(record_id, xmin, xmax);
+    if (xmax != 0 && xmax != transaction.get_id() && !TransactionManager::is_aborted(xmax)) {
+        delete block;
+        throw DbRelationError("row was deleted by a concurrent transaction");
+    }
+    block->set_xmax(record_id, transaction.get_id());
+    this->versions->put(block);
+    delete block;
+}
+
+/**
+ * Execute SELECT <handle> FROM <table_name>
+ * @return  handles  all rows visible to the calling transaction
+ */
+Handles *ColumnTable::select() {
+    return select(nullptr);
+}
+
+/**
+ * Execute SELECT <handle> FROM <table_name> WHERE <where>
+ * Only the version file and the columns in where are read.
+ * @param   where    key and value pair for condition
+ * @return  handles  qualifying rows visible to the calling transaction
+ */
+Handles *ColumnTable::select(const ValueDict *where) {
+    open();
+    Transaction transaction;
+    const Snapshot &snapshot = transaction.get_snapshot();
+    TableLockGuard lock(this->table_lock, LOCK_IS);
+    vector<pair<uint, Value>> conditions;
+    if (where != nullptr)
+        for (auto const &column: *where)
+            conditions.push_back(make_pair(column_index(column.first), column.second));
+    Handles *handles = new Handles();
+    BlockID last = this->versions->get_last_block_id();
+    vector<Value> values;
+    for (BlockID block_id = 1; block_id <= last; block_id++) {
+        RecordIDs visible;
+        {
+            SharedGuard latch(this->versions->latch(block_id));
+            SlottedPage *block = this->versions->get(block_id);
+            RecordIDs *record_ids = block->ids();
+            for (auto const &record_id: *record_ids) {
+                TxnID xmin, xmax;
+                block->get_version(record_id, xmin, xmax);
+                if (snapshot.visible(xmin, xmax))
+                    visible.push_back(record_id);
+            }
+            delete record_ids;
+            delete block;
+        }
+        for (auto const &condition: conditions) {
+            if (visible.empty())
+                break;
+            read_chunk(condition.first, block_id, values);
+            RecordIDs matching;
+            for (auto const &record_id: visible)
+                if (record_id <= values.size() && values[record_id - 1] == condition.second)
+                    matching.push_back(record_id);
+            visible.swap(matching);
+        }
+        for (auto const &record_id: visible)
+            handles->push_back(Handle(block_id, record_id));
+    }
+    return handles;
+}
+
+/**
+ * Get all the values of a row
+ * @param   handle  row to get
+ * @return  row     values keyed by column name
+ */
+ValueDict *ColumnTable::project(Handle handle) {
+    return project(handle, &this->column_names);
+}
+
+/**
+ * Get some of the values of a row; only those columns are read
+ * @param   handle        row to get
+ * @param   column_names  columns to get (all of them if empty)
+ * @return  row           values keyed by column name
+ * @throw   DbRelationError  if there is no such column
+ */
+ValueDict *ColumnTable::project(Handle handle, const ColumnNames *column_names) {
+    if (column_names == nullptr || column_names->empty())
+        column_names = &this->column_names;
+    TableLockGuard lock(this->table_lock, LOCK_IS);
+    ValueDict *row = new ValueDict();
+    try {
+        for (auto const &column_name: *column_names)
+            (*row)[column_name] = get_value(column_index(column_name), handle.first, handle.second);
+    } catch (...) {
+        delete row;
+        throw;
+    }
+    return row;
+}
+
+/**
+ * Remove the row versions that no snapshot can see any more from the version
+ * file, and clear the deletion marks of aborted transactions (see HeapTable::vacuum)
+ * @return  uint  number of row versions removed
+ */
+uint ColumnTable::vacuum() {
+    open();
+    TableLockGuard lock(this->table_lock, LOCK_IX);
+    TxnID horizon = TransactionManager::horizon();
+    uint removed = 0;
+    BlockID last = this->versions->get_last_block_id();
+    for (BlockID block_id = 1; block_id <= last; block_id++) {
+        ExclusiveGuard latch(this->versions->latch(block_id));
+        SlottedPage *block = this->versions->get_for_update(block_id);
+        RecordIDs *record_ids = block->ids();
+        uint removed_here = 0;
+        bool unmarked = false;
+        for (auto const &record_id: *record_ids) {
+            TxnID xmin, xmax;
+            block->get_version(record_id, xmin, xmax);
+            if (is_dead(xmin, xmax, horizon)) {
+                block->del(record_id);
+                removed_here++;
+            } else if (xmax != 0 && TransactionManager::is_aborted(xmax)) {
+                block->set_xmax(record_id, 0);
+                unmarked = true;
+            }
+        }
+        if (removed_here > 0 || unmarked)
+            this->versions->put(block);
+        removed += removed_here;
+        delete record_ids;
+        delete block;
+    }
+    return removed;
+}
+
+// Position of a column, or DbRelationError if the table has none of that name
+uint ColumnTable::column_index(const Identifier &column_name) const {
+    auto found = find(this->column_names.begin(), this->column_names.end(), column_name);
+    if (found == this->column_names.end())
+        throw DbRelationError("table does not have column named '" + column_name + "'");
+    return (uint)(found - this->column_names.begin());
+}
+
+// Record holding one value in an open chunk
+Dbt *ColumnTable::encode_value(uint column, const Value &value) const {
+    ColumnAttribute ca = this->column_attributes[column];
+    size_t size = 1 + (ca.get_data_type() == ColumnAttribute::INT ? sizeof(int32_t) : value.s.size());
+    if (size > UINT16_MAX)
+        throw DbRelationError("text field too long to store");
+    char *bytes = new char[size];
+    bytes[0] = PLAIN;
+    if (ca.get_data_type() == ColumnAttribute::INT)
+        memcpy(bytes + 1, &value.n, sizeof(int32_t));
+    else
+        memcpy(bytes + 1, value.s.data(), value.s.size());
+    return new Dbt(bytes, (u_int32_t)size);
+}
+
+// Value held by a record of an open chunk
+Value ColumnTable::decode_value(uint column, const Dbt *record) const {
+    const char *bytes = (const char *)record->get_data();
+    ColumnAttribute ca = this->column_attributes[column];
+    if (ca.get_data_type() == ColumnAttribute::INT) {
+        int32_t n;
+        memcpy(&n, bytes + 1, sizeof(n));
+        return Value(n);
+    }
+    return Value(string(bytes + 1, record->get_size() - 1));
+}
+
+// Add a row to a group if it fits in all of its blocks: the version first, then each value
+bool ColumnTable::append(BlockID block_id, Dbt &version, const vector<unique_ptr<Dbt>> &values, Handle &handle) {
+    vector<unique_ptr<ExclusiveGuard>> latches;
+    latches.push_back(unique_ptr<ExclusiveGuard>(new ExclusiveGuard(this->versions->latch(block_id))));
+    unique_ptr<SlottedPage> version_block(this->versions->get_for_update(block_id));
+    RecordID record_id;
+    try {
+        record_id = version_block->add(&version);
+    } catch (DbBlockNoRoomError &e) {
+        return false;
+    }
+    vector<unique_ptr<SlottedPage>> blocks;
+    for (uint column = 0; column < this->columns.size(); column++) {
+        HeapFile *file = this->columns[column];
+        latches.push_back(unique_ptr<ExclusiveGuard>(new ExclusiveGuard(file->latch(block_id))));
+        blocks.push_back(unique_ptr<SlottedPage>(file->get_for_update(block_id)));
+        SlottedPage *block = blocks.back().get();
+        RecordIDs *record_ids = block->ids();
+        size_t n_values = record_ids->size();
+        bool closed = false;
+        if (!record_ids->empty()) {
+            unique_ptr<Dbt> first(block->get(record_ids->front()));
+            closed = *(u_int8_t *)first->get_data() != PLAIN;
+        }
+        delete record_ids;
+        if (closed || n_values >= record_id)
+            return false;  // group was closed (or the files are out of step)
+        try {
+            // a crash may have left the version file a row ahead: fill the gap
+            ColumnAttribute ca = this->column_attributes[column];
+            Value filler = ca.get_data_type() == ColumnAttribute::INT ? Value(0) : Value(string());
+            for (; n_values + 1 < record_id; n_values++) {
+                unique_ptr<Dbt> gap(encode_value(column, filler));
+                block->add(gap.get());
+                delete[] (char *)gap->get_data();
+            }
+            block->add(values[column].get());
+        } catch (DbBlockNoRoomError &e) {
+            return false;
+        }
+    }
+    // nothing has been written yet; the version goes first so the columns never get ahead of it
+    this->versions->put(version_block.get());
+    for (uint column = 0; column < this->columns.size(); column++)
+        this->columns[column]->put(blocks[column].get());
+    handle = Handle(block_id, record_id);
+    return true;
+}
+
+// Give each column file as many blocks as the version file (after a crash while starting a group)
+void ColumnTable::align() {
+    BlockID last = this->versions->get_last_block_id();
+    bool aligned = true;
+    for (auto const &file: this->columns)
+        aligned = aligned && file->get_last_block_id() >= last;
+    if (aligned)
+        return;
+    lock_guard<mutex> guard(this->append_mutex);
+    for (auto const &file: this->columns)
+        while (file->get_last_block_id() < last)
+            delete file->get_new();
+}
+
+// Rewrite each column chunk of a group in its smallest encoding
+void ColumnTable::seal(BlockID block_id) {
+    vector<Value> values;
+    for (uint column = 0; column < this->columns.size(); column++) {
+        HeapFile *file = this->columns[column];
+        ExclusiveGuard latch(file->latch(block_id));
+        unique_ptr<SlottedPage> block(file->get_for_update(block_id));
+        RecordIDs *record_ids = block->ids();
+        bool open_chunk = !record_ids->empty();
+        values.clear();
+        for (auto const &record_id: *record_ids) {
+            unique_ptr<Dbt> record(block->get(record_id));
+            if (*(u_int8_t *)record->get_data() != PLAIN) {
+                open_chunk = false;  // already closed
+                break;
+            }
+            values.push_back(decode_value(column, record.get()));
+        }
+        delete record_ids;
+        if (!open_chunk)
+            continue;
+        string chunk = encode_chunk(column, values);
+        uint block_size = file->get_block_size();
+        void *bytes = calloc(1, block_size);
+        if (bytes == nullptr)
+            throw bad_alloc();
+        Dbt data(bytes, block_size);
+        data.set_flags(DB_DBT_MALLOC);
+        SlottedPage sealed(data, block_id, true);
+        Dbt record((void *)chunk.data(), (u_int32_t)chunk.size());
+        sealed.add(&record);
+        file->put(&sealed);
+    }
+}
+
+// A closed chunk: the values in whichever encoding takes the fewest bytes
+string ColumnTable::encode_chunk(uint column, const vector<Value> &values) const {
+    string best;
+    ColumnAttribute ca = this->column_attributes[column];
+    if (ca.get_data_type() == ColumnAttribute::INT) {
+        string array, runs, offsets;
+        append_value<u_int8_t>(array, INT_ARRAY);
+        append_value<u16>(array, (u16)values.size());
+        for (auto const &value: values)
+            append_value<int32_t>(array, value.n);
+        best = array;
+
+        append_value<u_int8_t>(runs, INT_RUNS);
+        append_value<u16>(runs, (u16)values.size());
+        for (size_t i = 0; i < values.size();) {
+            size_t j = i + 1;
+            while (j < values.size() && values[j].n == values[i].n && j - i < UINT16_MAX)
+                j++;
+            append_value<int32_t>(runs, values[i].n);
+            append_value<u16>(runs, (u16)(j - i));
+            i = j;
+        }
+        if (runs.size() < best.size())
+            best = runs;
+
+        int64_t min = 0, max = 0;
+        if (!values.empty()) {
+            min = max = values[0].n;
+            for (auto const &value: values) {
+                min = std::min(min, (int64_t)value.n);
+                max = std::max(max, (int64_t)value.n);
+            }
+        }
+        u_int8_t width = max - min <= UINT8_MAX ? 1 : max - min <= UINT16_MAX ? 2 : 0;
+        if (width > 0) {
+            append_value<u_int8_t>(offsets, INT_OFFSETS);
+            append_value<u16>(offsets, (u16)values.size());
+            append_value<int32_t>(offsets, (int32_t)min);
+            append_value<u_int8_t>(offsets, width);
+            for (auto const &value: values) {
+                u_int32_t offset = (u_int32_t)(value.n - min);
+                offsets.append((const char *)&offset, width);  // little-endian
+            }
+            if (offsets.size() < best.size())
+                best = offsets;
+        }
+    } else {
+        string array, dictionary;
+        append_value<u_int8_t>(array, TEXT_ARRAY);
+        append_value<u16>(array, (u16)values.size());
+        for (auto const &value: values) {
+            append_value<u16>(array, (u16)value.s.size());
+            array.append(value.s);
+        }
+        best = array;
+
+        map<string, u16> codes;
+        vector<const string *> distinct;
+        for (auto const &value: values) {
+            if (codes.find(value.s) != codes.end())
+                continue;
+            if (distinct.size() == UINT16_MAX)
+                return best;
+            codes[value.s] = (u16)distinct.size();
+            distinct.push_back(&value.s);
+        }
+        append_value<u_int8_t>(dictionary, TEXT_DICTIONARY);
+        append_value<u16>(dictionary, (u16)values.size());
+        append_value<u16>(dictionary, (u16)distinct.size());
+        for (auto const &text: distinct) {
+            append_value<u16>(dictionary, (u16)text->size());
+            dictionary.append(*text);
+        }
+        for (auto const &value: values) {
+            u16 code = codes[value.s];
+            if (distinct.size() <= UINT8_MAX + 1)
+                append_value<u_int8_t>(dictionary, (u_int8_t)code);
+            else
+                append_value<u16>(dictionary, code);
+        }
+        if (dictionary.size() < best.size())
+            best = dictionary;
+    }
+    return best;
+}
+
+// The values of a closed chunk, in record id order
+void ColumnTable::decode_chunk(uint column, const Dbt *record, vector<Value> &values) const {
+    const char *bytes = (const char *)record->get_data();
+    size_t offset = 0;
+    u_int8_t encoding = read_value<u_int8_t>(bytes, offset);
+    u16 n_values = read_value<u16>(bytes, offset);
+    values.clear();
+    values.reserve(n_values);
+    switch (encoding) {
+    case INT_ARRAY:
+        for (u16 i = 0; i < n_values; i++)
+            values.push_back(Value(read_value<int32_t>(bytes, offset)));
+        break;
+    case INT_RUNS:
+        while (values.size() < n_values) {
+            int32_t n = read_value<int32_t>(bytes, offset);
+            u16 count = read_value<u16>(bytes, offset);
+            values.insert(values.end(), count, Value(n));
+        }
+        break;
+    case INT_OFFSETS: {
+        int32_t min = read_value<int32_t>(bytes, offset);
+        u_int8_t width = read_value<u_int8_t>(bytes, offset);
+        for (u16 i = 0; i < n_values; i++) {
+            u_int32_t delta = 0;
+            memcpy(&delta, bytes + offset, width);
+            offset += width;
+            values.push_back(Value((int32_t)(min + (int64_t)delta)));
+        }
+        break;
+    }
+    case TEXT_ARRAY:
+        for (u16 i = 0; i < n_values; i++) {
+            u16 size = read_value<u16>(bytes, offset);
+            values.push_back(Value(string(bytes + offset, size)));
+            offset += size;
+        }
+        break;
+    case TEXT_DICTIONARY: {
+        u16 n_distinct = read_value<u16>(bytes, offset);
+        vector<string> distinct;
+        for (u16 i = 0; i < n_distinct; i++) {
+            u16 size = read_value<u16>(bytes, offset);
+            distinct.push_back(string(bytes + offset, size));
+            offset += size;
+        }
+        for (u16 i = 0; i < n_values; i++) {
+            u16 code = n_distinct <= UINT8_MAX + 1 ? read_value<u_int8_t>(bytes, offset) : read_value<u16>(bytes, offset);
+            values.push_back(Value(distinct.at(code)));
+        }
+        break;
+    }
+    default:
+        throw DbRelationError("unknown encoding " + to_string(encoding) + " in " + this->table_name + "." +
+                              this->column_names[column]);
+    }
+}
+
+// Read all of a column's values in a group, indexed by record id - 1 (true if the chunk is closed)
+bool ColumnTable::read_chunk(uint column, BlockID block_id, vector<Value> &values) {
+    HeapFile *file = this->columns[column];
+    SharedGuard latch(file->latch(block_id));
+    unique_ptr<SlottedPage> block(file->get(block_id));
+    RecordIDs *record_ids = block->ids();
+    bool closed = false;
+    values.clear();
+    for (auto const &record_id: *record_ids) {
+        unique_ptr<Dbt> record(block->get(record_id));
+        if (*(u_int8_t *)record->get_data() != PLAIN) {
+            decode_chunk(column, record.get(), values);
+            closed = true;
+            break;
+        }
+        values.resize(record_id);
+        values[record_id - 1] = decode_value(column, record.get());
+    }
+    delete record_ids;
+    return closed;
+}
+
+// One value of a row (closed chunks are decoded once and kept for the thread's next rows)
+Value ColumnTable::get_value(uint column, BlockID block_id, RecordID record_id) {
+    for (auto const &chunk: decoded_chunks)
+        if (chunk.generation == this->generation && chunk.column == column && chunk.block_id == block_id)
+            return record_id <= chunk.values.size() ? chunk.values[record_id - 1] : Value();
+    HeapFile *file = this->columns[column];
+    DecodedChunk chunk{this->generation, column, block_id, vector<Value>()};
+    {
+        SharedGuard latch(file->latch(block_id));
+        unique_ptr<SlottedPage> block(file->get(block_id));
+        RecordIDs *record_ids = block->ids();
+        RecordID first = record_ids->empty() ? 0 : record_ids->front();
+        RecordID last = record_ids->empty() ? 0 : record_ids->back();
+        delete record_ids;
+        unique_ptr<Dbt> record(first == 0 ? nullptr : block->get(first));
+        if (record != nullptr && *(u_int8_t *)record->get_data() == PLAIN) {
+            // an open chunk: just the one record
+            if (record_id < first || record_id > last)
+                record.reset();
+            else if (record_id != first)
+                record.reset(block->get(record_id));
+            if (record == nullptr)
+                throw DbRelationError("no row " + to_string(block_id) + ":" + to_string(record_id) + " in " +
+                                      this->table_name);
+            return decode_value(column, record.get());
+        }
+        if (record != nullptr)
+            decode_chunk(column, record.get(), chunk.values);
+    }
+    if (record_id == 0 || record_id > chunk.values.size())
+        throw DbRelationError("no row " + to_string(block_id) + ":" + to_string(record_id) + " in " +
+                              this->table_name);
+    Value value = chunk.values[record_id - 1];
+    decoded_chunks.push_back(move(chunk));
+    if (decoded_chunks.size() > DECODED_CHUNKS)
+        decoded_chunks.pop_front();
+    return value;
+}
+
+// Can no snapshot, now or later, see this row version? (see HeapTable::is_dead)
+bool ColumnTable::is_dead(TxnID xmin, TxnID xmax, TxnID horizon) const {
+    if (TransactionManager::is_aborted(xmin))
+        return true;
+    return xmax != 0 && xmax < horizon && !TransactionManager::is_aborted(xmax);
+}
@@ -0,0 +1,107 @@
+/**
+ * @file column_storage.h - columnar implementation of storage_engine
+ * ColumnTable: DbRelation
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class ColumnTable - column-at-a-time storage engine (implementation of DbRelation)
+ *
+ * Rows are stored in groups. Block k of the version file (<table>.db) holds
+ * the version header of each row in group k, and block k of each column's
+ * file (<table>.<column>.db) holds that column's values for the same rows
+ * under the same record ids, so a row's handle is its block and record id
+ * in the version file. A group is closed when any of its blocks is full,
+ * and each of its column chunks is then rewritten as a single record in the
+ * smallest encoding that fits its values (see Encoding).
+ *
+ * Scans read the version file and only the columns they compare, and
+ * project reads only the columns asked for. Multi-version like HeapTable:
+ * del stamps the version, and vacuum removes dead versions from the version
+ * file (their values stay in the column chunks). Inserts are appended one at
+ * a time. HeapTable's layout, Bloom filter, dictionary and compression
+ * options do not apply, and a table given any of them is refused. Nor does
+ * its row header: columns are INT or TEXT only and every row needs a value
+ * in each, so BOOLEAN columns and NULLs are refused.
+ */
+class ColumnTable : public DbRelation {
+public:
+    /**
+     * How a column chunk is stored: one record per value while its group is
+     * open, then one record [u8 encoding][u16 number of values][values]
+     */
+    enum Encoding : u_int8_t {
+        PLAIN = 0,        // a record per value: [PLAIN][int32 or text bytes]
+        INT_ARRAY,        // int32 per value
+        INT_RUNS,         // [int32 value][u16 count] per run of equal values
+        INT_OFFSETS,      // int32 minimum, u8 width, then each value less the minimum in width bytes
+        TEXT_ARRAY,       // [u16 size][bytes] per value
+        TEXT_DICTIONARY   // u16 number of distinct values, each [u16 size][bytes], then a u8 or u16 code per value
+    };
+
+    /**
+     * @param table_name         name of the relation
+     * @param column_names       its columns
+     * @param column_attributes  their types (INT or TEXT)
+     * @param page_size          bytes in each block (see PageFile::valid_block_size)
+     * @param layout             "row" only
+     * @param bloom_columns      none (the HeapTable options are refused, not ignored)
+     * @param dictionary_columns none
+     * @param compression        "none" only
+     */
+    ColumnTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                uint page_size=DbBlock::BLOCK_SZ, const std::string &layout="row",
+                const ColumnNames &bloom_columns=ColumnNames(), const ColumnNames &dictionary_columns=ColumnNames(),
+                const std::string &compression="none");
+    virtual ~ColumnTable();
+    ColumnTable(const ColumnTable& other) = delete;
+    ColumnTable(ColumnTable&& temp) = delete;
+    ColumnTable& operator=(const ColumnTable& other) = delete;
+    ColumnTable& operator=(ColumnTable&& temp) = delete;
+
+    virtual void create();
+    virtual void create_if_not_exists();
+    virtual void drop();
+    virtual void open();
+    virtual void close();
+    virtual Handle insert(const ValueDict* row);
+    virtual void update(const Handle handle, const ValueDict* new_values);
+    virtual void del(const Handle handle);
+    virtual Handles* select();
+    virtual Handles* select(const ValueDict* where);
+    virtual ValueDict* project(Handle handle);
+    virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+    virtual uint vacuum();
+
+    using DbRelation::project;
+
+protected:
+    static std::atomic<u_int64_t> generations;
+    HeapFile *versions;              // version header of each row
+    std::vector<HeapFile*> columns;  // values of each column, in column order
+    std::mutex append_mutex;         // inserts are appended one at a time
+    u_int64_t generation;            // tells this table's decoded chunks from an earlier one's
+
+    virtual uint column_index(const Identifier &column_name) const;
+    virtual Dbt* encode_value(uint column, const Value &value) const;
+    virtual Value decode_value(uint column, const Dbt *record) const;
+    virtual bool append(BlockID block_id, Dbt &version, const std::vector<std::unique_ptr<Dbt>> &values,
+                        Handle &handle);
+    virtual void align();
+    virtual void seal(BlockID block_id);
+    virtual std::string encode_chunk(uint column, const std::vector<Value> &values) const;
+    virtual void decode_chunk(uint column, const Dbt *record, std::vector<Value> &values) const;
+    virtual bool read_chunk(uint column, BlockID block_id, std::vector<Value> &values);
+    virtual Value get_value(uint column, BlockID block_id, RecordID record_id);
+    virtual bool is_dead(TxnID xmin, TxnID xmax, TxnID horizon) const;
+};
@@ -0,0 +1,145 @@
+/**
+ * @file dictionary.cpp - implementation of Dictionary
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "dictionary.h"
+using namespace std;
+
+Dictionary::Dictionary(string name, const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+                       const ColumnNames &encoded_columns) :
+                       filename(name + ".dict"), encoded(column_names.size(), false), n_encoded(0),
+                       values(column_names.size()), codes(column_names.size()), fd(-1), loaded(false) {
+    for (auto const &column_name: encoded_columns) {
+        auto position = std::find(column_names.begin(), column_names.end(), column_name);
+        if (position == column_names.end())
+            throw DbRelationError("table does not have column named '" + column_name + "'");
+        uint index = (uint)(position - column_names.begin());
+        ColumnAttribute ca = column_attributes[index];
+        if (ca.get_data_type() != ColumnAttribute::TEXT)
+            throw DbRelationError("column '" + column_name + "' is not TEXT");
+        if (!this->encoded[index])
+            this->n_encoded++;
+        this->encoded[index] = true;
+    }
+}
+
+Dictionary::~Dictionary() {
+    if (this->fd >= 0)
+        ::close(this->fd);
+}
+
+// Read the whole file, keeping the complete records and cutting off a torn one at the end
+void Dictionary::load() {
+    if (this->loaded || empty())
+        return;
+    lock_guard<mutex> load_guard(this->load_mutex);
+    if (this->loaded)
+        return;
+    ExclusiveGuard guard(this->lock);
+    forget();
+    this->fd = ::open(path().c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (this->fd < 0)
+        throw DbException(("cannot open " + this->filename).c_str(), errno);
+    string bytes;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(this->fd, buffer, sizeof(buffer))) > 0)
+        bytes.append(buffer, (size_t)n);
+    if (n < 0)
+        throw DbException(("cannot read " + this->filename).c_str(), errno);
+    const size_t header_sz = sizeof(u_int16_t) + sizeof(u_int32_t);
+    size_t offset = 0;
+    while (offset + header_sz <= bytes.size()) {
+        u_int16_t column = *(const u_int16_t *)(bytes.data() + offset);
+        u_int32_t size = *(const u_int32_t *)(bytes.data() + offset + sizeof(u_int16_t));
+        if (column >= this->values.size() || offset + header_sz + size > bytes.size())
+            break;
+        string value(bytes.data() + offset + header_sz, size);
+        this->codes[column][value] = (int32_t)this->values[column].size();
+        this->values[column].push_back(value);
+        offset += header_sz + size;
+    }
+    if (offset < bytes.size() && (ftruncate(this->fd, (off_t)offset) != 0 || fdatasync(this->fd) != 0))
+        throw DbException(("cannot repair " + this->filename).c_str(), errno);
+    this->loaded = true;
+}
+
+void Dictionary::close() {
+    lock_guard<mutex> load_guard(this->load_mutex);
+    ExclusiveGuard guard(this->lock);
+    forget();
+}
+
+void Dictionary::drop() {
+    lock_guard<mutex> load_guard(this->load_mutex);
+    ExclusiveGuard guard(this->lock);
+    forget();
+    unlink(path().c_str());
+}
+
+int32_t Dictionary::encode(uint column, const string &value) {
+    int32_t code;
+    if (find(column, value, code))
+        return code;
+    if (value.size() > UINT32_MAX)
+        throw DbRelationError("text field too long to encode");
+    ExclusiveGuard guard(this->lock);
+    auto entry = this->codes[column].find(value);
+    if (entry != this->codes[column].end())
+        return entry->second;  // given one while we waited
+    if (this->values[column].size() >= (size_t)INT32_MAX)
+        throw DbRelationError("too many distinct values to encode");
+    string record;
+    u_int16_t column_number = (u_int16_t)column;
+    u_int32_t size = (u_int32_t)value.size();
+    record.append((const char *)&column_number, sizeof(column_number));
+    record.append((const char *)&size, sizeof(size));
+    record.append(value);
+    if (write(this->fd, record.data(), record.size()) != (ssize_t)record.size() || fdatasync(this->fd) != 0)
+        throw DbException(("cannot write " + this->filename).c_str(), errno);
+    code = (int32_t)this->values[column].size();
+    this->codes[column][value] = code;
+    this->values[column].push_back(value);
+    return code;
+}
+
+bool Dictionary::find(uint column, const string &value, int32_t &code) const {
+    SharedGuard guard(this->lock);
+    auto entry = this->codes[column].find(value);
+    if (entry == this->codes[column].end())
+        return false;
+    code = entry->second;
+    return true;
+}
+
+string Dictionary::decode(uint column, int32_t code) const {
+    SharedGuard guard(this->lock);
+    if (code < 0 || (size_t)code >= this->values[column].size())
+        throw DbRelationError("no value with code " + to_string(code) + " in " + this->filename);
+    return this->values[column][code];
+}
+
+string Dictionary::path() const {
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    return string(env_home) + "/" + this->filename;
+}
+
+// Drop the values and the file descriptor (lock held)
+void Dictionary::forget() {
+    for (auto &column_values: this->values)
+        column_values.clear();
+    for (auto &column_codes: this->codes)
+        column_codes.clear();
+    if (this->fd >= 0)
+        ::close(this->fd);
+    this->fd = -1;
+    this->loaded = false;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file dictionary.h - per-table dictionaries of TEXT values kept as integer codes
+ * Dictionary
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "locks.h"
+#include "storage_engine.h"
+
+/**
+ * @class Dictionary - the distinct values of a table's dictionary-encoded TEXT columns
+ *
+ * Each value of an encoded column gets the next code of its column (from
+ * 0) the first time it is stored, and rows hold the code in place of the
+ * value. Codes are never reused or reassigned, so equal values have equal
+ * codes and a WHERE value that was never stored matches no row.
+ *
+ * The values are appended to <table>.dict in the environment directory as
+ * [u16 column][u32 size][bytes], in the order their codes were handed out,
+ * and the file is synced before a code is returned (so no row on disk ever
+ * refers to a value that is not). A torn record at the end is cut off when
+ * the file is loaded.
+ */
+class Dictionary {
+public:
+    /**
+     * @param name               table name (the file is <name>.dict)
+     * @param column_names       the table's columns
+     * @param column_attributes  their types
+     * @param encoded_columns    TEXT columns to encode
+     * @throws DbRelationError   one of them is not a TEXT column of the table
+     */
+    Dictionary(std::string name, const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+               const ColumnNames &encoded_columns=ColumnNames());
+    virtual ~Dictionary();
+    Dictionary(const Dictionary& other) = delete;
+    Dictionary(Dictionary&& temp) = delete;
+    Dictionary& operator=(const Dictionary& other) = delete;
+    Dictionary& operator=(Dictionary&& temp) = delete;
+
+    /**
+     * Is a column encoded?
+     * @param column  position of the column
+     */
+    virtual bool encodes(uint column) const {return this->encoded[column];}
+
+    /**
+     * Does the table have any encoded columns?
+     */
+    virtual bool empty() const {return this->n_encoded == 0;}
+
+    /**
+     * Read the values in the file (if not read since the last close or drop).
+     */
+    virtual void load();
+
+    /**
+     * Forget the values (the file stays).
+     */
+    virtual void close();
+
+    /**
+     * Forget the values and remove the file.
+     */
+    virtual void drop();
+
+    /**
+     * Code of a value, giving it one if it has none yet.
+     * @param column  position of an encoded column
+     * @param value   the value
+     * @returns       its code
+     */
+    virtual int32_t encode(uint column, const std::string &value);
+
+    /**
+     * Code of a value, if it has one.
+     * @param column  position of an encoded column
+     * @param value   the value
+     * @param code    returned by reference: its code
+     * @returns       false if the value was never encoded
+     */
+    virtual bool find(uint column, const std::string &value, int32_t &code) const;
+
+    /**
+     * Value of a code.
+     * @param column  position of an encoded column
+     * @param code    a code encode returned
+     * @returns       its value
+     * @throws DbRelationError  no such code
+     */
+    virtual std::string decode(uint column, int32_t code) const;
+
+protected:
+    std::string filename;
+    std::vector<bool> encoded;                                  // per column
+    uint n_encoded;
+    std::vector<std::vector<std::string>> values;               // per column, by code
+    std::vector<std::unordered_map<std::string, int32_t>> codes; // per column, by value
+    int fd;                                                     // file appended to, -1 until loaded
+    std::atomic<bool> loaded;
+    std::mutex load_mutex;
+    mutable RWLock lock;
+
+    virtual std::string path() const;
+    virtual void forget();
+};
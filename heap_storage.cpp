@@ -6,16 +6,35 @@
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
 
+#include <algorithm>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
 #include <cstring>
+#include <memory>
 #include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "heap_storage.h"
+#include "column_storage.h"
+#include "mmap_file.h"
+#include "page_codec.h"
+#include "pax_page.h"
+#include "uring_file.h"
+#include "prefetch.h"
+#include "thread_pool.h"
 using namespace std;
 
 typedef uint16_t u16;
 
+// bytes of an overflow page's record taken by the next page's id
+static const uint TOAST_LINK_SZ = sizeof(BlockID);
+
+// bytes of an overflow page that are not its chunk of the value: page header, record header, link
+static const uint TOAST_OVERHEAD = 4 + 4 + TOAST_LINK_SZ;
+
 /************************************************
  *  Implementation of SlottedPage class
  ***********************************************/
@@ -27,13 +46,19 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) :
                          DbBlock(block, block_id, is_new) {
     if (is_new) {
         this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
+        this->end_free = (u16)(block.get_size() - 1);
         put_header();
     } else {
         get_header(this->num_records, this->end_free);
     }
 }
 
+// Free the block's memory if Berkeley DB allocated it for us
+SlottedPage::~SlottedPage() {
+    if (this->block.get_flags() & DB_DBT_MALLOC)
+        free(this->block.get_data());
+}
+
 /**
  * Add a new record to the block.
  * @param   Dbt *data           data to store
@@ -41,7 +66,7 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) :
  * @throw   DbBlockNoRoomError  no room exception error
  */
 RecordID SlottedPage::add(const Dbt *data) throw(DbBlockNoRoomError){
-    if (!has_room((u16)data->get_size()))
+    if (data->get_size() > UINT16_MAX || !has_room((u16)data->get_size()))
         throw DbBlockNoRoomError("not enough room for new record");
     u16 id = ++this->num_records;
     u16 size = (u16)data->get_size();
@@ -83,6 +108,8 @@ void SlottedPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomEr
     // to hold original record location and size
     u16 old_size, old_loc;
     get_header(old_size, old_loc, record_id);
+    if (data.get_size() > UINT16_MAX)
+        throw DbBlockNoRoomError("Not enough room");
     // to hold new record size
     u16 new_size = (u16)data.get_size();
     // in case of new data size is bigger than before and there is no room
@@ -156,6 +183,39 @@ RecordIDs *SlottedPage::ids(void) const {
     return record_ids;
 }
 
+/**
+ * Read the creating and deleting transaction ids of a record
+ * @param   RecordID record_id  target record id
+ * @param   TxnID &xmin         creating transaction
+ * @param   TxnID &xmax         deleting transaction, 0 if none
+ */
+void SlottedPage::get_version(RecordID record_id, TxnID &xmin, TxnID &xmax) const {
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    TxnID *version = (TxnID *)this->address(loc);
+    xmin = version[0];
+    xmax = version[1];
+}
+
+/**
+ * Stamp a record with the transaction that deleted it
+ * @param   RecordID record_id  target record id
+ * @param   TxnID xmax          deleting transaction
+ */
+void SlottedPage::set_xmax(RecordID record_id, TxnID xmax) {
+    if (!have_record(record_id))
+        throw DbBlockError("Record not found");
+    u16 size, loc;
+    get_header(size, loc, record_id);
+    ((TxnID *)this->address(loc))[1] = xmax;
+}
+
+// Copy the block as it is now
+void SlottedPage::keep_image() {
+    const char *bytes = (const char *)this->block.get_data();
+    this->image.assign(bytes, bytes + this->block.get_size());
+}
+
 // Check if the record exists based on the record id
 bool SlottedPage::have_record(RecordID record_id) const {
     if (record_id == 0 || record_id > this->num_records)
@@ -185,9 +245,10 @@ void SlottedPage::put_header(RecordID id, u16 size, u16 loc){
     put_n((u16)(4 * id + 2), loc);
 }
 
-// Check if there is enough room
+// Check if there is enough room for a record of the given size and its header
 bool SlottedPage::has_room(u16 size) const {
-    return 4 * this->num_records + 4 <= this->end_free - size;
+    // the new header ends at 4 * (num_records + 2) - 1; the record starts at end_free - size + 1
+    return 4 * (this->num_records + 2) <= this->end_free - size + 1;
 }
 
 // Slide all record in the blokc left or right direction to compact it
@@ -242,17 +303,150 @@ void *SlottedPage::address(u16 offset) const {
     return (void *)((char *)this->block.get_data() + offset);
 }
 
+/************************************************
+ *  Implementation of PageFile class
+ ***********************************************/
+
+uint PageFile::read_ahead = 32;
+uint PageFile::extent_blocks = 64;
+mutex PageFile::open_files_mutex;
+set<PageFile*> PageFile::open_files;
+atomic<u_int64_t> HeapFile::pool_traffic(0);
+
+// Power of two from MIN_BLOCK_SZ to MAX_BLOCK_SZ
+bool PageFile::valid_block_size(uint block_size) {
+    for (uint size = MIN_BLOCK_SZ; size <= MAX_BLOCK_SZ; size *= 2)
+        if (block_size == size)
+            return true;
+    return false;
+}
+
+/**
+ * Write back the dirty blocks of every open file
+ */
+void PageFile::sync_all() {
+    lock_guard<mutex> guard(PageFile::open_files_mutex);
+    for (PageFile *file: PageFile::open_files)
+        file->sync();
+}
+
+/**
+ * Obtain all blocks from this file
+ * @return  BlockIDs*   vector of block ids
+ */
+BlockIDs *PageFile::block_ids() const {
+    BlockIDs *ids = new BlockIDs();
+    for (BlockID i = 1; i <= this->last; i++) {
+        ids->push_back(i);
+    }
+    return ids;
+}
+
+/**
+ * Get a block, keeping its image for put to log against
+ * @param   BlockID block_id  target block id
+ * @return  SlottedPage*      the block
+ */
+SlottedPage *PageFile::get_for_update(BlockID block_id) {
+    SlottedPage *page = get(block_id);
+    page->keep_image();
+    return page;
+}
+
+// Log the bytes of a block that changed since its image (the whole block if it has none), then keep it as the image
+LSN PageFile::log_block(const string &file_name, DbBlock *block) {
+    const char *after = (const char *)block->get_data();
+    SlottedPage *page = dynamic_cast<SlottedPage *>(block);
+    if (page == nullptr)
+        return WriteAheadLog::log_page(file_name, block->get_block_id(), nullptr, after, this->block_size);
+    vector<char> &image = page->get_image();
+    LSN lsn = WriteAheadLog::log_page(file_name, block->get_block_id(), image.empty() ? nullptr : image.data(),
+                                      after, this->block_size);
+    image.assign(after, after + this->block_size);
+    return lsn;
+}
+
+// Once this thread is reading sequentially, keep read_ahead blocks requested ahead of it
+void PageFile::read_ahead_of(BlockID block_id) {
+    static thread_local const PageFile *recent_file = nullptr;
+    static thread_local BlockID recent_block = 0;
+    static thread_local uint run = 0;
+    if (recent_file == this && block_id == recent_block + 1)
+        run++;
+    else
+        run = 0;
+    recent_file = this;
+    recent_block = block_id;
+    if (PageFile::read_ahead == 0 || run < SEQUENTIAL_RUN)
+        return;
+    BlockID to = block_id + PageFile::read_ahead;
+    if (to > this->last)
+        to = this->last;
+    // top up once half the window has been consumed; a position behind or far
+    // ahead of this reader is another scan's and starts over from here
+    BlockID from = this->prefetched;
+    while (true) {
+        BlockID start = (from < block_id || from > to) ? block_id : from;
+        if (to <= start || (start > block_id && start - block_id > PageFile::read_ahead / 2))
+            return;
+        if (this->prefetched.compare_exchange_weak(from, to)) {
+            prefetch(start + 1, to);
+            return;
+        }
+    }
+}
+
+// Id for get_new to hand out next, growing the file by a whole extent when it is full (alloc_mutex held)
+BlockID PageFile::next_block() {
+    BlockID block_id = this->last + 1;
+    if (block_id > this->allocated) {
+        uint extent = PageFile::extent_blocks;
+        this->allocated = extend(this->last + (extent > 0 ? extent : 1));
+    }
+    return block_id;
+}
+
+// Allocate disk space for a plain file's blocks after from, through the given one (0 or -1 and errno)
+int PageFile::allocate_blocks(int fd, BlockID from, BlockID through) const {
+    off_t offset = (off_t)from * this->block_size;
+    off_t length = (off_t)(through - from) * this->block_size;
+    if (fallocate(fd, 0, offset, length) == 0)
+        return 0;
+    if (errno != EOPNOTSUPP)
+        return -1;
+    // the file system cannot reserve space ahead: just make the file longer
+    return ftruncate(fd, offset + length);
+}
+
+// Set last from the file's length, leaving out the free blocks at the end of its last extent
+void PageFile::find_last(BlockID n_blocks) {
+    this->allocated = n_blocks;
+    this->last = n_blocks;
+    // the file is cut back to its last block when closed, so there are only
+    // blank blocks to skip after a crash
+    while (this->last > 1) {
+        SlottedPage *page = get(this->last);
+        bool blank = page->is_blank();
+        delete page;
+        if (!blank)
+            break;
+        this->last--;
+    }
+}
+
 /************************************************
  *  Implementation of HeapFile class
  ***********************************************/
 
 /**
  * Set name of the relation, and other parameters
- * @param   string name   File name
+ * @param   string name       File name
+ * @param   uint block_size   bytes in each block (Berkeley DB record length unless compressed)
+ * @param   bool compressed   keep the blocks compressed
  */
-HeapFile::HeapFile(std::string name) : DbFile(name), last(0), db(_DB_ENV, 0) {
-    this->dbfilename = this->name + ".db";
-    this->closed = true;
+HeapFile::HeapFile(std::string name, uint block_size, bool compressed) : PageFile(name, block_size),
+                                                                         db(_DB_ENV, 0), compressed(compressed) {
+    this->dbfilename = this->name + (compressed ? ".zdb" : ".db");
 }
 
 /**
@@ -269,6 +463,7 @@ void HeapFile::create(void) {
  */
 void HeapFile::drop(void) {
     close();
+    WriteAheadLog::log_drop(this->dbfilename);
     Db db(_DB_ENV, 0);
     db.remove(this->dbfilename.c_str(), nullptr , 0);
 }
@@ -284,7 +479,10 @@ void HeapFile::open(void) {
  * Close the database file
  */
 void HeapFile::close(void) {
+    lock_guard<mutex> guard(this->open_mutex);
     if (!this->closed) {
+        Prefetcher::shared().forget(&this->db);
+        WriteAheadLog::flush_all();  // closing writes the dirty pages back
         this->db.close(0);
         this->closed = true;
     }
@@ -296,19 +494,27 @@ void HeapFile::close(void) {
  *                        block and tis block id
  */
 SlottedPage *HeapFile::get_new(void) {
-    char block[DbBlock::BLOCK_SZ];
-    memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
-    int block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
-    // write out an empty block and read it back in so Berkeley DB is managing
-    // the memory
-    SlottedPage *page = new SlottedPage(data, this->last, true);
-    // write it out with initialization applied
-    this->db.put(nullptr, &key, &data, 0);
-    delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
+    lock_guard<mutex> guard(this->alloc_mutex);
+    BlockID block_id = next_block();
+    // the page owns its block, so nothing has to be read back from Berkeley DB
+    void *block = calloc(1, this->block_size);
+    if (block == nullptr)
+        throw bad_alloc();
+    Dbt data(block, this->block_size);
+    data.set_flags(DB_DBT_MALLOC);
+    SlottedPage *page = new SlottedPage(data, block_id, true);
+    Dbt initialized(block, this->block_size);
+    try {
+        log_block(this->dbfilename, page);
+        db_put(block_id, &initialized);
+    } catch (...) {
+        delete page;
+        throw;
+    }
+    pool_access(this->block_size);
+    // only publish the new block once it exists for concurrent scans
+    this->last = block_id;
+    return page;
 }
 
 /**
@@ -318,73 +524,206 @@ SlottedPage *HeapFile::get_new(void) {
  */
 SlottedPage *HeapFile::get(BlockID block_id) {
     Dbt data;
+    // DB_THREAD requires the block be copied out into memory we own
+    data.set_flags(DB_DBT_MALLOC);
     Dbt key(&block_id, sizeof(block_id));
     this->db.get(NULL, &key, &data, 0);
+    if (this->compressed && data.get_data() != nullptr) {
+        void *block = malloc(this->block_size);
+        if (block == nullptr) {
+            free(data.get_data());
+            throw bad_alloc();
+        }
+        try {
+            PageCodec::decompress(data.get_data(), data.get_size(), block, this->block_size);
+        } catch (...) {
+            free(block);
+            free(data.get_data());
+            throw;
+        }
+        free(data.get_data());
+        data.set_data(block);
+        data.set_size(this->block_size);
+    }
     SlottedPage *page = new SlottedPage(data, block_id, false);
+    pool_access(this->block_size);
+    read_ahead_of(block_id);
     return page;
 }
 
 /**
- * Write a block to the file
+ * Log a block's change and write it to the file (without waiting for the log, see pool_access)
  * @param   DbBlock *block  target block id
  */
 void HeapFile::put(DbBlock *block) {
-    BlockID id = block->get_block_id();
-    Dbt key(&id, sizeof(id));
-    this->db.put(nullptr, &key, block->get_block(), 0);
+    log_block(this->dbfilename, block);
+    db_put(block->get_block_id(), block->get_block());
+    pool_access(this->block_size);
 }
 
 /**
- * Obtain all blocks from this file
- * @return  BlockIDs*   vector of block ids
+ * Count bytes of pages going through the buffer pool, and force the log once
+ * they add up to half the pool. The pool evicts the pages used least
+ * recently, so until then every page changed since the log was last forced
+ * is still in it rather than on disk.
+ * @param   uint size  bytes of the page
  */
-BlockIDs *HeapFile::block_ids() const {
-    BlockIDs *ids = new BlockIDs();
-    for (BlockID i = 1; i <= this->last; i++) {
-        ids->push_back(i);
+void HeapFile::pool_access(uint size) {
+    static const u_int64_t margin = []() {
+        u_int32_t gbytes = 0, bytes = 0;
+        int n_caches = 0;
+        _DB_ENV->get_cachesize(&gbytes, &bytes, &n_caches);
+        return (((u_int64_t)gbytes << 30) + bytes) / 2;
+    }();
+    if ((HeapFile::pool_traffic += size) < margin)
+        return;
+    HeapFile::pool_traffic = 0;
+    WriteAheadLog::flush_all();
+}
+
+/**
+ * Delete the records of the blocks after the given one and have Berkeley DB
+ * return the pages they leave empty to the file system
+ * @param   BlockID n_blocks  blocks to keep
+ */
+void HeapFile::shrink(BlockID n_blocks) {
+    lock_guard<mutex> guard(this->alloc_mutex);
+    if (n_blocks >= this->last)
+        return;
+    WriteAheadLog::log_shrink(this->dbfilename, n_blocks, this->block_size);
+    for (BlockID block_id = this->last; block_id > n_blocks; block_id--) {
+        Dbt key(&block_id, sizeof(block_id));
+        this->db.del(nullptr, &key, 0);
     }
-    return ids;
+    this->last = n_blocks;
+    this->allocated = n_blocks;
+    if (this->prefetched > n_blocks)
+        this->prefetched = n_blocks;
+    this->db.compact(nullptr, nullptr, nullptr, nullptr, DB_FREE_SPACE, nullptr);
 }
 
 // Get the number of blocks in the file
 uint32_t HeapFile::get_block_count() {
     DB_BTREE_STAT* stat;
     this->db.stat(nullptr, &stat, DB_FAST_STAT);
-    return stat->bt_ndata;
+    uint32_t count = stat->bt_ndata;
+    free(stat);
+    return count;
 }
 
 // Open the database file, and set dbenv parameters
 void HeapFile::db_open(uint flags) {
+    lock_guard<mutex> guard(this->open_mutex);
     if (!this->closed){
         return;
     }
-    this->db.set_re_len(DbBlock::BLOCK_SZ);
-    this->db.open(NULL, this->dbfilename.c_str(), NULL, DB_RECNO, flags, 0644);
+    if (!this->compressed)
+        this->db.set_re_len(this->block_size);
+    this->db.open(NULL, this->dbfilename.c_str(), NULL, DB_RECNO, flags | DB_THREAD, 0644);
     this->last = flags ? 0 : get_block_count();
+    this->allocated = this->last;
     this->closed = false;
 }
 
+// Write a block's record (compressed, if the file is)
+void HeapFile::db_put(BlockID block_id, const Dbt *data) {
+    Dbt key(&block_id, sizeof(block_id));
+    if (!this->compressed) {
+        this->db.put(nullptr, &key, (Dbt *)data, 0);
+        return;
+    }
+    string stored;
+    PageCodec::compress(data->get_data(), this->block_size, stored);
+    Dbt record((void *)stored.data(), (u_int32_t)stored.size());
+    this->db.put(nullptr, &key, &record, 0);
+}
+
+// Have the Prefetcher read blocks into the Berkeley DB buffer pool
+void HeapFile::prefetch(BlockID first, BlockID last) {
+    Prefetcher::shared().request(&this->db, first, last);
+}
+
 /************************************************
  *  Implementation of HeapTable class
  ***********************************************/
 
+uint HeapTable::scan_threads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+uint HeapTable::fill_percent = 50;
+
 /**
  * Takes the name of the relation, the columns, and all the column attributes
  * @param           table_name        relation name
  * ColumnNames      column_names      column name list
  * ColumnAttributes column_attributes column attribute list
+ * string           storage           "heap", "mmap" or "uring"
+ * uint             page_size         bytes in each block
+ * string           layout            "row" or "pax"
+ * ColumnNames      bloom_columns     columns with a Bloom filter per block
+ * ColumnNames      dictionary_columns TEXT columns kept as dictionary codes
+ * string           compression       "none" or "zlib"
  */
 HeapTable::HeapTable(Identifier table_name, ColumnNames column_names,
-                     ColumnAttributes column_attributes) :
+                     ColumnAttributes column_attributes, const string &storage, uint page_size,
+                     const string &layout, const ColumnNames &bloom_columns,
+                     const ColumnNames &dictionary_columns, const string &compression) :
                      DbRelation(table_name, column_names, column_attributes),
-                     file(table_name) {
+                     pax(layout == "pax"), toast_open(false), toast_free_known(false),
+                     zones(table_name, column_names, column_attributes, bloom_columns, page_size / BLOOM_FRACTION),
+                     zones_loaded(false),
+                     dictionary(table_name, column_names, column_attributes, dictionary_columns),
+                     stored_attributes(column_attributes), n_booleans(0) {
+    if (!PageFile::valid_block_size(page_size))
+        throw DbRelationError("page size must be a power of two from " + to_string(PageFile::MIN_BLOCK_SZ) +
+                              " to " + to_string(PageFile::MAX_BLOCK_SZ));
+    if (layout != "row" && layout != "pax")
+        throw DbRelationError("unknown layout " + layout);
+    if (compression != "none" && compression != "zlib")
+        throw DbRelationError("unknown compression " + compression);
+    this->file = new_file(table_name, storage, page_size, compression == "zlib");
+    this->toast = new_file(table_name + ".toast", storage, page_size, compression == "zlib");
+    for (uint column = 0; column < this->stored_attributes.size(); column++) {
+        if (this->dictionary.encodes(column))
+            this->stored_attributes[column].set_data_type(ColumnAttribute::INT);
+        if (this->stored_attributes[column].get_data_type() == ColumnAttribute::BOOLEAN)
+            this->n_booleans++;
+    }
+}
+
+HeapTable::~HeapTable() {
+    delete this->file;
+    delete this->toast;
+}
+
+// Construct the kind of PageFile named by storage
+PageFile *HeapTable::new_file(string name, const string &storage, uint page_size, bool compressed) {
+    if (compressed && storage != "heap")
+        throw DbRelationError("only heap storage can be compressed");
+    if (storage == "mmap")
+        return new MmapFile(name, page_size);
+    else if (storage == "uring")
+        return new UringFile(name, page_size);
+    else if (storage == "heap")
+        return new HeapFile(name, page_size, compressed);
+    else
+        throw DbRelationError("unknown storage " + storage);
+}
+
+// View a block of the table's file in the table's layout (taking it over)
+SlottedPage *HeapTable::page(DbBlock *block) const {
+    if (this->pax)
+        return new PaxPage((SlottedPage *)block, this->stored_attributes);
+    return (SlottedPage *)block;
 }
 
 /**
  * Execute CREATE TABLE <table_name> ( <columns> )
  */
 void HeapTable::create() {
-    this->file.create();
+    this->file->create();
+    this->dictionary.drop();  // any left by an earlier table of the name
+    lock_guard<mutex> guard(this->zones_mutex);
+    this->zones.drop();
+    this->zones_loaded = false;
 }
 
 /**
@@ -403,21 +742,54 @@ void HeapTable::create_if_not_exists() {
  * Exectue DROP TABLE <table_name>
  */
 void HeapTable::drop(){
-    this->file.drop();
+    TableLockGuard lock(this->table_lock, LOCK_X);
+    this->file->drop();
+    this->dictionary.drop();
+    {
+        lock_guard<mutex> zones_guard(this->zones_mutex);
+        this->zones.drop();
+        this->zones_loaded = false;
+    }
+    lock_guard<mutex> guard(this->toast_mutex);
+    try {
+        this->toast->open();
+    } catch (DbException &e) {
+        return;  // never had a long value
+    }
+    this->toast->drop();
+    this->toast_open = false;
 }
 
 /**
  * Open existing table. Enables: insert, delete, select, project
  */
 void HeapTable::open(){
-    this->file.open();
+    this->file->open();
+    this->dictionary.load();
+    if (!this->zones_loaded)
+        load_zones();
 }
 
 /**
  * Close the table. Disables: insert, delete, select, project
  */
 void HeapTable::close(){
-    this->file.close();
+    {
+        lock_guard<mutex> zones_guard(this->zones_mutex);
+        if (this->zones_loaded) {
+            this->zones.save();
+            this->zones_loaded = false;
+        }
+    }
+    this->file->close();
+    this->dictionary.close();
+    lock_guard<mutex> guard(this->toast_mutex);
+    if (this->toast_open) {
+        this->toast->close();
+        this->toast_open = false;
+        this->toast_free_known = false;
+        this->toast_free.clear();
+    }
 }
 
 /**
@@ -428,7 +800,9 @@ void HeapTable::close(){
  */
 Handle HeapTable::insert(const ValueDict *row) {
     open();
+    Transaction transaction;
     ValueDict* full_row = validate(row);
+    TableLockGuard lock(this->table_lock, LOCK_IX);
     Handle handle = append(full_row);
     delete full_row;
     return handle;
@@ -441,15 +815,27 @@ void HeapTable::update(const Handle handle, const ValueDict *new_values) {
 
 /**
  * Execute DELETE FROM <table_name> WHERE <handle>
+ * The row stays in the block, stamped with the deleting transaction, until
+ * vacuum finds that nobody can see it any more.
  * @param   handles   the handle of the row to be deleted
+ * @throw   DbRelationError  another transaction has deleted the row
  */
 void HeapTable::del(const Handle handle) {
     open();
+    Transaction transaction;
+    TableLockGuard lock(this->table_lock, LOCK_IX);
     BlockID block_id = handle.first;
     RecordID record_id = handle.second;
-    SlottedPage* block = this->file.get(block_id);
-    block->del(record_id);
-    this->file.put(block);
+    ExclusiveGuard latch(this->file->latch(block_id));
+    SlottedPage* block = page(this->file->get_for_update(block_id));
+    TxnID xmin, xmax;
+    block->get_version(record_id, xmin, xmax);
+    if (xmax != 0 && xmax != transaction.get_id() && !TransactionManager::is_aborted(xmax)) {
+        delete block;
+        throw DbRelationError("row was deleted by a concurrent transaction");
+    }
+    block->set_xmax(record_id, transaction.get_id());
+    this->file->put(block);
     delete block;
 }
 
@@ -459,43 +845,94 @@ void HeapTable::del(const Handle handle) {
  * @return  handles   a list of handles for all rows
  */
 Handles *HeapTable::select() {
-    open();
-    Handles *handles = new Handles();
-    BlockIDs *block_ids = file.block_ids();
-    for (auto const &block_id : *block_ids) {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id : *record_ids)
-            handles->push_back(Handle(block_id, record_id));
-        delete record_ids;
-        delete block;
-    }
-    delete block_ids;
-    return handles;
+    return select(nullptr);
 }
 
 /**
  * Exectue SELECT <handle> FROM <table_name> WHERE <where>
+ * Only rows visible to the calling transaction's snapshot qualify.
+ * The blocks are split into morsels of MORSEL_SZ that up to scan_threads
+ * tasks on the shared thread pool (the caller helping) take in turn from a
+ * shared cursor; each latches and starts reading all the blocks of a morsel
+ * before filtering them one by one, and the results are concatenated in
+ * block order. The shared latches (a morsel's blocks have latches of their
+ * own) are held from before each read is queued until the block is scanned.
  * @param where     key and value pair for condition
  * @return handles  a list of handles for qualifying rows
  */
 Handles *HeapTable::select(const ValueDict *where) {
+    return scan(where, nullptr, 0);
+}
+
+/**
+ * Execute SELECT <handle> FROM <table_name> WHERE <column> <comparison> <constant(s)>
+ * Like select(where), for the comparisons of an INT column.
+ * @param column_name  INT column compared
+ * @param predicate    comparison
+ * @return handles     a list of handles for qualifying rows
+ * @throw DbRelationError  no such INT column
+ */
+Handles *HeapTable::select(const Identifier &column_name, const IntPredicate &predicate) {
+    auto position = find(this->column_names.begin(), this->column_names.end(), column_name);
+    if (position == this->column_names.end())
+        throw DbRelationError("table does not have column named '" + column_name + "'");
+    uint column = (uint)(position - this->column_names.begin());
+    if (this->column_attributes[column].get_data_type() != ColumnAttribute::INT)
+        throw DbRelationError("column '" + column_name + "' is not INT");
+    return scan(nullptr, &predicate, column);
+}
+
+// Handles of the visible rows that satisfy where and the predicate on the given column (either may be null)
+Handles *HeapTable::scan(const ValueDict *where, const IntPredicate *predicate, uint column) {
     open();
-    Handles *handles = new Handles();
-    BlockIDs *block_ids = file.block_ids();
-    for (auto const &block_id: *block_ids) {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id: *record_ids) {
-            Handle handle(block_id, record_id);
-            if (selected(handle, where)) {
-                handles->push_back(Handle(block_id, record_id));
+    // the blocks are compared with the codes of dictionary-encoded values, the zones with the values
+    ValueDict encoded_where;
+    const ValueDict *stored_where = where;
+    if (where != nullptr && !this->dictionary.empty()) {
+        if (!encode_where(where, encoded_where))
+            return new Handles();
+        stored_where = &encoded_where;
+    }
+    Transaction transaction;
+    const Snapshot &snapshot = transaction.get_snapshot();
+    TableLockGuard lock(this->table_lock, LOCK_IS);
+    BlockID last = this->file->get_last_block_id();
+    uint n_morsels = (last + MORSEL_SZ - 1) / MORSEL_SZ;
+    vector<Handles> morsel_handles(n_morsels);
+    atomic<uint> cursor(0);
+    auto scan = [&]() {
+        try {
+            uint morsel;
+            while ((morsel = cursor++) < n_morsels) {
+                BlockID first = morsel * MORSEL_SZ + 1;
+                vector<BlockID> block_ids;
+                vector<unique_ptr<SharedGuard>> latches;  // from before each read is queued until it is scanned
+                vector<unique_ptr<DbBlockIO>> reads;
+                for (BlockID block_id = first; block_id < first + MORSEL_SZ && block_id <= last; block_id++) {
+                    if ((where != nullptr || predicate != nullptr) &&
+                        !this->zones.may_match(block_id, where, predicate, column))
+                        continue;
+                    block_ids.push_back(block_id);
+                    latches.push_back(unique_ptr<SharedGuard>(new SharedGuard(this->file->latch(block_id))));
+                    reads.push_back(unique_ptr<DbBlockIO>(this->file->get_async(block_id)));
+                }
+                for (BlockID i = 0; i < reads.size(); i++)
+                    scan_block(block_ids[i], *reads[i], snapshot, stored_where, predicate, column,
+                               morsel_handles[morsel]);
             }
+        } catch (...) {
+            cursor = n_morsels;  // stop the others early
+            throw;
         }
-        delete record_ids;
-        delete block;
-    }
-    delete block_ids;
+    };
+    TaskGraph graph;
+    for (uint i = 0; i < HeapTable::scan_threads && i < n_morsels; i++)
+        graph.add(scan);
+    graph.run();
+
+    Handles *handles = new Handles();
+    for (auto const &morsel: morsel_handles)
+        handles->insert(handles->end(), morsel.begin(), morsel.end());
     return handles;
 }
 
@@ -505,14 +942,8 @@ Handles *HeapTable::select(const ValueDict *where) {
  * @return  row     values
  */
 ValueDict *HeapTable::project(Handle handle){
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage *block = this->file.get(block_id);
-    Dbt *data = block->get(record_id);
-    ValueDict *row = unmarshal(data);
-    delete data;
-    delete block;
-    return row;
+    const ColumnNames *all_columns = nullptr;
+    return project(handle, all_columns);
 }
 
 /**
@@ -523,33 +954,39 @@ ValueDict *HeapTable::project(Handle handle){
  * @throw   DbRelationError error if there is no matching column name/s
  */
 ValueDict *HeapTable::project(Handle handle, const ColumnNames *column_names) {
-    ValueDict *result = new ValueDict();
-    ValueDict *row = project(handle);
-    if (column_names == NULL || column_names->empty()) {
-        delete result;
-        return row;
-    } else {
+    if (column_names != NULL && column_names->empty())
+        column_names = NULL;
+    TableLockGuard lock(this->table_lock, LOCK_IS);
+    BlockID block_id = handle.first;
+    RecordID record_id = handle.second;
+    // the latch is held throughout: a mapped block is read in place
+    SharedGuard latch(this->file->latch(block_id));
+    SlottedPage *block = page(this->file->get(block_id));
+    Dbt *data = block->get(record_id);
+    // only the columns asked for are decoded (and read from overflow pages)
+    ValueDict *row = unmarshal(data, column_names);
+    delete data;
+    delete block;
+    if (column_names != NULL) {
         for (auto const &column_name : *column_names) {
-            if (row->find(column_name) != row->end()) {
-                result->insert(std::pair<Identifier, Value>(column_name,
-                               row->at(column_name)));
-            } else {
+            if (row->find(column_name) == row->end()) {
+                delete row;
                 throw DbRelationError("table does not have column named ''" +
                                       column_name + "'");
             }
         }
     }
-    delete row;
-    return result;
+    return row;
 }
 
-// Validate the row before insert it
+// Validate the row before insert it (a column it does not have is NULL)
 ValueDict *HeapTable::validate(const ValueDict *row) const {
     ValueDict *validated = new ValueDict();
+    uint col_num = 0;
     for (auto const &column_name : this->column_names) {
+        ColumnAttribute ca = this->column_attributes[col_num++];
         if (row->find(column_name) == row->end()) {
-            string m = "don't know how to handle NULLs, defaults, etc, yet";
-            throw DbRelationError(m);
+            validated->insert(std::pair<Identifier, Value>(column_name, Value::null(ca.get_data_type())));
         } else {
             validated->insert(std::pair<Identifier, Value>(column_name,
                               row->at(column_name)));
@@ -558,55 +995,368 @@ ValueDict *HeapTable::validate(const ValueDict *row) const {
     return validated;
 }
 
-// Appends a record to the file
-Handle HeapTable::append(const ValueDict *row) {
-    RecordID id;
-    Dbt *data = marshal(row);
-    BlockID last_block_id = this->file.get_last_block_id();
-    SlottedPage *block = this->file.get(last_block_id);
+/**
+ * Remove the row versions that no snapshot can see any more: those created
+ * by an aborted transaction, and those deleted by a transaction that
+ * committed before the oldest running snapshot was taken. The deletion
+ * marks of aborted transactions are cleared, so that once every table has
+ * been vacuumed nothing refers to them (see TransactionManager::forget_aborted)
+ * @return  uint  number of row versions removed
+ */
+uint HeapTable::vacuum() {
+    open();
+    TableLockGuard lock(this->table_lock, LOCK_IX);
+    TxnID horizon = TransactionManager::horizon();
+    uint removed = 0;
+    BlockIDs *block_ids = this->file->block_ids();
+    for (auto const &block_id: *block_ids) {
+        ExclusiveGuard latch(this->file->latch(block_id));
+        SlottedPage *block = page(this->file->get_for_update(block_id));
+        RecordIDs *record_ids = block->ids();
+        uint removed_here = 0;
+        bool unmarked = false;
+        for (auto const &record_id: *record_ids) {
+            TxnID xmin, xmax;
+            block->get_version(record_id, xmin, xmax);
+            if (is_dead(xmin, xmax, horizon)) {
+                Dbt *data = block->get(record_id);
+                free_toast(data);
+                delete data;
+                block->del(record_id);
+                removed_here++;
+            } else if (xmax != 0 && TransactionManager::is_aborted(xmax)) {
+                block->set_xmax(record_id, 0);
+                unmarked = true;
+            }
+        }
+        if (removed_here > 0 || unmarked)
+            this->file->put(block);
+        if (removed_here > 0)
+            summarize(block_id, block);
+        removed += removed_here;
+        delete record_ids;
+        delete block;
+    }
+    delete block_ids;
+    this->zones.save();
+    return removed;
+}
+
+/**
+ * Move the live rows of the blocks at the end of the file into the room left
+ * in earlier blocks filled to less than fill_percent, from the first such
+ * block on, until the two meet. Each row is copied (with copies of its
+ * out-of-line values) as a new version by this transaction, which stamps the
+ * original deleted; rows not yet committed or already deleted stay put.
+ * Readers carry on meanwhile; writers wait.
+ * @param   HandleMoves &moves  returned: old and new handle of each row moved
+ * @return  uint                number of rows moved
+ */
+uint HeapTable::compact(HandleMoves &moves) {
+    open();
+    TableLockGuard lock(this->table_lock, LOCK_SIX);  // until the moves are committed
+    Transaction transaction;
+    const Snapshot &snapshot = transaction.get_snapshot();
+    uint fill_limit = this->file->get_block_size() * HeapTable::fill_percent / 100;
+    uint moved = 0;
+    BlockID source = this->file->get_last_block_id();
+    // next block from the given one on with room to spare, or source if there is none before it
+    auto next_target = [&](BlockID block_id) {
+        while (block_id < source && used(block_id) >= fill_limit)
+            block_id++;
+        return block_id;
+    };
+    for (BlockID target = next_target(1); target < source; source--) {
+        // copy out the rows that can move, then let go of the block
+        vector<pair<RecordID, ValueDict*>> rows;
+        {
+            SharedGuard latch(this->file->latch(source));
+            SlottedPage *block = page(this->file->get(source));
+            RecordIDs *record_ids = block->ids();
+            for (auto const &record_id: *record_ids) {
+                TxnID xmin, xmax;
+                block->get_version(record_id, xmin, xmax);
+                if (xmax == 0 && snapshot.visible(xmin, xmax)) {
+                    Dbt *data = block->get(record_id);
+                    rows.push_back(make_pair(record_id, unmarshal(data)));
+                    delete data;
+                }
+            }
+            delete record_ids;
+            delete block;
+        }
+        RecordIDs moved_here;
+        for (auto const &row: rows) {
+            if (target >= source)
+                break;
+            Dbt *data = marshal(row.second);
+            ((TxnID *)data->get_data())[0] = transaction.get_id();
+            RecordID id = 0;
+            while (target < source && (id = place(target, row.second, data)) == 0)
+                target = next_target(target + 1);
+            if (id == 0)
+                free_toast(data);  // nowhere left to put it
+            else
+                moves.push_back(make_pair(Handle(source, row.first), Handle(target, id)));
+            delete[] (char *)data->get_data();
+            delete data;
+            if (id != 0)
+                moved_here.push_back(row.first);
+        }
+        for (auto const &row: rows)
+            delete row.second;
+        if (!moved_here.empty()) {
+            ExclusiveGuard latch(this->file->latch(source));
+            SlottedPage *block = page(this->file->get_for_update(source));
+            for (auto const &record_id: moved_here)
+                block->set_xmax(record_id, transaction.get_id());
+            this->file->put(block);
+            delete block;
+            moved += (uint)moved_here.size();
+        }
+    }
+    return moved;
+}
+
+/**
+ * Give back the blocks at the end of the file that have no row versions
+ * left (the first block always stays). The table is only locked X once
+ * the last block is seen to be empty.
+ * @return  uint  number of blocks freed
+ */
+uint HeapTable::shrink() {
+    open();
+    {
+        // most passes find nothing to cut: look without holding up the readers
+        TableLockGuard lock(this->table_lock, LOCK_IS);
+        BlockID last = this->file->get_last_block_id();
+        if (last <= 1 || !is_empty(last))
+            return 0;
+    }
+    TableLockGuard lock(this->table_lock, LOCK_X);
+    BlockID last = this->file->get_last_block_id();
+    BlockID keep = last;
+    while (keep > 1 && is_empty(keep)) {
+        this->zones.replace(keep, ValueDicts());
+        keep--;
+    }
+    if (keep == last)
+        return 0;
+    this->file->shrink(keep);
+    this->zones.save();
+    return last - keep;
+}
+
+// Does a block have no row versions left?
+bool HeapTable::is_empty(BlockID block_id) {
+    SharedGuard latch(this->file->latch(block_id));
+    SlottedPage *block = page(this->file->get(block_id));
+    RecordIDs *record_ids = block->ids();
+    bool empty = record_ids->empty();
+    delete record_ids;
+    delete block;
+    return empty;
+}
+
+// Bytes a block's row versions and their slots take up
+uint HeapTable::used(BlockID block_id) {
+    SharedGuard latch(this->file->latch(block_id));
+    SlottedPage *block = page(this->file->get(block_id));
+    RecordIDs *record_ids = block->ids();
+    uint bytes = 0;
+    for (auto const &record_id: *record_ids) {
+        Dbt *data = block->get(record_id);
+        bytes += data->get_size() + 4;
+        delete data;
+    }
+    delete record_ids;
+    delete block;
+    return bytes;
+}
+
+// Add a marshaled row to the given block, returning its id there, or 0 if there is no room
+RecordID HeapTable::place(BlockID block_id, const ValueDict *row, Dbt *data) {
+    ExclusiveGuard latch(this->file->latch(block_id));
+    SlottedPage *block = page(this->file->get_for_update(block_id));
+    RecordID id = 0;
     try {
+        this->zones.widen(block_id, row);
         id = block->add(data);
-    } catch(DbBlockNoRoomError& error) {
-        // need a new block
-        block = this->file.get_new();
-        id = block->add(data);
+        this->file->put(block);
+    } catch (DbBlockNoRoomError &error) {
+        // leave the zones a little wider than they need be
     }
-    this->file.put(block);
-    Handle handle = std::make_pair(this->file.get_last_block_id(), id);
     delete block;
-    free(data->get_data());
+    return id;
+}
+
+// Would a marshaled row fit in a block of its own?
+bool HeapTable::fits_empty(const Dbt *data) const {
+    void *bytes = calloc(1, this->file->get_block_size());
+    if (bytes == nullptr)
+        throw bad_alloc();
+    Dbt empty_data(bytes, this->file->get_block_size());
+    empty_data.set_flags(DB_DBT_MALLOC);  // the page frees it
+    unique_ptr<SlottedPage> empty(page(new SlottedPage(empty_data, 0, true)));
+    try {
+        empty->add(data);
+    } catch (DbBlockNoRoomError &error) {
+        return false;
+    }
+    return true;
+}
+
+// Appends a record to the file, created by the calling transaction
+Handle HeapTable::append(const ValueDict *row) {
+    RecordID id = 0;
+    Transaction transaction;
+    Dbt *data = marshal(row);
+    ((TxnID *)data->get_data())[0] = transaction.get_id();
+    BlockID block_id = this->file->get_last_block_id();
+    while (id == 0) {
+        ExclusiveGuard latch(this->file->latch(block_id));
+        SlottedPage *block = page(this->file->get_for_update(block_id));
+        try {
+            this->zones.widen(block_id, row);  // before the row can reach the disk
+            id = block->add(data);
+            this->file->put(block);
+            delete block;
+        } catch(DbBlockNoRoomError& error) {
+            delete block;
+            // a block without rows may still be full: a PAX block never hands out an id twice
+            if (!fits_empty(data)) {
+                delete[] (char *)data->get_data();
+                delete data;
+                throw;
+            }
+            // need a new block, unless another writer has just added one
+            BlockID last_block_id = this->file->get_last_block_id();
+            if (last_block_id == block_id) {
+                SlottedPage *new_block = this->file->get_new();
+                last_block_id = new_block->get_block_id();
+                delete new_block;
+            }
+            // latch and re-read it: another writer may get to it first
+            block_id = last_block_id;
+        }
+    }
+    Handle handle = std::make_pair(block_id, id);
+    delete[] (char *)data->get_data();
     delete data;
     return handle;
 }
 
-// Return the bits to go into the file
-Dbt *HeapTable::marshal(const ValueDict *row) const {
-    char *bytes = new char[DbBlock::BLOCK_SZ];
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &column_name : this->column_names){
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            if (offset + 4 > DbBlock::BLOCK_SZ - 4)
-                throw DbRelationError("row too big to marshal");
-            *(int32_t *)(bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            uint size = value.s.length();
-            if (size > UINT16_MAX)
-                throw DbRelationError("text field too long to marshal");
-            if (offset + 2 + size > DbBlock::BLOCK_SZ)
-                throw DbRelationError("row too big to marshal");
-            *(u16*) (bytes + offset) = size;
-            offset += sizeof(u16);
-            // Assume ascii
-            memcpy(bytes + offset, value.s.c_str(), size);
-            offset += size;
-        } else {
-            throw DbRelationError("Only know how to marshal INT and TEXT");
+// Read the zone map, or rebuild it from every row version in the blocks if it was not saved clean
+void HeapTable::load_zones() {
+    lock_guard<mutex> guard(this->zones_mutex);
+    if (this->zones_loaded)
+        return;
+    if (!this->zones.load()) {
+        BlockIDs *block_ids = this->file->block_ids();
+        for (auto const &block_id: *block_ids) {
+            SharedGuard latch(this->file->latch(block_id));
+            SlottedPage *block = page(this->file->get(block_id));
+            summarize(block_id, block);
+            delete block;
         }
+        delete block_ids;
+        this->zones.save();
+    }
+    this->zones_loaded = true;
+}
+
+// Set a block's zones from the row versions in it (its latch held)
+void HeapTable::summarize(BlockID block_id, SlottedPage *block) {
+    ValueDicts rows;
+    RecordIDs *record_ids = block->ids();
+    for (auto const &record_id: *record_ids) {
+        Dbt *data = block->get(record_id);
+        rows.push_back(unmarshal(data));
+        delete data;
+    }
+    delete record_ids;
+    this->zones.replace(block_id, rows);
+    for (auto const &row: rows)
+        delete row;
+}
+
+// Return the bits to go into the file, after an empty version header
+// (long TEXT values are written to overflow pages first)
+Dbt *HeapTable::marshal(const ValueDict *row) {
+    uint page_size = this->file->get_block_size();
+    uint toast_threshold = page_size / TOAST_FRACTION;
+    if (this->pax) {
+        // a PAX block has a fixed share for TEXT values, and a row's must fit in it together
+        uint n_text = 0;
+        for (ColumnAttribute ca: this->stored_attributes)
+            if (ca.get_data_type() == ColumnAttribute::DataType::TEXT)
+                n_text++;
+        if (n_text > 0)
+            toast_threshold = min(toast_threshold, PaxPage::text_room(page_size, this->stored_attributes) / n_text);
+    }
+    char *bytes = new char[page_size];
+    char *nulls = bytes + SlottedPage::VERSION_SZ;
+    char *booleans = nulls + (this->column_names.size() + 7) / 8;
+    uint offset = SlottedPage::VERSION_SZ + row_header_size((uint)this->column_names.size(), this->n_booleans);
+    memset(bytes, 0, offset);
+    uint col_num = 0, boolean_num = 0;
+    vector<BlockID> chains;
+    try {
+        for (auto const &column_name : this->column_names){
+            uint column_number = col_num++;
+            ColumnAttribute ca = this->stored_attributes[column_number];
+            ValueDict::const_iterator column = row->find(column_name);
+            Value value = column->second;
+            if (value.is_null) {
+                set_bit(nulls, column_number);
+                if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN)
+                    boolean_num++;
+                continue;
+            }
+            if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
+                if (offset + 4 > page_size - 4)
+                    throw DbRelationError("row too big to marshal");
+                if (this->dictionary.encodes(column_number))
+                    *(int32_t *)(bytes + offset) = this->dictionary.encode(column_number, value.s);
+                else
+                    *(int32_t *)(bytes + offset) = value.n;
+                offset += sizeof(int32_t);
+            } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
+                size_t size = value.s.length();
+                if (size > UINT32_MAX)
+                    throw DbRelationError("text field too long to marshal");
+                if (size > toast_threshold) {
+                    if (offset + 2 + 2 * sizeof(u_int32_t) > page_size)
+                        throw DbRelationError("row too big to marshal");
+                    BlockID first = toast_value(value.s);
+                    chains.push_back(first);
+                    *(u16 *)(bytes + offset) = TOASTED;
+                    offset += sizeof(u16);
+                    *(u_int32_t *)(bytes + offset) = first;
+                    *(u_int32_t *)(bytes + offset + sizeof(u_int32_t)) = (u_int32_t)size;
+                    offset += 2 * sizeof(u_int32_t);
+                    continue;
+                }
+                if (offset + 2 + size > page_size)
+                    throw DbRelationError("row too big to marshal");
+                *(u16*) (bytes + offset) = (u16)size;
+                offset += sizeof(u16);
+                // Assume ascii
+                memcpy(bytes + offset, value.s.c_str(), size);
+                offset += size;
+            } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
+                if (value.n != 0)
+                    set_bit(booleans, boolean_num);
+                boolean_num++;
+            } else {
+                throw DbRelationError("Only know how to marshal INT, TEXT and BOOLEAN");
+            }
+        }
+    } catch (...) {
+        delete[] bytes;
+        for (auto const &first: chains)
+            free_toast_chain(first);
+        throw;
     }
     char *right_size_bytes = new char[offset];
     memcpy(right_size_bytes, bytes, offset);
@@ -616,40 +1366,325 @@ Dbt *HeapTable::marshal(const ValueDict *row) const {
 }
 
 // Transform the bit data from a Dbt object into a ValueDict row
-ValueDict *HeapTable::unmarshal(Dbt *data) const {
+// (just the given columns, if any: only those are read from overflow pages;
+// dictionary-encoded columns are left as their codes unless decode)
+ValueDict *HeapTable::unmarshal(Dbt *data, const ColumnNames *column_names, bool decode) {
     ValueDict *row = new ValueDict();
     char *bytes = (char *)data->get_data();
-    uint offset = 0;
-    uint col_num = 0;
+    const char *nulls = bytes + SlottedPage::VERSION_SZ;
+    const char *booleans = nulls + (this->column_names.size() + 7) / 8;
+    uint offset = SlottedPage::VERSION_SZ + row_header_size((uint)this->column_names.size(), this->n_booleans);
+    uint col_num = 0, boolean_num = 0;
     for (auto const &column_name : this->column_names){
-        ColumnAttribute ca = this->column_attributes[col_num++];
+        uint column_number = col_num++;
+        ColumnAttribute ca = this->stored_attributes[column_number];
+        bool wanted = column_names == nullptr ||
+                      find(column_names->begin(), column_names->end(), column_name) != column_names->end();
+        if (get_bit(nulls, column_number)) {
+            if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN)
+                boolean_num++;
+            if (wanted)
+                row->insert(std::pair<Identifier, Value>(
+                        column_name, Value::null(this->column_attributes[column_number].get_data_type())));
+            continue;
+        }
         if (ca.get_data_type() == ColumnAttribute::DataType::INT){
             int32_t n = *(int32_t *)(bytes + offset);
-            row->insert(std::pair<Identifier, Value>(column_name, Value(n)));
+            if (wanted && decode && this->dictionary.encodes(column_number))
+                row->insert(std::pair<Identifier, Value>(column_name,
+                                                         Value(this->dictionary.decode(column_number, n))));
+            else if (wanted)
+                row->insert(std::pair<Identifier, Value>(column_name, Value(n)));
             offset += sizeof(int32_t);
         }
         else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
             u16 size = *(u16 *)(bytes + offset);
             offset += sizeof(u16);
-            char buffer[DbBlock::BLOCK_SZ];
+            if (size == TOASTED) {
+                BlockID first = *(u_int32_t *)(bytes + offset);
+                u_int32_t length = *(u_int32_t *)(bytes + offset + sizeof(u_int32_t));
+                offset += 2 * sizeof(u_int32_t);
+                if (wanted)
+                    row->insert(std::pair<Identifier, Value>(column_name, Value(detoast_value(first, length))));
+                continue;
+            }
             // Assume ascii for now
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            row->insert(std::pair<Identifier, Value>(column_name, Value(buffer)));
+            if (wanted)
+                row->insert(std::pair<Identifier, Value>(column_name, Value(string(bytes + offset, size))));
             offset += size;
+        } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
+            bool b = get_bit(booleans, boolean_num++);
+            if (wanted)
+                row->insert(std::pair<Identifier, Value>(column_name, Value(b)));
         } else {
-            throw DbRelationError("Only know how to marshal INT and TEXT");
+            throw DbRelationError("Only know how to marshal INT, TEXT and BOOLEAN");
         }
     }
     return row;
 }
 
-// See if the row at the given handle satisfies the given where clause
-bool HeapTable::selected(Handle handle, const ValueDict* where) {
+// Open the overflow file, creating it for the table's first long value
+PageFile *HeapTable::toast_file() {
+    lock_guard<mutex> guard(this->toast_mutex);
+    if (!this->toast_open) {
+        try {
+            this->toast->open();
+        } catch (DbException &e) {
+            this->toast->create();
+        }
+        this->toast_open = true;
+    }
+    return this->toast;
+}
+
+// Write a long value to a chain of overflow pages and return the first one
+BlockID HeapTable::toast_value(const string &value) {
+    PageFile *toast = toast_file();
+    size_t chunk = toast->get_block_size() - TOAST_OVERHEAD;
+    size_t n_pages = value.empty() ? 1 : (value.size() + chunk - 1) / chunk;
+    // take all the pages first so each can link to the next
+    vector<SlottedPage *> pages;
+    for (size_t i = 0; i < n_pages; i++)
+        pages.push_back(new_toast_page());
+    char *record = new char[TOAST_LINK_SZ + chunk];
+    for (size_t i = 0; i < n_pages; i++) {
+        size_t size = min(chunk, value.size() - i * chunk);
+        *(BlockID *)record = i + 1 < n_pages ? pages[i + 1]->get_block_id() : 0;
+        memcpy(record + TOAST_LINK_SZ, value.data() + i * chunk, size);
+        Dbt data(record, (u_int32_t)(TOAST_LINK_SZ + size));
+        ExclusiveGuard latch(toast->latch(pages[i]->get_block_id()));
+        pages[i]->add(&data);
+        toast->put(pages[i]);
+    }
+    delete[] record;
+    BlockID first = pages.front()->get_block_id();
+    for (auto const &page: pages)
+        delete page;
+    return first;
+}
+
+// Read a long value back from its chain of overflow pages
+string HeapTable::detoast_value(BlockID block_id, u_int32_t length) {
+    PageFile *toast = toast_file();
+    string value;
+    value.reserve(length);
+    while (block_id != 0 && value.size() < length) {
+        SharedGuard latch(toast->latch(block_id));
+        SlottedPage *page = toast->get(block_id);
+        Dbt *data = page->get(1);
+        if (data == nullptr || data->get_size() < TOAST_LINK_SZ) {
+            delete data;
+            delete page;
+            break;
+        }
+        char *bytes = (char *)data->get_data();
+        block_id = *(BlockID *)bytes;
+        value.append(bytes + TOAST_LINK_SZ, data->get_size() - TOAST_LINK_SZ);
+        delete data;
+        delete page;
+    }
+    if (value.size() != length)
+        throw DbRelationError("overflow value in " + this->table_name + " is damaged");
+    return value;
+}
+
+// An empty overflow page: a free one if there is any, otherwise a new one
+SlottedPage *HeapTable::new_toast_page() {
+    unique_lock<mutex> lock(this->toast_mutex);
+    if (!this->toast_free_known) {
+        // the pages freed before the file was last opened are the empty ones
+        BlockIDs *block_ids = this->toast->block_ids();
+        for (auto const &block_id: *block_ids) {
+            SharedGuard latch(this->toast->latch(block_id));
+            SlottedPage *page = this->toast->get(block_id);
+            RecordIDs *record_ids = page->ids();
+            if (record_ids->empty())
+                this->toast_free.push_back(block_id);
+            delete record_ids;
+            delete page;
+        }
+        delete block_ids;
+        this->toast_free_known = true;
+    }
+    if (this->toast_free.empty()) {
+        lock.unlock();
+        return this->toast->get_new();
+    }
+    BlockID block_id = this->toast_free.back();
+    this->toast_free.pop_back();
+    lock.unlock();
+    // start it over (nothing else can reach a free page)
+    uint block_size = this->toast->get_block_size();
+    void *block = calloc(1, block_size);
+    if (block == nullptr)
+        throw bad_alloc();
+    Dbt data(block, block_size);
+    data.set_flags(DB_DBT_MALLOC);
+    return new SlottedPage(data, block_id, true);
+}
+
+// Free the overflow pages of a row's long values
+void HeapTable::free_toast(const Dbt *data) {
+    const char *bytes = (const char *)data->get_data();
+    const char *nulls = bytes + SlottedPage::VERSION_SZ;
+    uint offset = SlottedPage::VERSION_SZ + row_header_size((uint)this->column_names.size(), this->n_booleans);
+    uint column_number = 0;
+    for (ColumnAttribute ca: this->stored_attributes) {
+        if (get_bit(nulls, column_number++))
+            continue;
+        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
+            offset += sizeof(int32_t);
+        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
+            u16 size = *(const u16 *)(bytes + offset);
+            offset += sizeof(u16);
+            if (size == TOASTED) {
+                free_toast_chain(*(const u_int32_t *)(bytes + offset));
+                offset += 2 * sizeof(u_int32_t);
+            } else {
+                offset += size;
+            }
+        }
+    }
+}
+
+// Empty each page of a chain of overflow pages and put it on the free list
+void HeapTable::free_toast_chain(BlockID block_id) {
+    PageFile *toast = toast_file();
+    while (block_id != 0) {
+        BlockID next = 0;
+        {
+            ExclusiveGuard latch(toast->latch(block_id));
+            SlottedPage *page = toast->get_for_update(block_id);
+            Dbt *data = page->get(1);
+            if (data == nullptr) {
+                delete page;
+                return;  // already freed
+            }
+            if (data->get_size() >= TOAST_LINK_SZ)
+                next = *(BlockID *)data->get_data();
+            page->del(1);
+            toast->put(page);
+            delete data;
+            delete page;
+        }
+        lock_guard<mutex> guard(this->toast_mutex);
+        // otherwise it is found empty when the list is gathered
+        if (this->toast_free_known)
+            this->toast_free.push_back(block_id);
+        block_id = next;
+    }
+}
+
+// Add the handles of the rows in a block (shared latch held) that are visible and satisfy where and the predicate on column
+void HeapTable::scan_block(BlockID block_id, DbBlockIO &read, const Snapshot &snapshot, const ValueDict *where,
+                           const IntPredicate *predicate, uint column, Handles &handles) {
+    SlottedPage *block = page(read.wait());
+    RecordIDs *record_ids = block->ids();
+    if (this->pax && (where != nullptr || predicate != nullptr)) {
+        // narrow down a column at a time, then check just the survivors' versions
+        PaxPage *pax_block = (PaxPage *)block;
+        if (predicate != nullptr)
+            pax_block->filter(column, *predicate, *record_ids);
+        vector<uint> toastable;  // TEXT columns compared: values out of line still need a look
+        if (where != nullptr) {
+            for (auto const &condition: *where) {
+                auto position = find(this->column_names.begin(), this->column_names.end(), condition.first);
+                if (position == this->column_names.end())
+                    throw DbRelationError("table does not have column named '" + condition.first + "'");
+                uint index = (uint)(position - this->column_names.begin());
+                pax_block->match(index, condition.second, *record_ids);
+                if (condition.second.data_type == ColumnAttribute::TEXT && !condition.second.is_null)
+                    toastable.push_back(index);
+            }
+        }
+        for (auto const &record_id: *record_ids) {
+            TxnID xmin, xmax;
+            block->get_version(record_id, xmin, xmax);
+            if (!snapshot.visible(xmin, xmax))
+                continue;
+            bool toasted = false;
+            for (auto const &index: toastable)
+                toasted = toasted || pax_block->is_toasted(record_id, index);
+            if (!toasted || selected(block, record_id, where))
+                handles.push_back(Handle(block_id, record_id));
+        }
+        delete record_ids;
+        delete block;
+        return;
+    }
+    for (auto const &record_id: *record_ids) {
+        TxnID xmin, xmax;
+        block->get_version(record_id, xmin, xmax);
+        if (snapshot.visible(xmin, xmax) && selected(block, record_id, where) &&
+            (predicate == nullptr || satisfies(block, record_id, *predicate, column)))
+            handles.push_back(Handle(block_id, record_id));
+    }
+    delete record_ids;
+    delete block;
+}
+
+// See if the given record in a block satisfies the given where clause (with dictionary codes, see encode_where)
+bool HeapTable::selected(SlottedPage *block, RecordID record_id, const ValueDict* where) {
     if (where == nullptr)
         return true;
-    ValueDict* row = this->project(handle, where);
-    return *row == *where;
+    ColumnNames where_columns;
+    for (auto const &column: *where)
+        where_columns.push_back(column.first);
+    Dbt *data = block->get(record_id);
+    ValueDict *row = unmarshal(data, &where_columns, false);
+    delete data;
+    bool match = true;
+    for (auto const &column: *where) {
+        auto value = row->find(column.first);
+        if (value == row->end())
+            throw DbRelationError("table does not have column named '" + column.first + "'");
+        if (value->second != column.second) {
+            match = false;
+            break;
+        }
+    }
+    delete row;
+    return match;
+}
+
+// Put each value of where on a dictionary-encoded column in encoded as its code, the others as they are
+// (false if a value has no code, so that no row can match)
+bool HeapTable::encode_where(const ValueDict *where, ValueDict &encoded) const {
+    bool matchable = true;
+    for (auto const &condition: *where) {
+        auto position = find(this->column_names.begin(), this->column_names.end(), condition.first);
+        if (position == this->column_names.end())
+            throw DbRelationError("table does not have column named '" + condition.first + "'");
+        uint index = (uint)(position - this->column_names.begin());
+        int32_t code;
+        if (!this->dictionary.encodes(index) || condition.second.is_null)
+            encoded[condition.first] = condition.second;
+        else if (condition.second.data_type == ColumnAttribute::TEXT &&
+                 this->dictionary.find(index, condition.second.s, code))
+            encoded[condition.first] = Value(code);
+        else
+            matchable = false;
+    }
+    return matchable;
+}
+
+// See if the given record's value in an INT column satisfies the predicate (a NULL never does)
+bool HeapTable::satisfies(SlottedPage *block, RecordID record_id, const IntPredicate &predicate, uint column) {
+    ColumnNames just_column{this->column_names[column]};
+    Dbt *data = block->get(record_id);
+    ValueDict *row = unmarshal(data, &just_column);
+    delete data;
+    const Value &value = row->at(this->column_names[column]);
+    bool holds = !value.is_null && predicate.test(value.n);
+    delete row;
+    return holds;
+}
+
+// Can no snapshot, now or later, see this row version?
+bool HeapTable::is_dead(TxnID xmin, TxnID xmax, TxnID horizon) const {
+    if (TransactionManager::is_aborted(xmin))
+        return true;
+    return xmax != 0 && xmax < horizon && !TransactionManager::is_aborted(xmax);
 }
 
 void test_set_row(ValueDict &row, int a, string b) {
@@ -669,6 +1704,491 @@ bool test_compare(DbRelation &table, Handle handle, int a, string b) {
     return !(value.s != b);
 }
 
+// A block filled to its last byte gives back every record intact
+bool test_slotted_page() {
+    char block[DbBlock::BLOCK_SZ];
+    memset(block, 0, sizeof(block));
+    Dbt data(block, sizeof(block));
+    SlottedPage page(data, 1, true);
+    vector<string> records;
+    for (u_int32_t size = 100; size > 0; size--) {
+        while (true) {
+            string record(size, (char)('A' + records.size() % 26));
+            Dbt record_data((void *)record.data(), size);
+            try {
+                page.add(&record_data);
+            } catch (DbBlockNoRoomError &e) {
+                break;
+            }
+            records.push_back(record);
+        }
+    }
+    bool ok = true;
+    for (RecordID id = 1; id <= records.size(); id++) {
+        Dbt *record = page.get(id);
+        ok = ok && string((char *)record->get_data(), record->get_size()) == records[id - 1];
+        delete record;
+    }
+    cout << "slotted page " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// The table the tests below work on (a INT, b TEXT, then any of Table's options), opened or created
+template <class Table, class... Options>
+static unique_ptr<Table> test_table(const string &name, Options... options) {
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    unique_ptr<Table> table(new Table(name, column_names, column_attributes, options...));
+    table->create_if_not_exists();
+    return table;
+}
+
+// Insert rows a = 0 to n - 1 with the same b, returning their handles
+Handles test_fill(DbRelation &table, int n, string b) {
+    ValueDict row;
+    Handles handles;
+    for (int i = 0; i < n; i++) {
+        test_set_row(row, i, b);
+        handles.push_back(table.insert(&row));
+    }
+    return handles;
+}
+
+// Do select and project give back the rows test_fill inserted, in order?
+bool test_rows(DbRelation &table, int n, string b) {
+    Handles* handles = table.select();
+    bool ok = handles->size() == (size_t)n;
+    int i = 0;
+    for (auto const& handle: *handles)
+        if (ok && !test_compare(table, handle, i++, b))
+            ok = false;
+    delete handles;
+    return ok;
+}
+
+// Scans reading ahead find the same rows as scans that do not
+bool test_read_ahead() {
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_read_ahead_cpp");
+    string b(200, 'r');
+    test_fill(*table, 2000, b);
+    uint read_ahead = PageFile::read_ahead;
+    uint scan_threads = HeapTable::scan_threads;
+    HeapTable::scan_threads = 1;
+    PageFile::read_ahead = 8;
+    bool ok = test_rows(*table, 2000, b);
+    PageFile::read_ahead = 0;
+    ok = ok && test_rows(*table, 2000, b);
+    PageFile::read_ahead = read_ahead;
+    HeapTable::scan_threads = scan_threads;
+    table->drop();
+    cout << "read-ahead " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Rows written to a storage backend are there after a delete and after the file is opened again
+bool test_storage(const string &storage) {
+    string name = "_test_" + storage + "_cpp";
+    string b(100, 's');
+    unique_ptr<HeapTable> table = test_table<HeapTable>(name, storage);
+    Handles handles = test_fill(*table, 1000, b);
+    table->del(handles.back());
+    bool ok = test_rows(*table, 999, b);
+    table->close();
+    table = test_table<HeapTable>(name, storage);
+    ok = ok && test_rows(*table, 999, b);
+    table->drop();
+    cout << storage << " storage " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Size of a file in the environment directory (-1 if there is none)
+off_t test_file_size(const string &file_name) {
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    struct stat status;
+    if (stat((string(env_home) + "/" + file_name).c_str(), &status) != 0)
+        return -1;
+    return status.st_size;
+}
+
+// A plain file grows a whole extent at a time and gives back the unused part of the last one when closed
+bool test_extents() {
+    uint extent_blocks = PageFile::extent_blocks;
+    PageFile::extent_blocks = 8;
+    off_t extent = 8 * DbBlock::BLOCK_SZ;
+    string b(100, 'e');
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_extents_cpp", "mmap");
+    test_fill(*table, 1000, b);
+    off_t open_size = test_file_size("_test_extents_cpp.pages");
+    table->close();
+    off_t closed_size = test_file_size("_test_extents_cpp.pages");
+    PageFile::extent_blocks = extent_blocks;
+    bool ok = open_size > extent && open_size % extent == 0 && closed_size % DbBlock::BLOCK_SZ == 0 &&
+              closed_size <= open_size && open_size - closed_size < extent;
+    table = test_table<HeapTable>("_test_extents_cpp", "mmap");
+    ok = ok && test_rows(*table, 1000, b);
+    table->drop();
+    cout << "extents " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// A table with larger pages keeps its rows in blocks of that size
+bool test_page_size() {
+    const uint page_size = 16384;
+    string b(1000, 'p');  // too long for four to a 4 KB page
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_page_size_cpp", "mmap", page_size);
+    test_fill(*table, 1000, b);
+    bool ok = test_rows(*table, 1000, b);
+    table->close();
+    off_t size = test_file_size("_test_page_size_cpp.pages");
+    ok = ok && size % page_size == 0 && size <= (off_t)page_size * (1000 / 15 + 1);  // 15 or 16 to a page
+    table = test_table<HeapTable>("_test_page_size_cpp", "mmap", page_size);
+    ok = ok && test_rows(*table, 1000, b);
+    table->drop();
+    cout << "page size " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Long TEXT values go out of line and come back whole; vacuum frees their pages for the next ones
+bool test_toast() {
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_toast_cpp", "mmap");
+    string b;
+    for (uint i = 0; i < 3 * DbBlock::BLOCK_SZ; i++)
+        b += (char)('a' + i % 26);
+    Handles handles = test_fill(*table, 20, b);
+    bool ok = test_rows(*table, 20, b);
+    off_t size = test_file_size("_test_toast_cpp.toast.pages");
+    ok = ok && size >= 20 * 3 * DbBlock::BLOCK_SZ;
+    for (auto const &handle: handles)
+        table->del(handle);
+    table->vacuum();
+    test_fill(*table, 20, b);
+    ok = ok && test_rows(*table, 20, b) && test_file_size("_test_toast_cpp.toast.pages") == size;
+    table->drop();
+    ok = ok && test_file_size("_test_toast_cpp.toast.pages") == -1;
+    cout << "toast " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// A column table gives back its rows, finds them by value, and refuses the HeapTable options
+bool test_column_storage() {
+    string b(50, 'c');
+    unique_ptr<ColumnTable> table = test_table<ColumnTable>("_test_column_cpp");
+    Handles handles = test_fill(*table, 1000, b);
+    table->del(handles.back());
+    table->vacuum();
+    bool ok = test_rows(*table, 999, b);
+    ValueDict where;
+    where["a"] = Value(500);
+    Handles *found = table->select(&where);
+    ok = ok && found->size() == 1 && test_compare(*table, found->front(), 500, b);
+    delete found;
+    table->close();
+    table = test_table<ColumnTable>("_test_column_cpp");
+    ok = ok && test_rows(*table, 999, b);
+    table->drop();
+    try {
+        test_table<ColumnTable>("_test_column_cpp", DbBlock::BLOCK_SZ, "pax");
+        ok = false;
+    } catch (DbRelationError &e) {
+        // as expected
+    }
+    cout << "column storage " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// In PAX blocks the rows left by a delete and vacuum keep their handles, and new rows are added after them
+bool test_pax() {
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_pax_cpp", "heap", DbBlock::BLOCK_SZ, "pax");
+    string b(40, 'x');
+    Handles handles = test_fill(*table, 1000, b);
+    for (uint i = 1; i < handles.size(); i += 2)
+        table->del(handles[i]);
+    table->vacuum();
+    ValueDict row;
+    Handles added;
+    for (int i = 0; i < 500; i++) {
+        test_set_row(row, 1000 + i, b);
+        added.push_back(table->insert(&row));
+    }
+    bool ok = true;
+    for (uint i = 0; i < handles.size(); i += 2)
+        ok = ok && test_compare(*table, handles[i], (int)i, b);
+    for (uint i = 0; i < added.size(); i++)
+        ok = ok && test_compare(*table, added[i], 1000 + (int)i, b);
+    Handles *all = table->select();
+    ok = ok && all->size() == 1000;
+    delete all;
+    ValueDict where;
+    where["a"] = Value(1001);
+    Handles *found = table->select(&where);
+    ok = ok && found->size() == 1 && found->front() == added[1];
+    delete found;
+    table->drop();
+    cout << "pax " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Every kernel agrees with IntPredicate::test, and INT comparisons select the right rows in both layouts
+bool test_int_filter() {
+    const uint n = 1003;  // not a whole number of vectors or words
+    vector<int32_t> values;
+    for (uint i = 0; i < n; i++)
+        values.push_back((int32_t)(i * 7919 % 2001) - 1000);
+    vector<u_int64_t> bitmap((n + 63) / 64);
+    bool ok = true;
+    for (int kernel = IntFilter::SCALAR; kernel <= IntFilter::best(); kernel++) {
+        for (int op = IntPredicate::EQ; op <= IntPredicate::BETWEEN; op++) {
+            IntPredicate predicate((IntPredicate::Comparison)op, values[17], 500);
+            IntFilter::filter(values.data(), n, predicate, bitmap.data(), (IntFilter::Kernel)kernel);
+            for (uint i = 0; i < n; i++)
+                ok = ok && ((bitmap[i / 64] >> (i % 64)) & 1) == (u_int64_t)predicate.test(values[i]);
+        }
+    }
+    for (auto const &layout: {"row", "pax"}) {
+        unique_ptr<HeapTable> table = test_table<HeapTable>("_test_int_filter_cpp", "heap", DbBlock::BLOCK_SZ, layout);
+        test_fill(*table, 1000, "f");
+        Handles *found = table->select("a", IntPredicate(IntPredicate::BETWEEN, 100, 199));
+        ok = ok && found->size() == 100 && test_compare(*table, found->front(), 100, "f");
+        delete found;
+        found = table->select("a", IntPredicate(IntPredicate::NE, 5));
+        ok = ok && found->size() == 999;
+        delete found;
+        table->drop();
+    }
+    cout << "int filter " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Rows selected by value
+size_t test_count(DbRelation &table, const Identifier &column_name, const Value &value) {
+    ValueDict where;
+    where[column_name] = value;
+    Handles *found = table.select(&where);
+    size_t n = found->size();
+    delete found;
+    return n;
+}
+
+// Filtered scans skipping blocks by their zones find the same rows, with the map saved and loaded again
+bool test_zone_map() {
+    string b(100, 'z');
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_zone_map_cpp");
+    Handles handles = test_fill(*table, 1000, b);
+    bool ok = test_count(*table, "a", Value(500)) == 1 && test_count(*table, "a", Value(1000)) == 0;
+    table->del(handles[500]);
+    table->vacuum();
+    ok = ok && test_count(*table, "a", Value(500)) == 0 && test_count(*table, "a", Value(501)) == 1;
+    table->close();
+    ok = ok && test_file_size("_test_zone_map_cpp.zones") > 0;
+    table = test_table<HeapTable>("_test_zone_map_cpp");
+    ValueDict row;
+    test_set_row(row, 500, "late");
+    table->insert(&row);  // in the last block, whose zone must widen
+    ok = ok && test_count(*table, "a", Value(500)) == 1 && test_count(*table, "b", Value("late")) == 1 &&
+         test_count(*table, "a", Value(0)) == 1;
+    table->drop();
+    ok = ok && test_file_size("_test_zone_map_cpp.zones") == -1;
+    cout << "zone map " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Equality on Bloom filter columns finds every row with the value, in both layouts, and none without it
+bool test_bloom() {
+    bool ok = true;
+    for (auto const &layout: {"row", "pax"}) {
+        unique_ptr<HeapTable> table = test_table<HeapTable>("_test_bloom_cpp", "heap", DbBlock::BLOCK_SZ, layout,
+                                                            ColumnNames{"a", "b"});
+        ValueDict row;
+        for (int i = 0; i < 1000; i++) {
+            // every block spans the whole range of a, with only some of the values in it
+            test_set_row(row, i % 50 * 20 + i / 50, "v" + to_string(i % 7));
+            table->insert(&row);
+        }
+        for (int a = 0; a < 1000; a += 37)
+            ok = ok && test_count(*table, "a", Value(a)) == 1;
+        ok = ok && test_count(*table, "a", Value(-1)) == 0 && test_count(*table, "a", Value(1000)) == 0 &&
+             test_count(*table, "b", Value("v3")) == 143 && test_count(*table, "b", Value("v7")) == 0;
+        table->drop();
+    }
+    cout << "bloom " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// compact moves the last rows into the room deletes left, and shrink then gives the emptied blocks back;
+// row ids are never handed out again, so PAX blocks that have had all the rows they can hold take no more
+bool test_compact() {
+    string b = "m";
+    bool ok = true;
+    for (auto const &layout: {"row", "pax"}) {
+        unique_ptr<HeapTable> table = test_table<HeapTable>("_test_compact_cpp", "mmap", DbBlock::BLOCK_SZ, layout);
+        Handles handles = test_fill(*table, 1000, b);
+        for (int i = 100; i < 900; i++)
+            table->del(handles[i]);
+        table->vacuum();
+        HandleMoves moves;
+        uint moved = table->compact(moves);
+        table->vacuum();
+        uint freed = table->shrink();
+        // a PAX block takes no more rows once its ids are used up, and only the last one has ids left
+        if (string(layout) == "pax")
+            ok = ok && moved == 0 && freed == 0;
+        else
+            ok = ok && moved > 0 && freed > 0;
+        ok = ok && moves.size() == moved;
+        for (auto const &move: moves) {
+            int a = (int)(find(handles.begin(), handles.end(), move.first) - handles.begin());
+            ok = ok && a >= 900 && a < 1000 && test_compare(*table, move.second, a, b) &&
+                 find(handles.begin(), handles.end(), move.second) == handles.end();
+        }
+        Handles *rest = table->select();
+        ok = ok && rest->size() == 200;
+        delete rest;
+        for (int a = 0; a < 1000; a += 100)
+            ok = ok && test_count(*table, "a", Value(a)) == (a < 100 || a >= 900 ? 1U : 0U);
+        table->drop();
+    }
+    // a PAX block whose ids are used up is full even once vacuum has removed all its rows
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_compact_cpp", "heap", DbBlock::BLOCK_SZ, "pax");
+    ValueDict row;
+    test_set_row(row, 1, b);
+    Handles handles;
+    while (handles.empty() || handles.back().first == 1)
+        handles.push_back(table->insert(&row));
+    for (auto const &handle: handles)
+        table->del(handle);
+    table->vacuum();
+    table->shrink();
+    try {
+        Handle handle = table->insert(&row);
+        ok = ok && handle.first != 1 && test_compare(*table, handle, 1, b) && test_count(*table, "a", Value(1)) == 1;
+    } catch (DbBlockNoRoomError &e) {
+        ok = false;
+    }
+    table->drop();
+    cout << "compact/shrink " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Dictionary-encoded TEXT comes back decoded and is found by equality, also once the dictionary is read back
+bool test_dictionary() {
+    ColumnNames dictionary_columns = {"b"};
+    vector<string> colors = {"red", "green", "blue", ""};
+    bool ok = true;
+    for (auto const &layout: {"row", "pax"}) {
+        unique_ptr<HeapTable> table = test_table<HeapTable>("_test_dictionary_cpp", "heap", DbBlock::BLOCK_SZ, layout,
+                                                            ColumnNames(), dictionary_columns);
+        ValueDict row;
+        for (int i = 0; i < 1000; i++) {
+            test_set_row(row, i, colors[i % colors.size()]);
+            table->insert(&row);
+        }
+        ok = ok && test_count(*table, "b", Value("green")) == 250 && test_count(*table, "b", Value("")) == 250 &&
+             test_count(*table, "b", Value("purple")) == 0;
+        table->close();
+        table = test_table<HeapTable>("_test_dictionary_cpp", "heap", DbBlock::BLOCK_SZ, layout, ColumnNames(),
+                                      dictionary_columns);
+        ValueDict where;
+        where["b"] = Value("blue");
+        Handles *found = table->select(&where);
+        ok = ok && found->size() == 250 && test_compare(*table, found->back(), 998, "blue");
+        delete found;
+        ok = ok && test_count(*table, "b", Value("red")) == 250;
+        table->drop();
+    }
+    cout << "dictionary " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// Blocks kept compressed (.zdb) read back the same, after a change and after the file is opened again
+bool test_compression() {
+    string b(200, 'z');
+    unique_ptr<HeapTable> plain = test_table<HeapTable>("_test_plain_cpp");
+    test_fill(*plain, 1000, b);
+    plain->close();
+    off_t plain_size = test_file_size("_test_plain_cpp.db");
+    plain->drop();
+    unique_ptr<HeapTable> table = test_table<HeapTable>("_test_compression_cpp", "heap", DbBlock::BLOCK_SZ, "row",
+                                                        ColumnNames(), ColumnNames(), "zlib");
+    Handles handles = test_fill(*table, 1000, b);
+    table->del(handles.back());
+    bool ok = test_rows(*table, 999, b);
+    table->close();
+    off_t size = test_file_size("_test_compression_cpp.zdb");
+    ok = ok && size > 0 && size < plain_size / 2 && test_file_size("_test_compression_cpp.db") == -1;
+    table = test_table<HeapTable>("_test_compression_cpp", "heap", DbBlock::BLOCK_SZ, "row", ColumnNames(),
+                                  ColumnNames(), "zlib");
+    ok = ok && test_rows(*table, 999, b);
+    table->drop();
+    cout << "compression " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
+// NULLs and BOOLEANs come back as stored, in both layouts, and zones and Bloom filters neither match nor hide them
+bool test_nulls() {
+    ColumnNames column_names = {"a", "b", "c"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+                                          ColumnAttribute(ColumnAttribute::BOOLEAN)};
+    bool ok = true;
+    for (auto const &layout: {"row", "pax"}) {
+        size_t v3 = 0;
+        {
+            HeapTable table("_test_nulls_cpp", column_names, column_attributes, "heap", DbBlock::BLOCK_SZ, layout,
+                            {"a", "b"});
+            table.create();
+            for (int i = 0; i < 1000; i++) {
+                // a is NULL in every tenth row and b in the last blocks
+                ValueDict row;
+                if (i % 10 != 0)
+                    row["a"] = Value(i);
+                row["b"] = i < 900 ? Value("v" + to_string(i % 7)) : Value::null(ColumnAttribute::TEXT);
+                row["c"] = Value(i % 2 == 0);
+                table.insert(&row);
+                v3 += i < 900 && i % 7 == 3 ? 1 : 0;
+            }
+            table.close();
+        }
+        HeapTable table("_test_nulls_cpp", column_names, column_attributes, "heap", DbBlock::BLOCK_SZ, layout,
+                        {"a", "b"});
+        table.open();
+        ok = ok && test_count(table, "a", Value::null(ColumnAttribute::INT)) == 100 &&
+             test_count(table, "a", Value(0)) == 0 && test_count(table, "a", Value(10)) == 0 &&
+             test_count(table, "a", Value(11)) == 1 &&
+             test_count(table, "b", Value::null(ColumnAttribute::TEXT)) == 100 &&
+             test_count(table, "b", Value("v3")) == v3 && test_count(table, "c", Value(true)) == 500;
+        Handles *found = table.select("a", IntPredicate(IntPredicate::BETWEEN, 0, 20));
+        ok = ok && found->size() == 18;
+        delete found;
+        found = table.select();
+        ValueDict *row = table.project(found->front());
+        ok = ok && (*row)["a"].is_null && (*row)["b"] == Value("v0") && (*row)["c"] == Value(true);
+        delete row;
+        row = table.project(found->back());
+        ok = ok && (*row)["a"] == Value(999) && (*row)["b"].is_null && (*row)["c"] == Value(false);
+        delete row;
+        delete found;
+        table.drop();
+    }
+    try {
+        ColumnTable table("_test_nulls_cpp", column_names, column_attributes);
+        ok = false;
+    } catch (DbRelationError &e) {
+        // as expected
+    }
+    unique_ptr<ColumnTable> table = test_table<ColumnTable>("_test_nulls_cpp");
+    ValueDict row;
+    row["a"] = Value(1);
+    try {
+        table->insert(&row);
+        ok = false;
+    } catch (DbRelationError &e) {
+        // as expected
+    }
+    table->drop();
+    cout << "nulls " << (ok ? "ok" : "failed") << endl;
+    return ok;
+}
+
 // test function -- returns true if all tests pass
 bool test_heap_storage() {
     ColumnNames column_names;
@@ -724,5 +2244,20 @@ bool test_heap_storage() {
     cout << "del ok" << endl;
     table.drop();
     delete handles;
-    return true;
+    return test_slotted_page()
+        && test_read_ahead()
+        && test_storage("mmap")
+        && test_storage("uring")
+        && test_extents()
+        && test_page_size()
+        && test_toast()
+        && test_column_storage()
+        && test_pax()
+        && test_int_filter()
+        && test_zone_map()
+        && test_bloom()
+        && test_compact()
+        && test_dictionary()
+        && test_compression()
+        && test_nulls();
 }
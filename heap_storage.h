@@ -1,7 +1,8 @@
 /**
  * @file heap_storage.h - Implementation of storage_engine with a heap file structure.
  * SlottedPage: DbBlock
- * HeapFile: DbFile
+ * PageFile: DbFile
+ * HeapFile: PageFile
  * HeapTable: DbRelation
  *
  * @author Kevin Lundeen
@@ -10,8 +11,17 @@
 #pragma once
 
 #include "db_cxx.h"
+#include "dictionary.h"
+#include "int_filter.h"
 #include "storage_engine.h"
+#include "transaction.h"
+#include "wal.h"
+#include "zone_map.h"
+#include <atomic>
 #include <cstring>
+#include <mutex>
+#include <set>
+#include <vector>
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -25,14 +35,22 @@
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+        Each record begins with its version header: the id of the transaction that created
+        it (xmin) followed by the id of the transaction that deleted it (xmax, 0 if none).
  *
  */
 class SlottedPage : public DbBlock {
 public:
+    /**
+     * Size of the version header at the start of every record
+     */
+    static const u_int16_t VERSION_SZ = 2 * sizeof(TxnID);
+
     SlottedPage(Dbt &block, BlockID block_id, bool is_new=false);
     // Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are unnecessary
     // but we delete them explicitly just to make sure we don't use them accidentally
-    virtual ~SlottedPage() {}
+    // (a block fetched with DB_DBT_MALLOC owns its memory and frees it here)
+    virtual ~SlottedPage();
     SlottedPage(const SlottedPage& other) = delete;
     SlottedPage(SlottedPage&& temp) = delete;
     SlottedPage& operator=(const SlottedPage& other) = delete;
@@ -44,9 +62,44 @@ public:
     virtual void del(RecordID record_id);
     virtual RecordIDs* ids(void) const;
 
+    /**
+     * Read a record's version header.
+     * @param record_id  record to look at
+     * @param xmin       returned by reference: creating transaction
+     * @param xmax       returned by reference: deleting transaction or 0
+     */
+    virtual void get_version(RecordID record_id, TxnID &xmin, TxnID &xmax) const;
+
+    /**
+     * Mark a record as deleted by the given transaction, in place.
+     * @param record_id  record to mark
+     * @param xmax       deleting transaction
+     */
+    virtual void set_xmax(RecordID record_id, TxnID xmax);
+
+    /**
+     * Is this block still all zeros, i.e. preallocated but never handed out?
+     * @returns  true if it was never initialized as a page
+     */
+    virtual bool is_blank() const {return this->num_records == 0 && this->end_free == 0;}
+
+    /**
+     * Keep a copy of the block as it is now, so that the change made to it
+     * from here on can be logged without reading it again.
+     */
+    virtual void keep_image();
+
+    /**
+     * The copy keep_image made (refreshed each time the block is logged),
+     * empty if there is none. A page made from this one takes it over.
+     * @returns  the block's contents when last kept
+     */
+    virtual std::vector<char>& get_image() {return this->image;}
+
 protected:
     u_int16_t num_records;
     u_int16_t end_free;
+    std::vector<char> image;  // contents as last logged (see keep_image)
 
     virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id=0) const;
     virtual void put_header(RecordID id=0, u_int16_t size=0, u_int16_t loc=0);
@@ -59,6 +112,117 @@ protected:
     virtual bool have_record(RecordID record_id) const;
 };
 
+/**
+ * @class PageFile - DbFile of SlottedPages shared by several threads
+ *
+ * What the heap table's storage backends have in common: block ids run from 1
+ * to the last block, callers hold the block's latch (shared to read,
+ * exclusive to read-modify-write) around get/put, and once a thread reads
+ * blocks in sequence the next ones are read ahead.
+ */
+class PageFile : public DbFile {
+public:
+    /**
+     * Blocks to read ahead of a sequential reader (0 turns read-ahead off)
+     */
+    static uint read_ahead;
+
+    /**
+     * Blocks a plain file grows by at a time (the ones not yet handed out by
+     * get_new are kept for the next calls)
+     */
+    static uint extent_blocks;
+
+    /**
+     * Write back the dirty blocks of every open file that keeps its own (done
+     * at each checkpoint; Berkeley DB's are written back separately).
+     */
+    static void sync_all();
+
+    /**
+     * Page sizes a table may be created with
+     */
+    static const uint MIN_BLOCK_SZ = 4096;
+    static const uint MAX_BLOCK_SZ = 65536;
+
+    /**
+     * Is this a page size a table may be created with (a power of two from
+     * MIN_BLOCK_SZ to MAX_BLOCK_SZ, so 16-bit offsets reach every byte)?
+     * @param block_size  page size in bytes
+     * @returns           true if it may be used
+     */
+    static bool valid_block_size(uint block_size);
+
+    PageFile(std::string name, uint block_size) : DbFile(name), last(0), prefetched(0), closed(true),
+                                                  block_size(block_size), allocated(0) {}
+    virtual ~PageFile() {}
+    PageFile(const PageFile& other) = delete;
+    PageFile(PageFile&& temp) = delete;
+    PageFile& operator=(const PageFile& other) = delete;
+    PageFile& operator=(PageFile&& temp) = delete;
+
+    virtual SlottedPage* get_new(void) = 0;
+    virtual SlottedPage* get(BlockID block_id) = 0;
+
+    /**
+     * Get a block to change and put back (its exclusive latch held), keeping
+     * its image so that put logs only the bytes that changed.
+     * @param block_id  block to get
+     * @returns         the block
+     */
+    virtual SlottedPage* get_for_update(BlockID block_id);
+
+    virtual BlockIDs* block_ids() const;
+    virtual u_int32_t get_last_block_id() {return last;}
+    virtual uint get_block_size() const {return block_size;}
+
+    /**
+     * Get the latch protecting a block (latches are striped over the block ids).
+     * @param block_id  block to be latched
+     * @returns         its latch
+     */
+    virtual Latch& latch(BlockID block_id) {return latches[block_id % N_LATCHES];}
+
+    /**
+     * Write back this file's dirty blocks and wait for them.
+     */
+    virtual void sync() {}
+
+    /**
+     * Cut the file back to its first blocks, giving the rest back to the file
+     * system (the caller makes sure they hold no rows and nobody reads them).
+     * @param n_blocks  blocks to keep
+     */
+    virtual void shrink(BlockID n_blocks) = 0;
+
+protected:
+    static const uint N_LATCHES = 64;
+    static std::mutex open_files_mutex;
+    static std::set<PageFile*> open_files;  // the ones sync_all() syncs
+    static const uint SEQUENTIAL_RUN = 2;  // consecutive reads before reading ahead
+    std::atomic<u_int32_t> last;
+    std::atomic<u_int32_t> prefetched;  // read-ahead has been requested up to here
+    bool closed;
+    uint block_size;  // bytes in each block
+    std::mutex open_mutex;  // guards closed and opening/closing
+    std::mutex alloc_mutex;  // serializes get_new
+    BlockID allocated;  // blocks the file has room for: last+1 to here are free
+    Latch latches[N_LATCHES];
+    virtual void read_ahead_of(BlockID block_id);
+    virtual LSN log_block(const std::string &file_name, DbBlock *block);
+    virtual void prefetch(BlockID first, BlockID last) = 0;
+    virtual int allocate_blocks(int fd, BlockID from, BlockID through) const;
+    virtual BlockID next_block();
+    virtual void find_last(BlockID n_blocks);
+
+    /**
+     * Make room in the file for blocks up to the given one (alloc_mutex held).
+     * @param through  block the file should extend to at least
+     * @returns        block the file now extends to
+     */
+    virtual BlockID extend(BlockID through) {return through;}
+};
+
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
@@ -66,10 +230,22 @@ protected:
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+        The database is opened with DB_THREAD and every block is copied out into memory owned by its
+        SlottedPage, so one HeapFile can be shared by several threads.
+        Every block written is logged to the WriteAheadLog, against the image kept by get_for_update,
+        and handed to Berkeley DB at once. The buffer pool may write a page back whenever it needs the
+        room, so the log is forced whenever pages adding up to half the pool have gone through it
+        since the last time (see pool_access), as well as before the file is closed and before a
+        checkpoint writes pages back.
+        Read-ahead is done by the Prefetcher thread.
+        A compressed heap file (<name>.zdb rather than <name>.db) keeps each block as a
+        variable-length record compressed by PageCodec: the Berkeley DB buffer pool and the disk hold
+        the compressed images, and a block is decompressed into the memory of its SlottedPage when it
+        is read and compressed again when it is written back. The log still holds whole blocks.
  */
-class HeapFile : public DbFile {
+class HeapFile : public PageFile {
 public:
-    HeapFile(std::string name);
+    HeapFile(std::string name, uint block_size=DbBlock::BLOCK_SZ, bool compressed=false);
     virtual ~HeapFile() {}
     HeapFile(const HeapFile& other) = delete;
     HeapFile(HeapFile&& temp) = delete;
@@ -83,26 +259,149 @@ public:
     virtual SlottedPage* get_new(void);
     virtual SlottedPage* get(BlockID block_id);
     virtual void put(DbBlock* block);
-    virtual BlockIDs* block_ids() const;
-    virtual u_int32_t get_last_block_id() {return last;}
+    virtual void shrink(BlockID n_blocks);
+
+    /**
+     * Note a page going into or out of the Berkeley DB buffer pool (the
+     * Prefetcher's reads too), forcing the log if enough have that a page
+     * changed since it was last forced could be evicted.
+     * @param size  bytes of the page
+     */
+    static void pool_access(uint size);
 
 protected:
+    static std::atomic<u_int64_t> pool_traffic;  // bytes through the buffer pool since the log was last forced
     std::string dbfilename;
-    u_int32_t last;
-    bool closed;
     Db db;
+    bool compressed;
     virtual void db_open(uint flags=0);
+    virtual void db_put(BlockID block_id, const Dbt *data);
+    virtual void prefetch(BlockID first, BlockID last);
     virtual uint32_t get_block_count();
 };
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * Multi-version: del only stamps the row with the deleting transaction, and
+ * scans return the rows visible to the calling transaction's snapshot, so
+ * readers and writers never wait for each other. Scans and project hold the
+ * table lock in IS mode, insert, del and vacuum IX and drop X, with a latch
+ * on each block while it is read or changed.
+ *
+ * The rows are kept in a HeapFile (Berkeley DB), an MmapFile (a plain file
+ * mapped into memory) or a UringFile (a plain file read and written with
+ * io_uring), chosen when the table is constructed, in blocks of the page
+ * size it was created with. With "zlib" compression (heap storage only) the
+ * HeapFile keeps its blocks compressed, for tables read far more than they
+ * are written.
+ *
+ * TEXT values longer than a quarter of a page are kept out of line in a
+ * second file of the same kind (<table>.toast), split over a chain of
+ * overflow pages; the row holds only the first page and the length. They
+ * are read back only when their column is projected or compared. Vacuum
+ * frees the chains of the row versions it removes for reuse.
+ *
+ * With the "pax" layout each block keeps its rows a column at a time (see
+ * PaxPage), and a scan compares WHERE values against each column's array
+ * in the block before looking at any row, INT columns with vectorized
+ * kernels (see IntFilter).
+ *
+ * Filtered scans do not read the blocks whose zone maps (see ZoneMap) rule
+ * out every row in them, nor, for equality on the columns chosen for Bloom
+ * filters, the blocks whose filters do not have the value. The map is
+ * rebuilt from the blocks when the table is opened if its file was not saved
+ * clean; vacuum tightens the zones of the blocks it removes rows from and
+ * saves the map.
+ *
+ * Deleted rows leave holes that appends never fill, so compact moves the
+ * live rows of the last blocks into earlier blocks less than fill_percent
+ * full. A move is an update: the copy is a new version made by compact's
+ * transaction, which also stamps the original deleted, so running snapshots
+ * still see each row once. Once vacuum has removed the originals, shrink
+ * gives the emptied blocks at the end of the file back. Row ids are never
+ * reused, so a PAX block only takes moved rows while it has slots left.
+ *
+ * After its version header each row has a bit per column, set if its value
+ * is NULL, and a bit per BOOLEAN column, set if it is true; only the other
+ * values that are not NULL take bytes. A column missing from an inserted
+ * row is NULL, and a NULL in a where clause asks for IS NULL, which is
+ * decided from those bits alone.
+ *
+ * The TEXT columns chosen for dictionary encoding hold an INT code in each
+ * row in place of the value (see Dictionary), so in blocks and in the PAX
+ * arrays they are INT columns. Equality in a WHERE clause on one of them is
+ * turned into equality on the value's code before the scan, and a value
+ * with no code matches no row without reading a block.
  */
 
 class HeapTable : public DbRelation {
 public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes );
-    virtual ~HeapTable() {}
+    /**
+     * Blocks handed to a scanning thread at a time
+     */
+    static const BlockID MORSEL_SZ = 16;
+
+    /**
+     * Threads a scan may use, the calling thread included (default: one per core)
+     */
+    static uint scan_threads;
+
+    /**
+     * TEXT values longer than a page over this are kept out of line
+     */
+    static const uint TOAST_FRACTION = 4;
+
+    /**
+     * In place of a marshaled TEXT value's size: the value is out of line,
+     * [u32 first overflow page][u32 length] follow
+     */
+    static const u_int16_t TOASTED = UINT16_MAX;
+
+    /**
+     * Bytes after a marshaled row's version header for its NULL bits (one per
+     * column) and then its BOOLEAN values (one bit per BOOLEAN column)
+     * @param n_columns   columns of the table
+     * @param n_booleans  how many of them are BOOLEAN
+     * @returns           bytes of the bits
+     */
+    static uint row_header_size(uint n_columns, uint n_booleans) {return (n_columns + 7) / 8 + (n_booleans + 7) / 8;}
+
+    /**
+     * Is a bit of a row header set?
+     * @param bits  first byte of the NULL bits or of the BOOLEAN bits
+     * @param i     column (or BOOLEAN column) number
+     */
+    static bool get_bit(const char *bits, uint i) {return (bits[i / 8] >> (i % 8)) & 1;}
+    static void set_bit(char *bits, uint i) {bits[i / 8] |= (char)(1 << (i % 8));}
+
+    /**
+     * A column's Bloom filter for a block has a bit per this many bytes of the page
+     */
+    static const uint BLOOM_FRACTION = 4;
+
+    /**
+     * compact moves rows into the blocks filled to less than this percentage of the page
+     */
+    static uint fill_percent;
+
+    /**
+     * @param table_name         name of the relation
+     * @param column_names       its columns
+     * @param column_attributes  their types
+     * @param storage            "heap" for a HeapFile, "mmap" for an MmapFile,
+     *                           "uring" for a UringFile
+     * @param page_size          bytes in each of its blocks (see PageFile::valid_block_size)
+     * @param layout             "row" for SlottedPage blocks, "pax" for PaxPage blocks
+     * @param bloom_columns      columns to keep a Bloom filter of for each block
+     * @param dictionary_columns TEXT columns to keep as codes in a Dictionary
+     * @param compression        "none", or "zlib" for a compressed HeapFile
+     */
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              const std::string &storage="heap", uint page_size=DbBlock::BLOCK_SZ,
+              const std::string &layout="row", const ColumnNames &bloom_columns=ColumnNames(),
+              const ColumnNames &dictionary_columns=ColumnNames(), const std::string &compression="none");
+    virtual ~HeapTable();
     HeapTable(const HeapTable& other) = delete;
     HeapTable(HeapTable&& temp) = delete;
     HeapTable& operator=(const HeapTable& other) = delete;
@@ -120,16 +419,60 @@ public:
     virtual Handles* select(const ValueDict* where);
     virtual ValueDict* project(Handle handle);
     virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+    virtual uint vacuum();
+    virtual uint compact(HandleMoves &moves);
+    virtual uint shrink();
+
+    /**
+     * Handles of the visible rows whose value in an INT column satisfies a
+     * comparison (which select(where) can only make for equality).
+     * @param column_name  an INT column
+     * @param predicate    comparison to make
+     * @returns            handles of the rows that qualify
+     */
+    virtual Handles* select(const Identifier &column_name, const IntPredicate &predicate);
 
     using DbRelation::project;
 
 protected:
-    HeapFile file;
+    PageFile *file;
+    bool pax;               // blocks of file are PaxPages
+    PageFile *toast;        // overflow pages of long TEXT values
+    bool toast_open;        // toast is opened (or created) when first needed
+    std::mutex toast_mutex; // guards toast_open and the free list
+    bool toast_free_known;  // toast_free has been gathered since toast was opened
+    std::vector<BlockID> toast_free;  // overflow pages no value uses
+    ZoneMap zones;          // range of each column's values in each block
+    std::atomic<bool> zones_loaded;
+    std::mutex zones_mutex; // guards loading the zone map
+    Dictionary dictionary;  // values of the dictionary-encoded columns
+    ColumnAttributes stored_attributes;  // column types as kept in the blocks (codes are INT)
+    uint n_booleans;        // BOOLEAN columns
+    static PageFile *new_file(std::string name, const std::string &storage, uint page_size, bool compressed);
+    virtual SlottedPage* page(DbBlock *block) const;
+    virtual void load_zones();
+    virtual void summarize(BlockID block_id, SlottedPage *block);
     virtual ValueDict* validate(const ValueDict* row) const;
     virtual Handle append(const ValueDict* row);
-    virtual Dbt* marshal(const ValueDict* row) const;
-    virtual ValueDict* unmarshal(Dbt* data) const;
-    virtual bool selected(Handle handle, const ValueDict* where);
+    virtual bool is_empty(BlockID block_id);
+    virtual uint used(BlockID block_id);
+    virtual RecordID place(BlockID block_id, const ValueDict* row, Dbt* data);
+    virtual bool fits_empty(const Dbt* data) const;
+    virtual Dbt* marshal(const ValueDict* row);
+    virtual ValueDict* unmarshal(Dbt* data, const ColumnNames* column_names=nullptr, bool decode=true);
+    virtual bool encode_where(const ValueDict* where, ValueDict &encoded) const;
+    virtual PageFile* toast_file();
+    virtual BlockID toast_value(const std::string &value);
+    virtual std::string detoast_value(BlockID block_id, u_int32_t length);
+    virtual SlottedPage* new_toast_page();
+    virtual void free_toast(const Dbt* data);
+    virtual void free_toast_chain(BlockID block_id);
+    virtual Handles* scan(const ValueDict *where, const IntPredicate *predicate, uint column);
+    virtual void scan_block(BlockID block_id, DbBlockIO &read, const Snapshot &snapshot, const ValueDict *where,
+                            const IntPredicate *predicate, uint column, Handles &handles);
+    virtual bool selected(SlottedPage *block, RecordID record_id, const ValueDict* where);
+    virtual bool satisfies(SlottedPage *block, RecordID record_id, const IntPredicate &predicate, uint column);
+    virtual bool is_dead(TxnID xmin, TxnID xmax, TxnID horizon) const;
 };
 
 bool test_heap_storage();
@@ -0,0 +1,213 @@
+/**
+ * @file int_filter.cpp - implementation of IntPredicate and IntFilter
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "int_filter.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+using namespace std;
+
+bool IntPredicate::test(int32_t n) const {
+    switch (this->op) {
+        case EQ: return n == this->low;
+        case NE: return n != this->low;
+        case LT: return n < this->low;
+        case LE: return n <= this->low;
+        case GT: return n > this->low;
+        case GE: return n >= this->low;
+        default: return n >= this->low && n <= this->high;
+    }
+}
+
+// one comparison over count (at most 64) values into a bitmap word, a value at a time
+template <int OP>
+static inline u_int64_t scalar_word(const int32_t *values, uint count, int32_t low, int32_t high) {
+    u_int64_t bits = 0;
+    for (uint i = 0; i < count; i++) {
+        int32_t n = values[i];
+        bool holds;
+        switch (OP) {
+            case IntPredicate::EQ: holds = n == low; break;
+            case IntPredicate::NE: holds = n != low; break;
+            case IntPredicate::LT: holds = n < low; break;
+            case IntPredicate::LE: holds = n <= low; break;
+            case IntPredicate::GT: holds = n > low; break;
+            case IntPredicate::GE: holds = n >= low; break;
+            default: holds = n >= low && n <= high;
+        }
+        bits |= (u_int64_t)holds << i;
+    }
+    return bits;
+}
+
+template <int OP>
+static void scalar_filter(const int32_t *values, uint n, int32_t low, int32_t high, u_int64_t *bitmap) {
+    for (uint word = 0; word * 64 < n; word++)
+        bitmap[word] = scalar_word<OP>(values + word * 64, min(64U, n - word * 64), low, high);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// all-ones lanes where 8 values satisfy the comparison
+template <int OP>
+__attribute__((target("avx2")))
+static inline __m256i avx2_compare(__m256i v, __m256i low, __m256i high) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    switch (OP) {
+        case IntPredicate::EQ: return _mm256_cmpeq_epi32(v, low);
+        case IntPredicate::NE: return _mm256_xor_si256(_mm256_cmpeq_epi32(v, low), ones);
+        case IntPredicate::LT: return _mm256_cmpgt_epi32(low, v);
+        case IntPredicate::LE: return _mm256_xor_si256(_mm256_cmpgt_epi32(v, low), ones);
+        case IntPredicate::GT: return _mm256_cmpgt_epi32(v, low);
+        case IntPredicate::GE: return _mm256_xor_si256(_mm256_cmpgt_epi32(low, v), ones);
+        default: return _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi32(low, v),
+                                                             _mm256_cmpgt_epi32(v, high)), ones);
+    }
+}
+
+template <int OP>
+__attribute__((target("avx2")))
+static void avx2_filter(const int32_t *values, uint n, int32_t low, int32_t high, u_int64_t *bitmap) {
+    __m256i low_v = _mm256_set1_epi32(low), high_v = _mm256_set1_epi32(high);
+    uint full = n / 64;
+    for (uint word = 0; word < full; word++) {
+        const int32_t *v = values + word * 64;
+        u_int64_t bits = 0;
+        for (uint j = 0; j < 8; j++) {
+            __m256i lanes = avx2_compare<OP>(_mm256_loadu_si256((const __m256i *)(v + 8 * j)), low_v, high_v);
+            bits |= (u_int64_t)(uint)_mm256_movemask_ps(_mm256_castsi256_ps(lanes)) << (8 * j);
+        }
+        bitmap[word] = bits;
+    }
+    if (n % 64 != 0)
+        bitmap[full] = scalar_word<OP>(values + full * 64, n % 64, low, high);
+}
+
+// all-ones lanes where 4 values satisfy the comparison
+template <int OP>
+__attribute__((target("sse4.2")))
+static inline __m128i sse42_compare(__m128i v, __m128i low, __m128i high) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    switch (OP) {
+        case IntPredicate::EQ: return _mm_cmpeq_epi32(v, low);
+        case IntPredicate::NE: return _mm_xor_si128(_mm_cmpeq_epi32(v, low), ones);
+        case IntPredicate::LT: return _mm_cmplt_epi32(v, low);
+        case IntPredicate::LE: return _mm_xor_si128(_mm_cmpgt_epi32(v, low), ones);
+        case IntPredicate::GT: return _mm_cmpgt_epi32(v, low);
+        case IntPredicate::GE: return _mm_xor_si128(_mm_cmplt_epi32(v, low), ones);
+        default: return _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(v, low), _mm_cmpgt_epi32(v, high)), ones);
+    }
+}
+
+template <int OP>
+__attribute__((target("sse4.2")))
+static void sse42_filter(const int32_t *values, uint n, int32_t low, int32_t high, u_int64_t *bitmap) {
+    __m128i low_v = _mm_set1_epi32(low), high_v = _mm_set1_epi32(high);
+    uint full = n / 64;
+    for (uint word = 0; word < full; word++) {
+        const int32_t *v = values + word * 64;
+        u_int64_t bits = 0;
+        for (uint j = 0; j < 16; j++) {
+            __m128i lanes = sse42_compare<OP>(_mm_loadu_si128((const __m128i *)(v + 4 * j)), low_v, high_v);
+            bits |= (u_int64_t)(uint)_mm_movemask_ps(_mm_castsi128_ps(lanes)) << (4 * j);
+        }
+        bitmap[word] = bits;
+    }
+    if (n % 64 != 0)
+        bitmap[full] = scalar_word<OP>(values + full * 64, n % 64, low, high);
+}
+
+#endif
+
+typedef void (*FilterFunction)(const int32_t *values, uint n, int32_t low, int32_t high, u_int64_t *bitmap);
+
+// kernel for each comparison, in IntPredicate::Comparison order
+#define FILTER_FUNCTIONS(kernel) {kernel<IntPredicate::EQ>, kernel<IntPredicate::NE>, kernel<IntPredicate::LT>, \
+                                  kernel<IntPredicate::LE>, kernel<IntPredicate::GT>, kernel<IntPredicate::GE>, \
+                                  kernel<IntPredicate::BETWEEN>}
+
+static const FilterFunction filter_functions[][IntPredicate::BETWEEN + 1] = {
+    FILTER_FUNCTIONS(scalar_filter),
+#ifdef HAVE_X86_KERNELS
+    FILTER_FUNCTIONS(sse42_filter),
+    FILTER_FUNCTIONS(avx2_filter),
+#endif
+};
+
+IntFilter::Kernel IntFilter::best() {
+    static Kernel kernel = []() {
+#ifdef HAVE_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return AVX2;
+        if (__builtin_cpu_supports("sse4.2"))
+            return SSE42;
+#endif
+        return SCALAR;
+    }();
+    return kernel;
+}
+
+const char *IntFilter::name(Kernel kernel) {
+    switch (kernel) {
+        case AVX2: return "avx2";
+        case SSE42: return "sse4.2";
+        default: return "scalar";
+    }
+}
+
+void IntFilter::filter(const int32_t *values, uint n, const IntPredicate &predicate, u_int64_t *bitmap,
+                       Kernel kernel) {
+    filter_functions[kernel][predicate.op](values, n, predicate.low, predicate.high, bitmap);
+}
+
+string IntFilter::benchmark(uint n_values, uint rounds) {
+    static const char *comparisons[] = {"=", "<>", "<", "<=", ">", ">=", "BETWEEN"};
+    // values from 0 to 999, compared with the middle so about half qualify
+    vector<int32_t> values(n_values);
+    mt19937 random(5300);
+    uniform_int_distribution<int32_t> distribution(0, 999);
+    for (auto &value: values)
+        value = distribution(random);
+    uint n_words = (n_values + 63) / 64;
+    vector<u_int64_t> expected(n_words), bitmap(n_words);
+
+    ostringstream out;
+    out << fixed << setprecision(3);
+    out << "filter " << n_values << " values x " << rounds << " rounds, ns per value (best kernel "
+        << name(best()) << "):" << endl;
+    for (int op = IntPredicate::EQ; op <= IntPredicate::BETWEEN; op++) {
+        IntPredicate predicate((IntPredicate::Comparison)op, 500, 749);
+        out << "  " << left << setw(8) << comparisons[op] << right;
+        double scalar_ns = 0;
+        for (int kernel = SCALAR; kernel <= best(); kernel++) {
+            auto start = chrono::steady_clock::now();
+            for (uint round = 0; round < rounds; round++)
+                filter(values.data(), n_values, predicate, bitmap.data(), (Kernel)kernel);
+            double ns = (double)chrono::duration_cast<chrono::nanoseconds>(
+                                chrono::steady_clock::now() - start).count() / ((double)n_values * rounds);
+            if (kernel == SCALAR) {
+                scalar_ns = ns;
+                expected = bitmap;
+            }
+            out << " " << name((Kernel)kernel) << " " << ns;
+            if (kernel != SCALAR)
+                out << " (" << setprecision(1) << (ns > 0 ? scalar_ns / ns : 0.0) << "x)" << setprecision(3);
+            if (bitmap != expected)
+                out << " MISMATCH";
+        }
+        out << endl;
+    }
+    return out.str();
+}
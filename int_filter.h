@@ -0,0 +1,83 @@
+/**
+ * @file int_filter.h - vectorized comparisons of int32 arrays against a constant
+ * IntPredicate
+ * IntFilter
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @class IntPredicate - comparison of an INT column with constants
+ */
+class IntPredicate {
+public:
+    enum Comparison {EQ, NE, LT, LE, GT, GE, BETWEEN};
+
+    /**
+     * @param op    comparison
+     * @param low   value compared with (lower bound of BETWEEN)
+     * @param high  upper bound of BETWEEN (inclusive, like low)
+     */
+    IntPredicate(Comparison op=EQ, int32_t low=0, int32_t high=0) : op(op), low(low), high(high) {}
+
+    Comparison op;
+    int32_t low;
+    int32_t high;
+
+    /**
+     * Does a value satisfy the predicate?
+     * @param n  value of the column
+     * @returns  true if it does
+     */
+    bool test(int32_t n) const;
+};
+
+/**
+ * @class IntFilter - evaluate an IntPredicate over an array of int32 values at once
+ *
+ * The result is a selection bitmap: bit i % 64 of word i / 64 is set if
+ * values[i] satisfies the predicate. Kernels compare 8 values at a time with
+ * AVX2 or 4 at a time with SSE4.2, each comparison producing a mask without
+ * branches, and the scalar kernel one at a time; filter uses the widest the
+ * CPU supports, found when first called.
+ */
+class IntFilter {
+public:
+    enum Kernel {SCALAR, SSE42, AVX2};
+
+    /**
+     * The widest kernel this CPU supports.
+     * @returns  AVX2, SSE42 or SCALAR
+     */
+    static Kernel best();
+
+    /**
+     * @param kernel  a kernel
+     * @returns       its name for reports
+     */
+    static const char *name(Kernel kernel);
+
+    /**
+     * Compare each of an array's values against the predicate.
+     * @param values     the array
+     * @param n          number of values in it
+     * @param predicate  what they are compared against
+     * @param bitmap     returned: (n + 63) / 64 words, bit per value (bits past n are 0)
+     * @param kernel     kernel to use (must be supported; default the best one)
+     */
+    static void filter(const int32_t *values, uint n, const IntPredicate &predicate, u_int64_t *bitmap,
+                       Kernel kernel=best());
+
+    /**
+     * Time each kernel on each comparison (the shell's "bench" command).
+     * @param n_values  values in the array compared
+     * @param rounds    times each comparison is run
+     * @returns         human-readable report, one comparison per line
+     */
+    static std::string benchmark(uint n_values=1U << 20, uint rounds=100);
+};
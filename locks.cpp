@@ -0,0 +1,113 @@
+/**
+ * @file locks.cpp - implementation of Latch, TableLock and LockStats
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <chrono>
+#include <sstream>
+#include "locks.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Nanoseconds since start
+static unsigned long long elapsed_ns(Clock::time_point start) {
+    return (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/************************************************
+ *  Implementation of Latch class
+ ***********************************************/
+
+/**
+ * Acquire the latch shared, timing the wait only if we actually block
+ */
+void Latch::lock_shared() {
+    if (pthread_rwlock_tryrdlock(&this->rwlock) == 0)
+        return;
+    Clock::time_point start = Clock::now();
+    pthread_rwlock_rdlock(&this->rwlock);
+    LockStats::latch_waits++;
+    LockStats::latch_wait_ns += elapsed_ns(start);
+}
+
+/**
+ * Acquire the latch exclusive, timing the wait only if we actually block
+ */
+void Latch::lock() {
+    if (pthread_rwlock_trywrlock(&this->rwlock) == 0)
+        return;
+    Clock::time_point start = Clock::now();
+    pthread_rwlock_wrlock(&this->rwlock);
+    LockStats::latch_waits++;
+    LockStats::latch_wait_ns += elapsed_ns(start);
+}
+
+/************************************************
+ *  Implementation of TableLock class
+ ***********************************************/
+
+TableLock::TableLock() {
+    for (uint i = 0; i < N_MODES; i++)
+        this->held[i] = 0;
+}
+
+/**
+ * Block until mode is compatible with all held modes, then take it
+ * @param   LockMode mode  mode to acquire
+ */
+void TableLock::lock(LockMode mode) {
+    unique_lock<std::mutex> guard(this->mutex);
+    if (!compatible(mode)) {
+        Clock::time_point start = Clock::now();
+        this->released.wait(guard, [this, mode]() {return compatible(mode);});
+        LockStats::table_lock_waits++;
+        LockStats::table_lock_wait_ns += elapsed_ns(start);
+    }
+    this->held[mode]++;
+}
+
+/**
+ * Give up one hold of mode and wake any waiters
+ * @param   LockMode mode  mode previously acquired
+ */
+void TableLock::unlock(LockMode mode) {
+    {
+        lock_guard<std::mutex> guard(this->mutex);
+        this->held[mode]--;
+    }
+    this->released.notify_all();
+}
+
+// Standard multi-granularity compatibility matrix against what is held now
+bool TableLock::compatible(LockMode mode) const {
+    static const bool matrix[N_MODES][N_MODES] = {
+        //         IS     IX     S      SIX    X
+        /* IS  */ {true,  true,  true,  true,  false},
+        /* IX  */ {true,  true,  false, false, false},
+        /* S   */ {true,  false, true,  false, false},
+        /* SIX */ {true,  false, false, false, false},
+        /* X   */ {false, false, false, false, false}
+    };
+    for (uint held_mode = 0; held_mode < N_MODES; held_mode++)
+        if (this->held[held_mode] > 0 && !matrix[mode][held_mode])
+            return false;
+    return true;
+}
+
+/************************************************
+ *  Implementation of LockStats class
+ ***********************************************/
+
+atomic<unsigned long long> LockStats::latch_waits(0);
+atomic<unsigned long long> LockStats::latch_wait_ns(0);
+atomic<unsigned long long> LockStats::table_lock_waits(0);
+atomic<unsigned long long> LockStats::table_lock_wait_ns(0);
+
+// One line per counter, wait times in milliseconds
+string LockStats::report() {
+    ostringstream out;
+    out << "page latch waits: " << latch_waits << " (" << latch_wait_ns / 1e6 << " ms)" << endl;
+    out << "table lock waits: " << table_lock_waits << " (" << table_lock_wait_ns / 1e6 << " ms)" << endl;
+    return out.str();
+}
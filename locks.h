@@ -0,0 +1,152 @@
+/**
+ * @file locks.h - synchronization primitives shared by the storage engine
+ * RWLock
+ * Latch
+ * TableLock
+ * LockStats
+ * SharedGuard, ExclusiveGuard, TableLockGuard
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+/**
+ * @class RWLock - reader/writer lock (C++11 has no shared_mutex)
+ */
+class RWLock {
+public:
+    RWLock() {pthread_rwlock_init(&rwlock, nullptr);}
+    virtual ~RWLock() {pthread_rwlock_destroy(&rwlock);}
+    RWLock(const RWLock& other) = delete;
+    RWLock(RWLock&& temp) = delete;
+    RWLock& operator=(const RWLock& other) = delete;
+    RWLock& operator=(RWLock&& temp) = delete;
+
+    virtual void lock_shared() {pthread_rwlock_rdlock(&rwlock);}
+    virtual void lock() {pthread_rwlock_wrlock(&rwlock);}
+    virtual void unlock() {pthread_rwlock_unlock(&rwlock);}
+
+protected:
+    pthread_rwlock_t rwlock;
+};
+
+/**
+ * @class Latch - short-term shared/exclusive latch on a page
+ * Same as RWLock, but time spent blocked is added to LockStats.
+ */
+class Latch : public RWLock {
+public:
+    Latch() : RWLock() {}
+    virtual ~Latch() {}
+
+    virtual void lock_shared();
+    virtual void lock();
+};
+
+/**
+ * Modes of a TableLock: intention-shared, intention-exclusive, shared,
+ * shared with intention-exclusive, and exclusive.
+ */
+enum LockMode {
+    LOCK_IS,
+    LOCK_IX,
+    LOCK_S,
+    LOCK_SIX,
+    LOCK_X
+};
+
+/**
+ * @class TableLock - hierarchical lock on a whole relation
+ *
+ * Row readers take IS and row writers IX, together with shared or exclusive
+ * latches on the pages they touch. A full scan takes S and DROP takes X. So
+ * any number of scans share a table, writers on different tables never
+ * meet, and writers on the same table only meet on the pages they share.
+ * Grants are not queued in order; a mode is granted as soon as it is
+ * compatible with every mode currently held.
+ */
+class TableLock {
+public:
+    TableLock();
+    virtual ~TableLock() {}
+    TableLock(const TableLock& other) = delete;
+    TableLock& operator=(const TableLock& other) = delete;
+
+    virtual void lock(LockMode mode);
+    virtual void unlock(LockMode mode);
+
+protected:
+    static const uint N_MODES = 5;
+    std::mutex mutex;
+    std::condition_variable released;
+    uint held[N_MODES];  // number of holders in each mode
+
+    virtual bool compatible(LockMode mode) const;
+};
+
+/**
+ * @class LockStats - process-wide counters for time spent waiting on locks
+ */
+class LockStats {
+public:
+    static std::atomic<unsigned long long> latch_waits;
+    static std::atomic<unsigned long long> latch_wait_ns;
+    static std::atomic<unsigned long long> table_lock_waits;
+    static std::atomic<unsigned long long> table_lock_wait_ns;
+
+    /**
+     * Human-readable summary for the shell's "stats" command.
+     * @returns  one line per counter
+     */
+    static std::string report();
+};
+
+/**
+ * @class SharedGuard - holds an RWLock in shared mode for its lifetime
+ */
+class SharedGuard {
+public:
+    explicit SharedGuard(RWLock &lock) : lock(lock) {lock.lock_shared();}
+    ~SharedGuard() {lock.unlock();}
+    SharedGuard(const SharedGuard& other) = delete;
+    SharedGuard& operator=(const SharedGuard& other) = delete;
+
+protected:
+    RWLock &lock;
+};
+
+/**
+ * @class ExclusiveGuard - holds an RWLock in exclusive mode for its lifetime
+ */
+class ExclusiveGuard {
+public:
+    explicit ExclusiveGuard(RWLock &lock) : lock(lock) {lock.lock();}
+    ~ExclusiveGuard() {lock.unlock();}
+    ExclusiveGuard(const ExclusiveGuard& other) = delete;
+    ExclusiveGuard& operator=(const ExclusiveGuard& other) = delete;
+
+protected:
+    RWLock &lock;
+};
+
+/**
+ * @class TableLockGuard - holds a TableLock in the given mode for its lifetime
+ */
+class TableLockGuard {
+public:
+    TableLockGuard(TableLock &lock, LockMode mode) : lock(lock), mode(mode) {lock.lock(mode);}
+    ~TableLockGuard() {lock.unlock(mode);}
+    TableLockGuard(const TableLockGuard& other) = delete;
+    TableLockGuard& operator=(const TableLockGuard& other) = delete;
+
+protected:
+    TableLock &lock;
+    LockMode mode;
+};
@@ -0,0 +1,296 @@
+/**
+ * @file mmap_file.cpp - implementation of MmapFile
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mmap_file.h"
+using namespace std;
+
+/**
+ * @param   string name       relation name
+ * @param   uint block_size   bytes in each block
+ */
+MmapFile::MmapFile(std::string name, uint block_size) : PageFile(name, block_size), fd(-1), base(nullptr), mapped(0) {
+    this->filename = this->name + ".pages";
+}
+
+MmapFile::~MmapFile() {
+    try {
+        close();
+    } catch (DbException &e) {
+        // nothing to be done about it now; the log still has the changes
+    }
+}
+
+/**
+ * Create the file with its first block
+ */
+void MmapFile::create(void) {
+    file_open(O_RDWR | O_CREAT | O_EXCL);
+    SlottedPage *block = get_new();
+    delete block;
+}
+
+/**
+ * Close and remove the file
+ */
+void MmapFile::drop(void) {
+    close();
+    WriteAheadLog::log_drop(this->filename);
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    unlink((string(env_home) + "/" + this->filename).c_str());
+}
+
+/**
+ * Open the existing file
+ */
+void MmapFile::open(void) {
+    file_open(O_RDWR);
+}
+
+/**
+ * Write back the dirty blocks and unmap the file
+ */
+void MmapFile::close(void) {
+    lock_guard<mutex> guard(this->open_mutex);
+    if (this->closed)
+        return;
+    {
+        lock_guard<mutex> files_guard(PageFile::open_files_mutex);
+        PageFile::open_files.erase(this);
+    }
+    sync();
+    munmap(this->base, MAX_SZ);
+    // give back the free blocks of the last extent
+    int error = ftruncate(this->fd, (off_t)this->last * this->block_size) == 0 ? 0 : errno;
+    ::close(this->fd);
+    this->base = nullptr;
+    this->fd = -1;
+    this->mapped = 0;
+    this->closed = true;
+    if (error != 0)
+        throw DbException(("cannot cut back " + this->filename).c_str(), error);
+}
+
+/**
+ * Hand out the next free block, extending the file if there is none
+ * @return  SlottedPage*  a private copy of the new empty block
+ */
+SlottedPage *MmapFile::get_new(void) {
+    lock_guard<mutex> guard(this->alloc_mutex);
+    BlockID block_id = next_block();
+    SlottedPage *page = private_page(block_id, true);
+    LSN lsn;
+    try {
+        lsn = WriteAheadLog::log_page(this->filename, block_id, nullptr, page->get_data(), this->block_size);
+    } catch (...) {
+        delete page;
+        throw;
+    }
+    memcpy(address(block_id), page->get_data(), this->block_size);
+    changed(block_id, lsn);
+    // only publish the new block once it exists for concurrent scans
+    this->last = block_id;
+    return page;
+}
+
+/**
+ * Get a block
+ * @param   BlockID block_id  target block id
+ * @return  SlottedPage*      page over the mapped block
+ */
+SlottedPage *MmapFile::get(BlockID block_id) {
+    if (block_id == 0 || block_id > this->last)
+        throw DbBlockError("no block " + to_string(block_id) + " in " + this->filename);
+    Dbt data(address(block_id), this->block_size);
+    SlottedPage *page = new SlottedPage(data, block_id, false);
+    read_ahead_of(block_id);
+    return page;
+}
+
+/**
+ * Get a block to change
+ * @param   BlockID block_id  target block id
+ * @return  SlottedPage*      private copy of the mapped block
+ */
+SlottedPage *MmapFile::get_for_update(BlockID block_id) {
+    if (block_id == 0 || block_id > this->last)
+        throw DbBlockError("no block " + to_string(block_id) + " in " + this->filename);
+    return private_page(block_id, false);
+}
+
+/**
+ * Log the bytes of a changed block that differ from the mapped block, and
+ * copy it in (the mapping is private, so it stays off the disk until sync)
+ * @param   DbBlock *block  changed private copy of a block
+ */
+void MmapFile::put(DbBlock *block) {
+    BlockID block_id = block->get_block_id();
+    char *mapped_block = address(block_id);
+    if (block->get_data() == mapped_block)
+        throw DbBlockError("block " + to_string(block_id) + " of " + this->filename + " was changed in place");
+    LSN lsn = WriteAheadLog::log_page(this->filename, block_id, mapped_block, block->get_data(),
+                                      this->block_size);
+    memcpy(mapped_block, block->get_data(), this->block_size);
+    changed(block_id, lsn);
+}
+
+/**
+ * Write back the blocks and cut the file back (the blocks cut off stay
+ * mapped, but nothing reads them until get_new hands them out again)
+ * @param   BlockID n_blocks  blocks to keep
+ */
+void MmapFile::shrink(BlockID n_blocks) {
+    lock_guard<mutex> guard(this->alloc_mutex);
+    if (n_blocks >= this->last)
+        return;
+    WriteAheadLog::log_shrink(this->filename, n_blocks, this->block_size);
+    lock_guard<mutex> sync_guard(this->sync_mutex);
+    write_back();
+    if (ftruncate(this->fd, (off_t)n_blocks * this->block_size) != 0)
+        throw DbException(("cannot shrink " + this->filename).c_str(), errno);
+    this->last = n_blocks;
+    this->allocated = n_blocks;
+    if (this->prefetched > n_blocks)
+        this->prefetched = n_blocks;
+}
+
+// Open the file, reserve its address range and map its blocks
+void MmapFile::file_open(int flags) {
+    lock_guard<mutex> guard(this->open_mutex);
+    if (!this->closed)
+        return;
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    string path = string(env_home) + "/" + this->filename;
+    this->fd = ::open(path.c_str(), flags, 0644);
+    if (this->fd < 0)
+        throw DbException(("cannot open " + this->filename).c_str(), errno);
+    struct stat status;
+    void *reserved = MAP_FAILED;
+    if (fstat(this->fd, &status) == 0)
+        reserved = mmap(nullptr, MAX_SZ, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        int error = errno;
+        ::close(this->fd);
+        this->fd = -1;
+        throw DbException(("cannot map " + this->filename).c_str(), error);
+    }
+    this->base = (char *)reserved;
+    this->mapped = 0;
+    this->prefetched = 0;
+    BlockID n_blocks = (BlockID)(status.st_size / this->block_size);
+    map_through(n_blocks);
+    find_last(n_blocks);
+    this->closed = false;
+    lock_guard<mutex> files_guard(PageFile::open_files_mutex);
+    PageFile::open_files.insert(this);
+}
+
+// A page over a copy of a block (a fresh empty one if is_new), freed with the page
+SlottedPage *MmapFile::private_page(BlockID block_id, bool is_new) {
+    void *copy = is_new ? calloc(1, this->block_size) : malloc(this->block_size);
+    if (copy == nullptr)
+        throw bad_alloc();
+    if (!is_new)
+        memcpy(copy, address(block_id), this->block_size);
+    Dbt data(copy, this->block_size);
+    data.set_flags(DB_DBT_MALLOC);
+    return new SlottedPage(data, block_id, is_new);
+}
+
+// Map whole chunks of the file until the given block is mapped
+void MmapFile::map_through(BlockID block_id) {
+    if (block_id <= this->mapped)
+        return;
+    BlockID through = (block_id + MAP_CHUNK - 1) / MAP_CHUNK * MAP_CHUNK;
+    if ((size_t)through * this->block_size > MAX_SZ)
+        through = (BlockID)(MAX_SZ / this->block_size);
+    // the chunk may run past the end of the file: only blocks before it are touched
+    void *chunk = mmap(address(this->mapped + 1), (size_t)(through - this->mapped) * this->block_size,
+                       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, this->fd,
+                       (off_t)this->mapped * this->block_size);
+    if (chunk == MAP_FAILED)
+        throw DbException(("cannot map " + this->filename).c_str(), errno);
+    this->mapped = through;
+}
+
+// Allocate the file's blocks through the given one and map them
+BlockID MmapFile::extend(BlockID through) {
+    BlockID max_blocks = (BlockID)(MAX_SZ / this->block_size);
+    if (through > max_blocks)
+        through = max_blocks;
+    if (through <= this->last)
+        throw DbBlockError(this->filename + " is full");
+    if (allocate_blocks(this->fd, this->allocated, through) != 0)
+        throw DbException(("cannot extend " + this->filename).c_str(), errno);
+    map_through(through);
+    return through;
+}
+
+// Ask the kernel to start reading blocks in
+void MmapFile::prefetch(BlockID first, BlockID last) {
+    madvise(address(first), (size_t)(last - first + 1) * this->block_size, MADV_WILLNEED);
+}
+
+/**
+ * Write back dirty blocks and wait for them
+ */
+void MmapFile::sync() {
+    lock_guard<mutex> guard(this->sync_mutex);
+    write_back();
+}
+
+// Note a block copied into the mapping, with the LSN of its change
+void MmapFile::changed(BlockID block_id, LSN lsn) {
+    lock_guard<mutex> guard(this->dirty_mutex);
+    LSN &needed = this->dirty[block_id];
+    needed = max(needed, lsn);
+}
+
+// Write the dirty blocks to the file, each after its log, and give their pages back (sync_mutex held)
+void MmapFile::write_back() {
+    map<BlockID, LSN> blocks;
+    {
+        lock_guard<mutex> guard(this->dirty_mutex);
+        blocks.swap(this->dirty);
+    }
+    if (blocks.empty())
+        return;
+    WriteAheadLog::flush_all();
+    for (auto const &block: blocks) {
+        BlockID block_id = block.first;
+        // a put cannot change the block meanwhile, and one since the log was forced must wait for it again
+        SharedGuard latch(this->latch(block_id));
+        if (block_id > this->last)
+            continue;  // cut off
+        LSN again = 0;
+        {
+            lock_guard<mutex> guard(this->dirty_mutex);
+            auto entry = this->dirty.find(block_id);
+            if (entry != this->dirty.end())
+                again = entry->second;
+        }
+        WriteAheadLog::flush(again);
+        if (pwrite(this->fd, address(block_id), this->block_size, (off_t)(block_id - 1) * this->block_size) !=
+            (ssize_t)this->block_size) {
+            int error = errno;
+            for (auto const &unwritten: blocks)
+                changed(unwritten.first, unwritten.second);
+            throw DbException(("cannot write " + this->filename).c_str(), error);
+        }
+        madvise(address(block_id), this->block_size, MADV_DONTNEED);
+    }
+    if (fdatasync(this->fd) != 0)
+        throw DbException(("cannot sync " + this->filename).c_str(), errno);
+}
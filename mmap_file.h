@@ -0,0 +1,78 @@
+/**
+ * @file mmap_file.h - heap table storage in a memory-mapped file
+ * MmapFile: PageFile
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include "heap_storage.h"
+
+/**
+ * @class MmapFile - plain file of blocks, mapped into memory (implementation of PageFile)
+ *
+ * The file in the environment directory is just the blocks one after the
+ * other, with no Berkeley DB underneath. It is mapped, so get hands back a
+ * SlottedPage over the mapped block itself and nothing is copied. A block is
+ * never changed in place: get_for_update and get_new hand out a private copy,
+ * and put logs the bytes that differ from the mapped block and copies the
+ * block in without waiting for the log. The mapping is private, so the
+ * kernel never writes a block back by itself: sync forces the log, then
+ * writes the changed blocks to the file and gives their pages back (later
+ * reads find them in the page cache).
+ *
+ * A large address range is reserved when the file is opened and the file is
+ * mapped into it a chunk at a time as it grows, so blocks never move. The
+ * file grows a whole extent at a time (see PageFile::extent_blocks).
+ * Read-ahead is an madvise(MADV_WILLNEED) hint to the kernel. Dirty blocks
+ * are written back at each checkpoint, when the file is cut back and when it
+ * is closed.
+ */
+class MmapFile : public PageFile {
+public:
+    /**
+     * Largest file (address space reserved for each open file)
+     */
+    static const size_t MAX_SZ = (size_t)1 << 36;
+
+    MmapFile(std::string name, uint block_size=DbBlock::BLOCK_SZ);
+    virtual ~MmapFile();
+    MmapFile(const MmapFile& other) = delete;
+    MmapFile(MmapFile&& temp) = delete;
+    MmapFile& operator=(const MmapFile& other) = delete;
+    MmapFile& operator=(MmapFile&& temp) = delete;
+
+    virtual void create(void);
+    virtual void drop(void);
+    virtual void open(void);
+    virtual void close(void);
+    virtual SlottedPage* get_new(void);
+    virtual SlottedPage* get(BlockID block_id);
+    virtual SlottedPage* get_for_update(BlockID block_id);
+    virtual void put(DbBlock* block);
+    virtual void sync();
+    virtual void shrink(BlockID n_blocks);
+
+protected:
+    static const BlockID MAP_CHUNK = 1024;  // blocks mapped at a time
+    std::string filename;  // in the environment directory
+    int fd;
+    char *base;            // start of the reserved range, block 1
+    BlockID mapped;        // blocks mapped so far
+    std::mutex dirty_mutex;
+    std::map<BlockID, LSN> dirty;  // blocks changed since written back, and the log each needs on disk first
+    std::mutex sync_mutex;         // one write-back at a time, none while the file is cut back
+    virtual void file_open(int flags);
+    virtual void write_back();
+    virtual void changed(BlockID block_id, LSN lsn);
+    virtual SlottedPage* private_page(BlockID block_id, bool is_new);
+    virtual void map_through(BlockID block_id);
+    virtual BlockID extend(BlockID through);
+    virtual void prefetch(BlockID first, BlockID last);
+    virtual char *address(BlockID block_id) const {return base + (size_t)(block_id - 1) * this->block_size;}
+};
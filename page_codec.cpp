@@ -0,0 +1,56 @@
+/**
+ * @file page_codec.cpp - implementation of PageCodec
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <zlib.h>
+#include "db_cxx.h"
+#include "page_codec.h"
+using namespace std;
+
+int PageCodec::level = Z_DEFAULT_COMPRESSION;
+atomic<unsigned long long> PageCodec::blocks_written(0);
+atomic<unsigned long long> PageCodec::bytes_written(0);
+atomic<unsigned long long> PageCodec::bytes_stored(0);
+atomic<unsigned long long> PageCodec::blocks_read(0);
+atomic<unsigned long long> PageCodec::bytes_read(0);
+
+void PageCodec::compress(const void *block, uint block_size, string &stored) {
+    uLongf size = compressBound(block_size);
+    stored.resize(size);
+    if (compress2((Bytef *)&stored[0], &size, (const Bytef *)block, block_size, PageCodec::level) == Z_OK &&
+        size < block_size)
+        stored.resize(size);
+    else
+        stored.assign((const char *)block, block_size);
+    PageCodec::blocks_written++;
+    PageCodec::bytes_written += block_size;
+    PageCodec::bytes_stored += stored.size();
+}
+
+void PageCodec::decompress(const void *stored, uint stored_size, void *block, uint block_size) {
+    PageCodec::blocks_read++;
+    PageCodec::bytes_read += stored_size;
+    if (stored_size == block_size) {
+        memcpy(block, stored, block_size);
+        return;
+    }
+    uLongf size = block_size;
+    if (stored_size > block_size ||
+        uncompress((Bytef *)block, &size, (const Bytef *)stored, stored_size) != Z_OK || size != block_size)
+        throw DbException("compressed block is damaged", EINVAL);
+}
+
+string PageCodec::report() {
+    unsigned long long written = PageCodec::bytes_written, stored = PageCodec::bytes_stored;
+    ostringstream out;
+    out << "compression: " << PageCodec::blocks_written << " blocks written in " << stored / 1024 << " KB for "
+        << written / 1024 << " KB (" << fixed << setprecision(2) << (stored == 0 ? 1.0 : (double)written / stored)
+        << "x), " << PageCodec::blocks_read << " blocks read from " << PageCodec::bytes_read / 1024 << " KB" << endl;
+    return out.str();
+}
@@ -0,0 +1,60 @@
+/**
+ * @file page_codec.h - compression of block images for compressed heap files
+ * PageCodec
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @class PageCodec - zlib compression of whole block images
+ *
+ * A block is stored as its zlib stream, or as the block itself when that
+ * would not be smaller, so a stored image exactly a block long is never
+ * compressed and anything shorter always is. The ratio of the bytes of
+ * block images compressed to the bytes stored for them is kept for the
+ * shell's "stats" command.
+ */
+class PageCodec {
+public:
+    /**
+     * zlib level the blocks are compressed with (1 fastest to 9 smallest)
+     */
+    static int level;
+
+    /**
+     * Image to store for a block.
+     * @param block       the block
+     * @param block_size  bytes in it
+     * @param stored      returned by reference: the image
+     */
+    static void compress(const void *block, uint block_size, std::string &stored);
+
+    /**
+     * Block back from a stored image.
+     * @param stored       the image
+     * @param stored_size  bytes in it
+     * @param block        returned: the block (block_size bytes)
+     * @param block_size   bytes in the block
+     * @throws DbException  the image is not of a block of this size
+     */
+    static void decompress(const void *stored, uint stored_size, void *block, uint block_size);
+
+    /**
+     * Blocks compressed and decompressed and their ratio, for the shell's "stats" command.
+     * @returns  human-readable report
+     */
+    static std::string report();
+
+protected:
+    static std::atomic<unsigned long long> blocks_written;
+    static std::atomic<unsigned long long> bytes_written;   // block images compressed
+    static std::atomic<unsigned long long> bytes_stored;    // what was stored for them
+    static std::atomic<unsigned long long> blocks_read;
+    static std::atomic<unsigned long long> bytes_read;      // stored images decompressed
+};
@@ -0,0 +1,84 @@
+/**
+ * @file parse_cache.cpp - implementation of ParseCache
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cctype>
+#include "parse_cache.h"
+using namespace std;
+using namespace hsql;
+
+/**
+ * Look up the normalized SQL, parsing and caching it on a miss
+ * @param   sql        SQL text as typed
+ * @return  ParsedSQL  parse result shared with the cache
+ */
+ParsedSQL ParseCache::get(const string &sql) {
+    string key = normalize(sql);
+    {
+        lock_guard<mutex> guard(this->cache_mutex);
+        auto found = this->entries.find(key);
+        if (found != this->entries.end()) {
+            // move to the front of the LRU list
+            this->lru.splice(this->lru.begin(), this->lru, found->second);
+            this->hits++;
+            return found->second->second;
+        }
+        this->misses++;
+    }
+    // parse outside the lock so other sessions are not held up
+    ParsedSQL parse(SQLParser::parseSQLString(key));
+    if (!parse->isValid() || this->capacity == 0)
+        return parse;
+    lock_guard<mutex> guard(this->cache_mutex);
+    auto found = this->entries.find(key);
+    if (found != this->entries.end())  // another session parsed it meanwhile
+        return found->second->second;
+    if (this->lru.size() >= this->capacity) {
+        this->entries.erase(this->lru.back().first);
+        this->lru.pop_back();
+    }
+    this->lru.push_front(make_pair(key, parse));
+    this->entries[key] = this->lru.begin();
+    return parse;
+}
+
+/**
+ * Drop every cached parse (ASTs still in use stay alive until released)
+ */
+void ParseCache::clear() {
+    lock_guard<mutex> guard(this->cache_mutex);
+    this->entries.clear();
+    this->lru.clear();
+}
+
+// Drop -- comments and collapse white space outside of quoted literals
+string ParseCache::normalize(const string &sql) {
+    string key;
+    key.reserve(sql.size());
+    char quote = '\0';
+    bool pending_space = false;
+    for (size_t i = 0; i < sql.size(); i++) {
+        char c = sql[i];
+        if (quote != '\0') {
+            key += c;
+            if (c == quote)
+                quote = '\0';
+        } else if (c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+            // a comment runs to the end of its line, which is white space like any other
+            while (i + 1 < sql.size() && sql[i + 1] != '\n')
+                i++;
+            pending_space = !key.empty();
+        } else if (isspace((unsigned char)c)) {
+            pending_space = !key.empty();
+        } else {
+            if (pending_space)
+                key += ' ';
+            pending_space = false;
+            if (c == '\'' || c == '"')
+                quote = c;
+            key += c;
+        }
+    }
+    return key;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file parse_cache.h - LRU cache of parsed SQL statements
+ * ParseCache
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "SQLParser.h"
+
+/**
+ * Parsed SQL shared between the cache and whoever is executing it, so that an
+ * eviction never frees an AST that is still in use.
+ */
+typedef std::shared_ptr<hsql::SQLParserResult> ParsedSQL;
+
+/**
+ * @class ParseCache - maps normalized SQL text to its Hyrise AST
+ *
+ * The AST is the only plan SQLExec has, so caching it means each statement
+ * shape is parsed once no matter how many times the application sends it.
+ * The least recently used shape is evicted when the cache is full.
+ * Invalid SQL is never cached. Safe to share between threads.
+ */
+class ParseCache {
+public:
+    /**
+     * Number of distinct statement shapes kept by default
+     */
+    static const size_t DEFAULT_CAPACITY = 512;
+
+    // ctor/dtor
+    ParseCache(size_t capacity=DEFAULT_CAPACITY) : capacity(capacity), hits(0), misses(0) {}
+    virtual ~ParseCache() {}
+    ParseCache(const ParseCache& other) = delete;
+    ParseCache(ParseCache&& temp) = delete;
+    ParseCache& operator=(const ParseCache& other) = delete;
+    ParseCache& operator=(ParseCache&& temp) = delete;
+
+    /**
+     * Get the parse of the given SQL, parsing it only on a cache miss.
+     * @param sql  SQL text as typed
+     * @returns    the (possibly shared) parse result, check isValid()
+     */
+    virtual ParsedSQL get(const std::string &sql);
+
+    /**
+     * Remove every cached parse.
+     */
+    virtual void clear();
+
+    /**
+     * Canonical form of the SQL text used as the cache key: outside of quoted
+     * literals, -- comments are dropped and runs of white space collapse to
+     * one blank, and leading and trailing white space is dropped.
+     * @param sql  SQL text as typed
+     * @returns    normalized SQL text
+     */
+    static std::string normalize(const std::string &sql);
+
+    // statistics
+    size_t get_hits() const {return hits;}
+    size_t get_misses() const {return misses;}
+    size_t size() {std::lock_guard<std::mutex> guard(cache_mutex); return lru.size();}
+
+protected:
+    typedef std::list<std::pair<std::string, ParsedSQL>> LRUList;
+
+    size_t capacity;
+    LRUList lru;  // most recently used at the front
+    std::unordered_map<std::string, LRUList::iterator> entries;
+    std::atomic<size_t> hits;    // atomic so the statistics can be read without the mutex
+    std::atomic<size_t> misses;
+    std::mutex cache_mutex;  // guards lru and entries
+};
@@ -0,0 +1,349 @@
+/**
+ * @file pax_page.cpp - implementation of PaxPage
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "pax_page.h"
+using namespace std;
+
+typedef u_int16_t u16;
+
+// bytes of a TEXT value's out-of-line pointer: [u32 first overflow page][u32 length]
+static const uint TOAST_POINTER_SZ = 2 * sizeof(u_int32_t);
+
+// bytes of the block header: number of rows, end of free space
+static const uint PAX_HEADER_SZ = 2 * sizeof(u16);
+
+// the int32 mini-columns after the row headers start on a multiple of 4
+static uint round_up_4(uint n) {
+    return (n + 3) & ~3U;
+}
+
+PaxPage::PaxPage(SlottedPage *page, const ColumnAttributes &column_attributes) :
+                 SlottedPage(*page->get_block(), page->get_block_id()) {
+    page->get_block()->set_flags(0);  // the memory is ours to free now
+    this->image.swap(page->get_image());
+    delete page;
+
+    uint n_booleans = 0;
+    for (ColumnAttribute ca: column_attributes) {
+        ColumnAttribute::DataType type = ca.get_data_type();
+        if (type != ColumnAttribute::INT && type != ColumnAttribute::TEXT && type != ColumnAttribute::BOOLEAN)
+            throw DbBlockError("Only know how to lay out INT, TEXT and BOOLEAN");
+        this->types.push_back(type);
+        this->booleans.push_back(type == ColumnAttribute::BOOLEAN ? n_booleans++ : 0);
+    }
+    this->header_sz = header_size_of(this->types);
+    this->capacity = capacity_of(this->block.get_size(), this->types);
+    uint offset = PAX_HEADER_SZ + this->capacity * VERSION_SZ + round_up_4(this->capacity * this->header_sz);
+    for (uint column = 0; column < this->types.size(); column++) {
+        this->columns.push_back(offset);
+        if (this->types[column] != ColumnAttribute::BOOLEAN)
+            offset += this->capacity * 4;
+    }
+    this->heap_start = offset;
+}
+
+uint PaxPage::text_room(uint block_size, const ColumnAttributes &column_attributes) {
+    vector<ColumnAttribute::DataType> types;
+    for (ColumnAttribute ca: column_attributes)
+        types.push_back(ca.get_data_type());
+    return block_size - layout_size(capacity_of(block_size, types), types);
+}
+
+PaxPage::~PaxPage() {
+    for (auto const &copy: this->copies)
+        delete[] copy;
+}
+
+/**
+ * Add a row, given in HeapTable's marshaled form, spreading it over the mini-columns.
+ * @param   Dbt *data           row to store
+ * @return  RecordID            its id in the block
+ * @throw   DbBlockNoRoomError  the block has no room for another row
+ */
+RecordID PaxPage::add(const Dbt *data) throw(DbBlockNoRoomError) {
+    // as in SlottedPage, a deleted row's id is never handed out again
+    RecordID id = this->num_records + 1;
+    if (id > this->capacity)
+        throw DbBlockNoRoomError("not enough room for new record");
+    const char *bytes = (const char *)data->get_data();
+    const char *nulls = bytes + VERSION_SZ;
+
+    // first see that its TEXT values fit
+    uint offset = VERSION_SZ + this->header_sz, needed = 0;
+    for (uint column = 0; column < this->types.size(); column++) {
+        ColumnAttribute::DataType type = this->types[column];
+        if (type == ColumnAttribute::BOOLEAN || HeapTable::get_bit(nulls, column)) {
+            continue;
+        } else if (type == ColumnAttribute::INT) {
+            offset += sizeof(int32_t);
+        } else {
+            u16 size = *(const u16 *)(bytes + offset);
+            uint n = size == HeapTable::TOASTED ? TOAST_POINTER_SZ : size;
+            offset += sizeof(u16) + n;
+            needed += n;
+        }
+    }
+    if (offset != data->get_size())
+        throw DbBlockError("row does not match the table's columns");
+    if (needed > this->end_free + 1U - this->heap_start)
+        throw DbBlockNoRoomError("not enough room for new record");
+
+    this->num_records = id;
+    memcpy(version(id), bytes, VERSION_SZ);
+    memcpy(row_header(id), nulls, this->header_sz);
+    offset = VERSION_SZ + this->header_sz;
+    for (uint column = 0; column < this->types.size(); column++) {
+        bool null = HeapTable::get_bit(nulls, column);
+        if (this->types[column] == ColumnAttribute::BOOLEAN) {
+            continue;
+        } else if (this->types[column] == ColumnAttribute::INT) {
+            ((int32_t *)address((u16)this->columns[column]))[id - 1] = null ? 0 : *(const int32_t *)(bytes + offset);
+            if (!null)
+                offset += sizeof(int32_t);
+        } else if (null) {
+            u16 *entry = text_entry(id, column);
+            entry[0] = entry[1] = 0;
+        } else {
+            u16 size = *(const u16 *)(bytes + offset);
+            offset += sizeof(u16);
+            uint n = size == HeapTable::TOASTED ? TOAST_POINTER_SZ : size;
+            u16 *entry = text_entry(id, column);
+            entry[0] = 0;
+            entry[1] = size;
+            if (n > 0) {
+                this->end_free -= n;
+                entry[0] = (u16)(this->end_free + 1U);
+                memcpy(address(entry[0]), bytes + offset, n);
+            }
+            offset += n;
+        }
+    }
+    put_header();
+    return id;
+}
+
+/**
+ * Get a row in HeapTable's marshaled form, gathered from the mini-columns.
+ * @param   record_id  row to get
+ * @return  Dbt*       the row (its bytes belong to the page), nullptr if deleted
+ */
+Dbt *PaxPage::get(RecordID record_id) const {
+    if (!have_record(record_id))
+        return nullptr;
+    uint size = VERSION_SZ + this->header_sz;
+    for (uint column = 0; column < this->types.size(); column++) {
+        if (this->types[column] == ColumnAttribute::BOOLEAN || is_null(record_id, column)) {
+            continue;
+        } else if (this->types[column] == ColumnAttribute::INT) {
+            size += sizeof(int32_t);
+        } else {
+            u16 n = text_entry(record_id, column)[1];
+            size += sizeof(u16) + (n == HeapTable::TOASTED ? TOAST_POINTER_SZ : n);
+        }
+    }
+    char *bytes = new char[size];
+    this->copies.push_back(bytes);
+    memcpy(bytes, version(record_id), VERSION_SZ);
+    memcpy(bytes + VERSION_SZ, row_header(record_id), this->header_sz);
+    uint offset = VERSION_SZ + this->header_sz;
+    for (uint column = 0; column < this->types.size(); column++) {
+        if (this->types[column] == ColumnAttribute::BOOLEAN || is_null(record_id, column)) {
+            continue;
+        } else if (this->types[column] == ColumnAttribute::INT) {
+            *(int32_t *)(bytes + offset) = ((int32_t *)address((u16)this->columns[column]))[record_id - 1];
+            offset += sizeof(int32_t);
+        } else {
+            const u16 *entry = text_entry(record_id, column);
+            uint n = entry[1] == HeapTable::TOASTED ? TOAST_POINTER_SZ : entry[1];
+            *(u16 *)(bytes + offset) = entry[1];
+            offset += sizeof(u16);
+            if (n > 0)
+                memcpy(bytes + offset, address(entry[0]), n);
+            offset += n;
+        }
+    }
+    return new Dbt(bytes, size);
+}
+
+// Rows are not rewritten in place: the heap table adds a new version instead
+void PaxPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError, DbBlockError) {
+    throw DbBlockError("PAX blocks do not replace rows in place");
+}
+
+/**
+ * Delete a row: its id is not reused, and its TEXT bytes are given back to free space.
+ * @param   record_id  row to delete
+ */
+void PaxPage::del(RecordID record_id) {
+    if (!have_record(record_id))
+        return;
+    TxnID *header = version(record_id);
+    header[0] = header[1] = 0;
+    for (uint column = 0; column < this->types.size(); column++)
+        if (this->types[column] == ColumnAttribute::TEXT) {
+            u16 *entry = text_entry(record_id, column);
+            entry[0] = entry[1] = 0;
+        }
+    compact();
+}
+
+/**
+ * All the rows in the block that have not been deleted.
+ * @return  RecordIDs*  their ids
+ */
+RecordIDs *PaxPage::ids(void) const {
+    RecordIDs *record_ids = new RecordIDs();
+    for (RecordID record_id = 1; record_id <= this->num_records; record_id++)
+        if (have_record(record_id))
+            record_ids->push_back(record_id);
+    return record_ids;
+}
+
+void PaxPage::get_version(RecordID record_id, TxnID &xmin, TxnID &xmax) const {
+    const TxnID *header = version(record_id);
+    xmin = header[0];
+    xmax = header[1];
+}
+
+void PaxPage::set_xmax(RecordID record_id, TxnID xmax) {
+    version(record_id)[1] = xmax;
+}
+
+void PaxPage::match(uint column, const Value &value, RecordIDs &record_ids) const {
+    // IS NULL is answered by the row headers alone
+    auto null = [this, column](RecordID id) { return is_null(id, column); };
+    if (value.is_null) {
+        record_ids.erase(remove_if(record_ids.begin(), record_ids.end(), [&null](RecordID id) { return !null(id); }),
+                         record_ids.end());
+        return;
+    }
+    if (value.data_type != this->types[column]) {
+        record_ids.clear();
+        return;
+    }
+    if (this->types[column] == ColumnAttribute::INT) {
+        filter(column, IntPredicate(IntPredicate::EQ, value.n), record_ids);
+    } else if (this->types[column] == ColumnAttribute::BOOLEAN) {
+        uint bits = ((uint)this->types.size() + 7) / 8;  // the BOOLEAN bits follow the NULL bits
+        uint boolean = this->booleans[column];
+        bool b = value.n != 0;
+        record_ids.erase(remove_if(record_ids.begin(), record_ids.end(),
+                                   [this, &null, bits, boolean, b](RecordID id) {
+                                       return null(id) || HeapTable::get_bit(row_header(id) + bits, boolean) != b;
+                                   }),
+                         record_ids.end());
+    } else {
+        record_ids.erase(remove_if(record_ids.begin(), record_ids.end(), null), record_ids.end());
+        // sizes first: only values of the right length are compared byte by byte
+        const u16 *entries = (const u16 *)address((u16)this->columns[column]);
+        const string &s = value.s;
+        record_ids.erase(remove_if(record_ids.begin(), record_ids.end(),
+                                   [this, entries, &s](RecordID id) {
+                                       const u16 *entry = entries + 2 * (id - 1);
+                                       if (entry[1] == HeapTable::TOASTED)
+                                           return false;
+                                       return entry[1] != s.size() ||
+                                              (entry[1] > 0 && memcmp(address(entry[0]), s.data(), s.size()) != 0);
+                                   }),
+                         record_ids.end());
+    }
+}
+
+void PaxPage::filter(uint column, const IntPredicate &predicate, RecordIDs &record_ids) const {
+    if (this->types[column] != ColumnAttribute::INT)
+        throw DbBlockError("can only filter an INT column");
+    // one pass over the column's array, which holds nothing else
+    vector<u_int64_t> bitmap((this->num_records + 63) / 64);
+    IntFilter::filter((const int32_t *)address((u16)this->columns[column]), this->num_records, predicate,
+                      bitmap.data());
+    record_ids.erase(remove_if(record_ids.begin(), record_ids.end(),
+                               [this, &bitmap, column](RecordID id) {
+                                   return !(bitmap[(id - 1) / 64] >> ((id - 1) % 64) & 1) || is_null(id, column);
+                               }),
+                     record_ids.end());
+}
+
+bool PaxPage::is_toasted(RecordID record_id, uint column) const {
+    return this->types[column] == ColumnAttribute::TEXT && text_entry(record_id, column)[1] == HeapTable::TOASTED;
+}
+
+// Bytes of a row header for the given columns (see HeapTable::row_header_size)
+uint PaxPage::header_size_of(const vector<ColumnAttribute::DataType> &types) {
+    uint n_booleans = (uint)count(types.begin(), types.end(), ColumnAttribute::BOOLEAN);
+    return HeapTable::row_header_size((uint)types.size(), n_booleans);
+}
+
+// Rows a block has room for: enough that they fill it if their TEXT values are about TEXT_GUESS bytes long
+uint PaxPage::capacity_of(uint block_size, const vector<ColumnAttribute::DataType> &types) {
+    uint row_sz = VERSION_SZ + header_size_of(types);
+    for (auto const &type: types)
+        if (type != ColumnAttribute::BOOLEAN)
+            row_sz += 4 + (type == ColumnAttribute::TEXT ? TEXT_GUESS : 0);
+    // less the padding after the row headers
+    return min((block_size - PAX_HEADER_SZ - 3) / row_sz, (uint)UINT16_MAX);
+}
+
+// Bytes from the start of a block to the end of its mini-columns
+uint PaxPage::layout_size(uint capacity, const vector<ColumnAttribute::DataType> &types) {
+    uint size = PAX_HEADER_SZ + capacity * VERSION_SZ + round_up_4(capacity * header_size_of(types));
+    for (auto const &type: types)
+        if (type != ColumnAttribute::BOOLEAN)
+            size += capacity * 4;
+    return size;
+}
+
+// Is the row there and not deleted?
+bool PaxPage::have_record(RecordID record_id) const {
+    return record_id >= 1 && record_id <= this->num_records && version(record_id)[0] != 0;
+}
+
+// Version header (xmin, xmax) of a row
+TxnID *PaxPage::version(RecordID record_id) const {
+    return (TxnID *)address((u16)(PAX_HEADER_SZ + (record_id - 1) * VERSION_SZ));
+}
+
+// NULL and BOOLEAN bits of a row
+char *PaxPage::row_header(RecordID record_id) const {
+    return (char *)address((u16)(PAX_HEADER_SZ + this->capacity * VERSION_SZ + (record_id - 1) * this->header_sz));
+}
+
+// Is a row's value in a column NULL?
+bool PaxPage::is_null(RecordID record_id, uint column) const {
+    return HeapTable::get_bit(row_header(record_id), column);
+}
+
+// (offset, size) of a row's value in a TEXT column
+u16 *PaxPage::text_entry(RecordID record_id, uint column) const {
+    return (u16 *)address((u16)this->columns[column]) + 2 * (record_id - 1);
+}
+
+// Move the TEXT bytes of the remaining rows together at the end of the block
+void PaxPage::compact() {
+    vector<pair<u16 *, string>> values;
+    for (RecordID record_id = 1; record_id <= this->num_records; record_id++) {
+        if (!have_record(record_id))
+            continue;
+        for (uint column = 0; column < this->types.size(); column++) {
+            if (this->types[column] != ColumnAttribute::TEXT)
+                continue;
+            u16 *entry = text_entry(record_id, column);
+            uint n = entry[1] == HeapTable::TOASTED ? TOAST_POINTER_SZ : entry[1];
+            if (n > 0)
+                values.push_back(make_pair(entry, string((char *)address(entry[0]), n)));
+        }
+    }
+    uint end = this->block.get_size();
+    for (auto const &value: values) {
+        end -= (uint)value.second.size();
+        value.first[0] = (u16)end;
+        memcpy(address((u16)end), value.second.data(), value.second.size());
+    }
+    this->end_free = (u16)(end - 1);
+    put_header();
+}
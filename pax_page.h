@@ -0,0 +1,119 @@
+/**
+ * @file pax_page.h - column-wise (PAX) layout of a heap table's block
+ * PaxPage: SlottedPage
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <vector>
+#include "heap_storage.h"
+#include "int_filter.h"
+
+/**
+ * @class PaxPage - block of a heap table laid out a column at a time
+ *
+ * Partition Attributes Across: the block holds the same rows a slotted page
+ * would, but each column's values are kept together in a mini-column, so a
+ * predicate on one column reads one contiguous array instead of every row.
+ *     Bytes 0x00 - 0x01: number of rows
+ *     Bytes 0x02 - 0x03: offset to end of free space (as in SlottedPage)
+ *     then capacity (xmin, xmax) version headers (xmin 0 for a deleted row)
+ *     then capacity row headers of NULL and BOOLEAN bits (see HeapTable),
+ *     padded to a multiple of 4 bytes
+ *     then for each column but the BOOLEAN ones, capacity entries: an int32
+ *     for INT, a (u16 offset, u16 size) for TEXT
+ *     then free space, then the TEXT bytes, added from the end of the block
+ * An out-of-line TEXT value has size HeapTable::TOASTED and 8 bytes of
+ * overflow pointer and length. A NULL has a 0 entry. The capacity follows from the page size and
+ * the column types alone, so a freshly initialized SlottedPage is also an
+ * empty PaxPage.
+ *
+ * add and get take and give rows in HeapTable's marshaled form, so the heap
+ * table handles both layouts alike; rows handed out by get stay valid until
+ * the page is deleted. Row ids are never reused, so that a handle kept by a
+ * cursor, an index or compact's moves never comes to name another row: once
+ * a block has had capacity rows it takes no more, even after deletes.
+ */
+class PaxPage : public SlottedPage {
+public:
+    /**
+     * TEXT bytes allowed for per value when sizing the mini-columns
+     */
+    static const uint TEXT_GUESS = 16;
+
+    /**
+     * Bytes left for TEXT values in an empty block, i.e. the most one row's may take.
+     * @param block_size         page size
+     * @param column_attributes  types of the table's columns
+     * @returns                  bytes after the mini-columns
+     */
+    static uint text_room(uint block_size, const ColumnAttributes &column_attributes);
+
+    /**
+     * Take over a block read as a SlottedPage.
+     * @param page               block (deleted here; its memory is now this page's)
+     * @param column_attributes  types of the table's columns
+     */
+    PaxPage(SlottedPage *page, const ColumnAttributes &column_attributes);
+    virtual ~PaxPage();
+    PaxPage(const PaxPage& other) = delete;
+    PaxPage(PaxPage&& temp) = delete;
+    PaxPage& operator=(const PaxPage& other) = delete;
+    PaxPage& operator=(PaxPage& temp) = delete;
+
+    virtual RecordID add(const Dbt* data) throw(DbBlockNoRoomError);
+    virtual Dbt* get(RecordID record_id) const;
+    virtual void put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError, DbBlockError);
+    virtual void del(RecordID record_id);
+    virtual RecordIDs* ids(void) const;
+    virtual void get_version(RecordID record_id, TxnID &xmin, TxnID &xmax) const;
+    virtual void set_xmax(RecordID record_id, TxnID xmax);
+
+    /**
+     * Keep only the rows whose value in a column may equal the given one
+     * (is NULL, for a NULL value). Out-of-line TEXT values are kept (see is_toasted).
+     * @param column      position of the column
+     * @param value       value to compare with
+     * @param record_ids  rows to narrow down, in place
+     */
+    virtual void match(uint column, const Value &value, RecordIDs &record_ids) const;
+
+    /**
+     * Keep only the rows whose value in an INT column satisfies a predicate,
+     * comparing the whole column's array at once (see IntFilter). A NULL
+     * never satisfies it.
+     * @param column      position of an INT column
+     * @param predicate   comparison to make
+     * @param record_ids  rows to narrow down, in place
+     */
+    virtual void filter(uint column, const IntPredicate &predicate, RecordIDs &record_ids) const;
+
+    /**
+     * Is a row's TEXT value kept out of line (so match could not compare it)?
+     * @param record_id  row
+     * @param column     position of a TEXT column
+     * @returns          true if the value is on overflow pages
+     */
+    virtual bool is_toasted(RecordID record_id, uint column) const;
+
+protected:
+    std::vector<ColumnAttribute::DataType> types;
+    std::vector<uint> columns;   // offset of each mini-column (none for BOOLEAN)
+    std::vector<uint> booleans;  // for a BOOLEAN column, which of them it is
+    uint header_sz;              // bytes of a row header
+    uint capacity;               // rows the block has room for
+    uint heap_start;             // end of the mini-columns
+    mutable std::vector<char*> copies;  // rows handed out by get
+
+    static uint header_size_of(const std::vector<ColumnAttribute::DataType> &types);
+    static uint capacity_of(uint block_size, const std::vector<ColumnAttribute::DataType> &types);
+    static uint layout_size(uint capacity, const std::vector<ColumnAttribute::DataType> &types);
+    virtual bool have_record(RecordID record_id) const;
+    virtual TxnID *version(RecordID record_id) const;
+    virtual char *row_header(RecordID record_id) const;
+    virtual bool is_null(RecordID record_id, uint column) const;
+    virtual u_int16_t *text_entry(RecordID record_id, uint column) const;
+    virtual void compact();
+};
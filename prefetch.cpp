@@ -0,0 +1,115 @@
+/**
+ * @file prefetch.cpp - implementation of Prefetcher
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cstdlib>
+#include <sstream>
+#include "prefetch.h"
+#include "heap_storage.h"
+using namespace std;
+
+/**
+ * @return  Prefetcher&  the prefetcher every heap file shares
+ */
+Prefetcher &Prefetcher::shared() {
+    static Prefetcher prefetcher;
+    return prefetcher;
+}
+
+/**
+ * Start the background thread
+ */
+Prefetcher::Prefetcher() : current(nullptr), cancel(false), stopping(false), n_requests(0), n_blocks(0) {
+    this->worker = thread(&Prefetcher::run, this);
+}
+
+Prefetcher::~Prefetcher() {
+    stop();
+}
+
+/**
+ * Queue a run of blocks for the thread
+ * @param   Db* db           heap file's database
+ * @param   u_int32_t first  first block id
+ * @param   u_int32_t last   last block id
+ */
+void Prefetcher::request(Db *db, u_int32_t first, u_int32_t last) {
+    lock_guard<std::mutex> guard(this->mutex);
+    if (this->stopping)
+        return;
+    this->requests.push_back(Request{db, first, last});
+    this->n_requests++;
+    this->requested.notify_one();
+}
+
+/**
+ * Drop queued requests for a database and wait out the one being read
+ * @param   Db* db  database about to be closed
+ */
+void Prefetcher::forget(Db *db) {
+    unique_lock<std::mutex> lock(this->mutex);
+    for (auto request = this->requests.begin(); request != this->requests.end();)
+        if (request->db == db)
+            request = this->requests.erase(request);
+        else
+            request++;
+    if (this->current == db) {
+        this->cancel = true;
+        this->idle.wait(lock, [this, db]() {return this->current != db;});
+    }
+}
+
+/**
+ * Wake the thread up and wait for it to exit
+ */
+void Prefetcher::stop() {
+    {
+        lock_guard<std::mutex> guard(this->mutex);
+        this->stopping = true;
+        this->requests.clear();
+        this->cancel = true;
+        this->requested.notify_all();
+    }
+    if (this->worker.joinable())
+        this->worker.join();
+}
+
+// Read-ahead requests and blocks read
+string Prefetcher::report() const {
+    ostringstream out;
+    out << "prefetch: " << this->n_requests << " read-aheads, " << this->n_blocks << " blocks read ahead" << endl;
+    return out.str();
+}
+
+// Read each requested run into the buffer pool until stopped
+void Prefetcher::run() {
+    unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->requested.wait(lock, [this]() {return this->stopping || !this->requests.empty();});
+        if (this->stopping)
+            return;
+        Request request = this->requests.front();
+        this->requests.pop_front();
+        this->current = request.db;
+        this->cancel = false;
+        lock.unlock();
+        for (u_int32_t block_id = request.first; block_id <= request.last && !this->cancel; block_id++) {
+            Dbt key(&block_id, sizeof(block_id));
+            Dbt data;
+            data.set_flags(DB_DBT_MALLOC);
+            try {
+                if (request.db->get(nullptr, &key, &data, 0) != 0)
+                    break;  // past the end of the file
+            } catch (DbException &e) {
+                break;  // only a hint: the scan will report real errors itself
+            }
+            free(data.get_data());
+            HeapFile::pool_access(data.get_size());  // may push changed pages out of the pool
+            this->n_blocks++;
+        }
+        lock.lock();
+        this->current = nullptr;
+        this->idle.notify_all();
+    }
+}
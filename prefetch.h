@@ -0,0 +1,85 @@
+/**
+ * @file prefetch.h - asynchronous read-ahead of heap file blocks
+ * Prefetcher
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "db_cxx.h"
+
+/**
+ * @class Prefetcher - thread that reads blocks ahead of sequential scans
+ *
+ * HeapFile::get asks for the blocks after the one a scan is reading. The
+ * thread reads them through the Berkeley DB handle and throws the copies away:
+ * what matters is that the pages are then in the environment's buffer pool,
+ * so the scan finds them there instead of waiting on the disk block by block.
+ */
+class Prefetcher {
+public:
+    /**
+     * The prefetcher shared by every heap file, started on first use.
+     * @returns  the shared prefetcher
+     */
+    static Prefetcher &shared();
+
+    Prefetcher();
+    virtual ~Prefetcher();
+    Prefetcher(const Prefetcher& other) = delete;
+    Prefetcher(Prefetcher&& temp) = delete;
+    Prefetcher& operator=(const Prefetcher& other) = delete;
+    Prefetcher& operator=(Prefetcher&& temp) = delete;
+
+    /**
+     * Queue a run of blocks to be read into the buffer pool.
+     * @param db     open RECNO database of the heap file
+     * @param first  first block id
+     * @param last   last block id (inclusive)
+     */
+    virtual void request(Db *db, u_int32_t first, u_int32_t last);
+
+    /**
+     * Drop the requests for a database and wait until it is no longer being
+     * read, so that it can be closed.
+     * @param db  database about to be closed
+     */
+    virtual void forget(Db *db);
+
+    /**
+     * Stop the thread, dropping whatever is still queued.
+     */
+    virtual void stop();
+
+    /**
+     * Counters for the shell's "stats" command.
+     * @returns  human-readable report, one line
+     */
+    virtual std::string report() const;
+
+protected:
+    struct Request {
+        Db *db;
+        u_int32_t first;
+        u_int32_t last;
+    };
+    std::deque<Request> requests;
+    Db *current;              // database being read, nullptr when idle
+    std::atomic<bool> cancel;  // forget() wants current given up
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable requested;  // signalled by request and stop
+    std::condition_variable idle;       // signalled when current is done
+    std::atomic<size_t> n_requests;
+    std::atomic<size_t> n_blocks;
+    std::thread worker;
+
+    virtual void run();
+};
@@ -3,10 +3,41 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 #include "schema_tables.h"
 //#include "ParseTreeToString.h" - Unused header file
 
+// Path of a file in the environment directory
+static std::string env_path(const std::string &file_name) {
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    return std::string(env_home) + "/" + file_name;
+}
+
+// The catalog version the database was created with (0 for a new database)
+static u_int32_t stored_catalog_version() {
+    std::ifstream in(env_path("_catalog.version"));
+    u_int32_t version = 0;
+    if (in >> version)
+        return version;
+    // schema tables from before the version was recorded
+    return access(env_path(Tables::TABLE_NAME + ".db").c_str(), F_OK) == 0 ? 1 : 0;
+}
+
 void initialize_schema_tables() {
+    u_int32_t version = stored_catalog_version();
+    if (version != 0 && version != CATALOG_VERSION)
+        throw DbRelationError("database has catalog version " + std::to_string(version) + ", but only version " +
+                              std::to_string(CATALOG_VERSION) + " can be read: recreate it");
+    if (version == 0) {
+        // first, so that schema tables without it are always old ones
+        std::ofstream out(env_path("_catalog.version"));
+        out << CATALOG_VERSION << std::endl;
+        if (!out)
+            throw DbRelationError("cannot write _catalog.version");
+    }
     Tables tables;
     tables.create_if_not_exists();
     tables.close();
@@ -48,12 +79,20 @@ bool is_acceptable_data_type(std::string dt) {
 const Identifier Tables::TABLE_NAME = "_tables";
 Columns* Tables::columns_table = nullptr;
 std::map<Identifier,DbRelation*> Tables::table_cache;
+std::recursive_mutex Tables::table_cache_mutex;
 
 // get the column name for _tables column
 ColumnNames& Tables::COLUMN_NAMES() {
     static ColumnNames cn;
-    if (cn.empty())
+    if (cn.empty()) {
         cn.push_back("table_name");
+        cn.push_back("storage");
+        cn.push_back("page_size");
+        cn.push_back("layout");
+        cn.push_back("bloom");
+        cn.push_back("dictionary");
+        cn.push_back("compression");
+    }
     return cn;
 }
 
@@ -63,12 +102,22 @@ ColumnAttributes& Tables::COLUMN_ATTRIBUTES() {
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
         cas.push_back(ca);
+        cas.push_back(ca);
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);
+        ca.set_data_type(ColumnAttribute::TEXT);
+        cas.push_back(ca);
+        cas.push_back(ca);
+        cas.push_back(ca);
+        cas.push_back(ca);
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure: table_name, the storage it is kept in, its page size, block layout,
+// Bloom filter columns, dictionary-encoded columns and block compression
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+    std::lock_guard<std::recursive_mutex> guard(Tables::table_cache_mutex);
     Tables::table_cache[TABLE_NAME] = this;
     if (Tables::columns_table == nullptr)
         columns_table = new Columns();
@@ -79,6 +128,12 @@ Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
 void Tables::create() {
     HeapTable::create();
     ValueDict row;
+    row["storage"] = Value("heap");
+    row["page_size"] = Value((int32_t)DbBlock::BLOCK_SZ);
+    row["layout"] = Value("row");
+    row["bloom"] = Value("");
+    row["dictionary"] = Value("");
+    row["compression"] = Value("none");
     row["table_name"] = Value("_tables");
     insert(&row);
     row["table_name"] = Value("_columns");
@@ -90,7 +145,9 @@ void Tables::create() {
 // Manually check that table_name is unique.
 Handle Tables::insert(const ValueDict* row) {
     // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles* handles = select(row);
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    Handles* handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
@@ -104,6 +161,8 @@ void Tables::del(Handle handle) {
     // remove from cache, if there
     ValueDict* row = project(handle);
     Identifier table_name = row->at("table_name").s;
+    delete row;
+    std::lock_guard<std::recursive_mutex> guard(Tables::table_cache_mutex);
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation* table = Tables::table_cache.at(table_name);
         Tables::table_cache.erase(table_name);
@@ -143,17 +202,69 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
     delete handles;
 }
 
+// Split a comma-separated list of column names
+static void split_columns(const std::string &list, ColumnNames &column_names) {
+    column_names.clear();
+    std::istringstream in(list);
+    std::string column_name;
+    while (std::getline(in, column_name, ','))
+        if (!column_name.empty())
+            column_names.push_back(column_name);
+}
+
+// Return the storage, page size, block layout, Bloom filter and dictionary-encoded columns and block compression
+// recorded for a table in _tables.
+void Tables::get_storage(Identifier table_name, std::string &storage, uint &page_size, std::string &layout,
+                         ColumnNames &bloom_columns, ColumnNames &dictionary_columns, std::string &compression) {
+    // SELECT storage, page_size, layout, bloom, dictionary, compression FROM _tables WHERE table_name = <table_name>
+    DbRelation* tables = Tables::table_cache.at(TABLE_NAME);
+    ValueDict where;
+    where["table_name"] = table_name;
+    Handles* handles = tables->select(&where);
+    storage = "heap";
+    page_size = DbBlock::BLOCK_SZ;
+    layout = "row";
+    bloom_columns.clear();
+    dictionary_columns.clear();
+    compression = "none";
+    if (!handles->empty()) {
+        ValueDict* row = tables->project(handles->front());
+        storage = row->at("storage").s;
+        page_size = (uint)row->at("page_size").n;
+        layout = row->at("layout").s;
+        split_columns(row->at("bloom").s, bloom_columns);
+        split_columns(row->at("dictionary").s, dictionary_columns);
+        compression = row->at("compression").s;
+        delete row;
+    }
+    delete handles;
+}
+
 // Return a table for given table_name.
 DbRelation& Tables::get_table(Identifier table_name) {
+    std::lock_guard<std::recursive_mutex> guard(Tables::table_cache_mutex);
     // if they are asking about a table we've once constructed, then just return that one
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return  *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise it is a ColumnTable or a HeapTable kept in the storage recorded for it
     ColumnNames column_names;
     ColumnAttributes column_attributes;
     get_columns(table_name, column_names, column_attributes);
-    DbRelation* table = new HeapTable(table_name, column_names, column_attributes);
+    std::string storage;
+    uint page_size;
+    std::string layout;
+    ColumnNames bloom_columns;
+    ColumnNames dictionary_columns;
+    std::string compression;
+    get_storage(table_name, storage, page_size, layout, bloom_columns, dictionary_columns, compression);
+    DbRelation* table;
+    if (storage == "column")
+        table = new ColumnTable(table_name, column_names, column_attributes, page_size, layout,
+                                bloom_columns, dictionary_columns, compression);
+    else
+        table = new HeapTable(table_name, column_names, column_attributes, storage, page_size, layout,
+                              bloom_columns, dictionary_columns, compression);
     Tables::table_cache[table_name] = table;
     return *table;
 }
@@ -258,6 +369,7 @@ Handle Columns::insert(const ValueDict* row) {
  */
 const Identifier Indices::TABLE_NAME = "_indices";
 std::map<std::pair<Identifier,Identifier>,DbIndex*> Indices::index_cache;
+std::recursive_mutex Indices::index_cache_mutex;
 
 // get the column name for _indices column
 ColumnNames& Indices::COLUMN_NAMES() {
@@ -323,7 +435,9 @@ void Indices::del(Handle handle) {
     ValueDict* row = project(handle);
     Identifier table_name = row->at("table_name").s;
     Identifier index_name = row->at("index_name").s;
+    delete row;
     std::pair<Identifier,Identifier> cache_key(table_name, index_name);
+    std::lock_guard<std::recursive_mutex> guard(Indices::index_cache_mutex);
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end()) {
         DbIndex* index = Indices::index_cache.at(cache_key);
         Indices::index_cache.erase(cache_key);
@@ -378,6 +492,7 @@ public:
 DbIndex& Indices::get_index(Identifier table_name, Identifier index_name) {
     // if they are asking about an index we've once constructed, then just return that one
     std::pair<Identifier,Identifier> cache_key(table_name, index_name);
+    std::lock_guard<std::recursive_mutex> guard(Indices::index_cache_mutex);
     if (Indices::index_cache.find(cache_key) != Indices::index_cache.end())
         return  *Indices::index_cache[cache_key];
 
@@ -7,12 +7,25 @@
  */
 #pragma once
 
+#include <mutex>
 #include "heap_storage.h"
+#include "column_storage.h"
+
+/**
+ * Layout of the schema tables, recorded in the environment directory
+ * (_catalog.version) when they are created:
+ *   1  nothing recorded: _tables has only table_name, or only some of the columns below
+ *   2  _tables also has storage, page_size, layout, bloom, dictionary and compression,
+ *      and each heap row has its NULL and BOOLEAN bits between its version and its fields
+ * A database from before the version was recorded is therefore refused rather than misread.
+ */
+const u_int32_t CATALOG_VERSION = 2;
 
 /**
  * Initialize access to the schema tables.
  * Must be called before anything else is done with any of the schema
  * data structures.
+ * @throws DbRelationError  the database was created with another CATALOG_VERSION
  */
 void initialize_schema_tables();
 
@@ -57,6 +70,20 @@ public:
      */
     static DbRelation& get_table(Identifier table_name);
 
+    /**
+     * Get the storage a table's rows are kept in.
+     * @param table_name  table to look up
+     * @param storage     returned by reference: "heap", "mmap" or "uring" (see HeapTable)
+     *                    or "column" (see ColumnTable)
+     * @param page_size   returned by reference: bytes in each of its blocks
+     * @param layout      returned by reference: "row" or "pax" (see HeapTable)
+     * @param bloom_columns  returned by reference: columns with Bloom filters (see HeapTable)
+     * @param dictionary_columns  returned by reference: dictionary-encoded columns (see HeapTable)
+     * @param compression  returned by reference: "none" or "zlib" (see HeapTable)
+     */
+    static void get_storage(Identifier table_name, std::string &storage, uint &page_size, std::string &layout,
+                            ColumnNames &bloom_columns, ColumnNames &dictionary_columns, std::string &compression);
+
 protected:
     // hard-coded columns for _tables table
     static ColumnNames& COLUMN_NAMES();
@@ -68,6 +95,7 @@ protected:
 private:
     // keep a cache of all the tables we've instantiated so far
     static std::map<Identifier,DbRelation*> table_cache;
+    static std::recursive_mutex table_cache_mutex;
 };
 
 
@@ -146,4 +174,5 @@ protected:
 
 private:
 	  static std::map<std::pair<Identifier,Identifier>,DbIndex*> index_cache;
+	  static std::recursive_mutex index_cache_mutex;
 };
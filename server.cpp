@@ -0,0 +1,203 @@
+/**
+ * @file server.cpp - implementation of SQLServer
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "SQLExec.h"
+#include "int_filter.h"
+using namespace std;
+using namespace hsql;
+
+/**
+ * Start listening and spin up the worker pool
+ * @param   address    socket path or TCP port
+ * @param   n_threads  worker count
+ * @param   cache      shared parse cache
+ * @throw   SQLServerError  could not listen on address
+ */
+SQLServer::SQLServer(string address, uint n_threads, ParseCache &cache) :
+                     address(address), n_threads(n_threads == 0 ? 1 : n_threads),
+                     cache(cache), listen_fd(-1), is_unix(true), stopping(false) {
+    listen_on();
+    for (uint i = 0; i < this->n_threads; i++)
+        this->workers.push_back(thread(&SQLServer::worker, this));
+}
+
+// Close the listening socket, cut off the sessions and wait for the workers to finish
+SQLServer::~SQLServer() {
+    if (this->listen_fd >= 0)
+        ::close(this->listen_fd);
+    if (this->is_unix)
+        unlink(this->address.c_str());
+    {
+        lock_guard<mutex> guard(this->clients_mutex);
+        this->stopping = true;
+        while (!this->clients.empty()) {
+            ::close(this->clients.front());
+            this->clients.pop();
+        }
+        // a worker waiting for its client's next line sees the end of the connection
+        for (int fd: this->sessions)
+            shutdown(fd, SHUT_RDWR);
+        this->clients_ready.notify_all();
+    }
+    for (auto &worker: this->workers)
+        worker.join();
+}
+
+/**
+ * Accept clients forever, queueing each for the next free worker
+ */
+void SQLServer::run() {
+    while (true) {
+        int fd = accept(this->listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            throw SQLServerError(string("accept: ") + strerror(errno));
+        }
+        lock_guard<mutex> guard(this->clients_mutex);
+        this->clients.push(fd);
+        this->clients_ready.notify_one();
+    }
+}
+
+// Bind to the socket path, or to 127.0.0.1 if the address is all digits
+void SQLServer::listen_on() {
+    this->is_unix = this->address.find_first_not_of("0123456789") != string::npos;
+    if (this->is_unix) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (this->address.size() >= sizeof(addr.sun_path))
+            throw SQLServerError("socket path too long: " + this->address);
+        strcpy(addr.sun_path, this->address.c_str());
+        unlink(this->address.c_str());
+        this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (this->listen_fd < 0 || bind(this->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            throw SQLServerError("cannot bind " + this->address + ": " + strerror(errno));
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)atoi(this->address.c_str()));
+        this->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (this->listen_fd < 0 || bind(this->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            throw SQLServerError("cannot bind port " + this->address + ": " + strerror(errno));
+    }
+    if (listen(this->listen_fd, SOMAXCONN) < 0)
+        throw SQLServerError(string("listen: ") + strerror(errno));
+}
+
+// Worker thread: serve one queued session after another until the server stops
+void SQLServer::worker() {
+    while (true) {
+        int fd;
+        {
+            unique_lock<mutex> lock(this->clients_mutex);
+            this->clients_ready.wait(lock, [this]() {return !this->clients.empty() || this->stopping;});
+            if (this->stopping)
+                return;
+            fd = this->clients.front();
+            this->clients.pop();
+            this->sessions.insert(fd);
+        }
+        serve(fd);
+        SQLExec::end_session();
+        lock_guard<mutex> guard(this->clients_mutex);
+        this->sessions.erase(fd);
+        ::close(fd);
+    }
+}
+
+// Read lines from the client and answer each with its results and a prompt
+void SQLServer::serve(int fd) {
+    const string prompt = "SQL> ";
+    send_all(fd, prompt);
+    string pending;
+    char buffer[4096];
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        pending.append(buffer, (size_t)n);
+        size_t eol;
+        while ((eol = pending.find('\n')) != string::npos) {
+            string query = pending.substr(0, eol);
+            pending.erase(0, eol + 1);
+            if (!query.empty() && query.back() == '\r')
+                query.pop_back();
+            if (query == "quit")
+                return;
+            if (query == "stats")
+                send_all(fd, SQLExec::statistics());
+            else if (query == "bench")
+                send_all(fd, IntFilter::benchmark());
+            else if (query == "vacuum")
+                send_all(fd, SQLExec::vacuum_command() + "\n");
+            else if (query.compare(0, 4, "set ") == 0)
+                send_all(fd, set_option(query));
+            else if (!query.empty())
+                send_all(fd, execute(query));
+            send_all(fd, prompt);
+        }
+    }
+}
+
+// Run every statement on the line, returning what the shell would print
+string SQLServer::execute(const string &query) {
+    ostringstream out;
+    ParsedSQL parse = this->cache.get(query);
+    if (!parse->isValid()) {
+        out << "invalid SQL: " << query << "\n" << parse->errorMsg() << "\n";
+        return out.str();
+    }
+    for (uint i = 0; i < parse->size(); i++) {
+        try {
+            QueryResult *result = SQLExec::execute(parse->getStatement(i));
+            out << *result << "\n";
+            delete result;
+        } catch (exception& e) {
+            // not just SQLExecError: never let a failing statement take down the worker
+            out << "Error: " << e.what() << "\n";
+        }
+    }
+    return out.str();
+}
+
+// Set a session option, returning what the shell would print
+string SQLServer::set_option(const string &line) {
+    try {
+        return SQLExec::set_option(line) + "\n";
+    } catch (SQLExecError& e) {
+        return string("Error: ") + e.what() + "\n";
+    }
+}
+
+// Write all of data, ignoring a client that has gone away
+void SQLServer::send_all(int fd, const string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        sent += (size_t)n;
+    }
+}
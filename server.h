@@ -0,0 +1,76 @@
+/**
+ * @file server.h - multi-threaded SQL server
+ * SQLServer
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parse_cache.h"
+
+/**
+ * @class SQLServerError - exception for setting up the server
+ */
+class SQLServerError : public std::runtime_error {
+public:
+    explicit SQLServerError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class SQLServer - serves concurrent client sessions against the one DbEnv
+ *
+ * Listens on a Unix domain socket or on a localhost TCP port. Each accepted
+ * connection is a session that one worker of a fixed pool serves until the
+ * client disconnects or sends "quit". The protocol is the shell's: the client
+ * sends SQL a line at a time and gets back each statement's result followed
+ * by a "SQL> " prompt. All sessions share one ParseCache. Deleting the
+ * server disconnects the sessions in progress and joins the workers.
+ */
+class SQLServer {
+public:
+    /**
+     * @param address    socket path, or a TCP port number to listen on localhost
+     * @param n_threads  number of sessions served at once
+     * @param cache      parse cache shared by all sessions
+     */
+    SQLServer(std::string address, uint n_threads, ParseCache &cache);
+    virtual ~SQLServer();
+    SQLServer(const SQLServer& other) = delete;
+    SQLServer(SQLServer&& temp) = delete;
+    SQLServer& operator=(const SQLServer& other) = delete;
+    SQLServer& operator=(SQLServer&& temp) = delete;
+
+    /**
+     * Accept connections and hand them to the workers (returns only on error).
+     */
+    virtual void run();
+
+protected:
+    std::string address;
+    uint n_threads;
+    ParseCache &cache;
+    int listen_fd;
+    bool is_unix;
+
+    std::vector<std::thread> workers;
+    std::queue<int> clients;  // accepted connections waiting for a worker
+    std::set<int> sessions;   // connections being served
+    bool stopping;            // workers are to finish
+    std::mutex clients_mutex; // guards clients, sessions and stopping
+    std::condition_variable clients_ready;
+
+    virtual void listen_on();
+    virtual void worker();
+    virtual void serve(int fd);
+    virtual std::string execute(const std::string &query);
+    virtual std::string set_option(const std::string &line);
+    static void send_all(int fd, const std::string &data);
+};
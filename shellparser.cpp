@@ -10,17 +10,29 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <thread>
 #include <cassert>
 #include "db_cxx.h"
 #include "SQLParser.h"
 #include "SQLExec.h"
+#include "parse_cache.h"
+#include "server.h"
+#include "vacuum.h"
+#include "checkpoint.h"
+#include "int_filter.h"
 using namespace std;
 using namespace hsql;
 
 DbEnv* _DB_ENV;
+const u_int32_t CACHE_SZ = 64 * 1024 * 1024;  // bytes in the Berkeley DB buffer pool
 
 // The Parser class itself
 class DBParser {
@@ -297,6 +309,36 @@ public:
         return statement;
     }
 
+    /**
+     *  Parse PREPARE statement
+     *  @param PrepareStatement *stmt
+     *	@return string
+     */
+    static string executePrepareStatement(const PrepareStatement *stmt) {
+        return string("PREPARE ") + stmt->name + " FROM '" + stmt->query + "'";
+    }
+
+    /**
+     *  Parse EXECUTE statement
+     *  @param ExecuteStatement *stmt
+     *	@return string
+     */
+    static string executeExecuteStatement(const ExecuteStatement *stmt) {
+        string statement = string("EXECUTE ") + stmt->name;
+        if (stmt->parameters != nullptr) {
+            statement += " (";
+            int comma = 0;
+            for (Expr *expr : *stmt->parameters) {
+                if (comma == 1)
+                    statement += ", ";
+                statement += printExpression(expr);
+                comma = 1;
+            }
+            statement += ")";
+        }
+        return statement;
+    }
+
     /**
      * (temp) Parse an SQL statement
      * @param	stmt, Hyrise AST for the statement
@@ -312,6 +354,10 @@ public:
             return executeDropStatement((const DropStatement *)stmt);
         case kStmtShow:
             return executeShowStatement((const ShowStatement *)stmt);
+        case kStmtPrepare:
+            return executePrepareStatement((const PrepareStatement *)stmt);
+        case kStmtExecute:
+            return executeExecuteStatement((const ExecuteStatement *)stmt);
         default:
             return "Not implemented";
         }
@@ -327,14 +373,73 @@ public:
         SQLParserResult *result = SQLParser::parseSQLString(SQLStatement);
         if (result->isValid()) {
             for (uint i = 0; i < result->size(); ++i) {
-                output += executeStatement(result->getStatement(0));
+                output += executeStatement(result->getStatement(i));
             }
         } else
-            return "Invalid SQL : " + SQLStatement;
+            output = "Invalid SQL : " + SQLStatement;
+        delete result;
         return output;
     }
 };
 
+/**
+ * Batch mode: run every statement of a script file without echoing them
+ * The whole file is read in one go and parsed once, then the statements are
+ * executed back to back. Stops at the first failing statement.
+ * With a data format, only the rows go to stdout and timing goes to stderr.
+ * @param	path, script file name
+ * @param	format, output format for query results
+ * @return	int, exit status
+ */
+int runScript(const char *path, QueryResult::Format format) {
+    ostream &report = format == QueryResult::TABLE ? cout : cerr;
+    ifstream in(path, ios::in | ios::binary);
+    if (!in) {
+        cerr << "(sql5300: cannot open script " << path << ")" << endl;
+        return 1;
+    }
+    // read to the end rather than seeking, so pipes and /dev/stdin work too
+    string script((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    SQLParserResult *parse = SQLParser::parseSQLString(script);
+    double parse_ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    if (!parse->isValid()) {
+        report << "invalid SQL in " << path << ": " << parse->errorMsg() << endl;
+        delete parse;
+        return 1;
+    }
+    int status = 0;
+    uint executed = 0;
+    for (uint i = 0; i < parse->size(); i++) {
+        Clock::time_point begin = Clock::now();
+        try {
+            QueryResult *result = SQLExec::execute(parse->getStatement(i));
+            if (format == QueryResult::TABLE) {
+                double ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+                cout << "[" << i + 1 << "] " << ms << " ms: " << *result << "\n";
+            } else {
+                result->write(cout, format);
+                double ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+                report << "[" << i + 1 << "] " << ms << " ms: " << result->get_message() << "\n";
+            }
+            delete result;
+            executed++;
+        } catch (exception& e) {
+            report << "[" << i + 1 << "] Error: " << e.what() << "\n";
+            status = 1;
+            break;
+        }
+    }
+    double total_ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    report << executed << " of " << parse->size() << " statements in " << total_ms
+         << " ms (parse " << parse_ms << " ms)" << endl;
+    delete parse;
+    return status;
+}
+
 /**
  * Main function, the entry point of the program
  * @param	argc
@@ -342,25 +447,122 @@ public:
  * @return	int
  */
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-      cerr << "Usage: cpsc5300: dbenvpath" << endl;
+    const char *scriptPath = nullptr;
+    const char *serverAddress = nullptr;
+    uint serverThreads = max(thread::hardware_concurrency(), 1U);  // 0 when it cannot tell
+    uint vacuumInterval = Vacuum::DEFAULT_INTERVAL;
+    uint commitDelay = 0;
+    uint checkpointInterval = Checkpointer::DEFAULT_INTERVAL;
+    uint checkpointLogMB = Checkpointer::DEFAULT_LOG_MB;
+    int opt;
+    QueryResult::Format format = QueryResult::TABLE;
+    while ((opt = getopt(argc, argv, "c:d:e:f:F:m:p:r:s:t:v:V:")) != -1) {
+        switch (opt) {
+        case 'c':
+            checkpointInterval = (uint)atoi(optarg);
+            break;
+        case 'd':
+            commitDelay = (uint)atoi(optarg);
+            break;
+        case 'm':
+            checkpointLogMB = (uint)atoi(optarg);
+            break;
+        case 'p':
+            HeapTable::scan_threads = (uint)max(1, atoi(optarg));
+            break;
+        case 'e':
+            PageFile::extent_blocks = (uint)max(1, atoi(optarg));
+            break;
+        case 'r':
+            PageFile::read_ahead = (uint)max(0, atoi(optarg));
+            break;
+        case 'f':
+            scriptPath = optarg;
+            break;
+        case 's':
+            serverAddress = optarg;
+            break;
+        case 't':
+            serverThreads = max((uint)atoi(optarg), 1U);
+            break;
+        case 'v':
+            vacuumInterval = (uint)atoi(optarg);
+            break;
+        case 'V':
+            HeapTable::fill_percent = (uint)min(100, max(0, atoi(optarg)));
+            break;
+        case 'F':
+            if (strcmp(optarg, "csv") == 0)
+                format = QueryResult::CSV;
+            else if (strcmp(optarg, "tsv") == 0)
+                format = QueryResult::TSV;
+            else if (strcmp(optarg, "binary") == 0)
+                format = QueryResult::BINARY;
+            else if (strcmp(optarg, "table") != 0)
+                argc = 0;
+            break;
+        default:
+            argc = 0;  // force the usage message
+        }
+    }
+    if (argc == 0 || optind != argc - 1) {
+      cerr << "Usage: cpsc5300: dbenvpath [-f script.sql] [-F table|csv|tsv|binary]"
+           << " [-s socketpath|port [-t threads]] [-v vacuum_seconds] [-V vacuum_fill_percent]"
+           << " [-d commit_delay_usec]"
+           << " [-c checkpoint_seconds] [-m checkpoint_log_mb] [-p scan_threads]"
+           << " [-r read_ahead_blocks] [-e extent_blocks]" << endl;
       return 1;
     }
-    char* envHome = argv[1];
+    char* envHome = argv[optind];
     cout << "(sql5300: running with database environment at " << envHome << ")" << endl;
     DBParser dbParser;
     // Initialize dbenv
     DbEnv *env = new DbEnv(0U);
     env->set_message_stream(&cout);
     env->set_error_stream(&cerr);
+    // heap file writes wait for the log only after pages adding up to half the pool (see HeapFile::pool_access)
+    env->set_cachesize(0, CACHE_SZ, 1);
     try {
-        env->open(envHome, DB_CREATE | DB_INIT_MPOOL, 0);
+        // DB_THREAD and Concurrent Data Store so server sessions can share the environment
+        env->open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_INIT_CDB | DB_THREAD, 0);
     } catch (DbException &exc) {
         cerr << "(sql5300: " << exc.what() << ")" << endl;
         exit(1);
     }
     _DB_ENV = env;
-    initialize_schema_tables();
+    try {
+        // recover from the log before anything reads the tables
+        TransactionManager::initialize();
+        WriteAheadLog::open(commitDelay);
+    } catch (DbException &exc) {
+        cerr << "(sql5300: " << exc.what() << ")" << endl;
+        exit(1);
+    }
+    try {
+        initialize_schema_tables();
+    } catch (DbRelationError &exc) {
+        cerr << "(sql5300: " << exc.what() << ")" << endl;
+        exit(1);
+    }
+    if (scriptPath != nullptr)
+        return runScript(scriptPath, format);
+    // reclaim deleted rows and bound recovery time in the background
+    Vacuum vacuum(vacuumInterval);
+    Checkpointer checkpointer(checkpointInterval, checkpointLogMB);
+    // repeated statements are parsed only once
+    ParseCache parse_cache;
+    if (serverAddress != nullptr) {
+        try {
+            SQLServer server(serverAddress, serverThreads, parse_cache);
+            cout << "(sql5300: serving " << serverThreads << " sessions at a time on "
+                 << serverAddress << ")" << endl;
+            server.run();
+        } catch (SQLServerError &e) {
+            cerr << "(sql5300: " << e.what() << ")" << endl;
+            return 1;
+        }
+        return 0;
+    }
     while(true) {
         // Receive SQLstatement by shell
         string query;
@@ -372,7 +574,31 @@ int main(int argc, char *argv[]) {
             cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
             continue;
         }
-        SQLParserResult* parse = SQLParser::parseSQLString(query);
+        if (query == "bench") {
+            cout << IntFilter::benchmark();
+            continue;
+        }
+        if (query == "vacuum") {
+            cout << SQLExec::vacuum_command() << endl;
+            continue;
+        }
+        if (query == "stats") {
+            cout << SQLExec::statistics();
+            cout << "parse cache: " << parse_cache.get_hits() << " hits, " << parse_cache.get_misses()
+                 << " misses" << endl;
+            cout << "vacuum: " << vacuum.get_passes() << " passes, " << vacuum.get_removed()
+                 << " row versions removed, " << vacuum.get_freed() << " blocks freed" << endl;
+            continue;
+        }
+        if (query.compare(0, 4, "set ") == 0) {
+            try {
+                cout << SQLExec::set_option(query) << endl;
+            } catch (SQLExecError& e) {
+                cout << "Error: " << e.what() << endl;
+            }
+            continue;
+        }
+        ParsedSQL parse = parse_cache.get(query);
         if (!parse->isValid()) {
             cout << "invalid SQL: " << query << endl;
             cout << parse->errorMsg() << endl;
@@ -380,16 +606,21 @@ int main(int argc, char *argv[]) {
             for (uint i = 0; i < parse->size(); i++) {
                 const SQLStatement *statement = parse->getStatement(i);
                 try {
-                    cout << dbParser.executeSQL(query) << endl;
+                    cout << dbParser.executeStatement(statement) << endl;
                     QueryResult *result = SQLExec::execute(statement);
-                    cout << *result << endl;
+                    if (format == QueryResult::TABLE) {
+                        cout << *result << endl;
+                    } else {
+                        result->write(cout, format);
+                        cout.flush();
+                        cerr << result->get_message() << endl;
+                    }
                     delete result;
-                } catch (SQLExecError& e) {
+                } catch (exception& e) {
                     cout << "Error: " << e.what() << endl;
                 }
             }
         }
-        delete parse;
     }
     return 0;
 }
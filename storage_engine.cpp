@@ -1,9 +1,18 @@
 #include "storage_engine.h"
 
+Value Value::null(ColumnAttribute::DataType data_type) {
+    Value value;
+    value.data_type = data_type;
+    value.is_null = true;
+    return value;
+}
+
 bool Value::operator==(const Value &other) const {
+    if (this->is_null || other.is_null)
+        return this->is_null && other.is_null;
     if (this->data_type != other.data_type)
         return false;
-    if (this->data_type == ColumnAttribute::INT)
+    if (this->data_type != ColumnAttribute::TEXT)
         return this->n == other.n;
     return this->s == other.s;
 }
@@ -12,6 +21,31 @@ bool Value::operator!=(const Value &other) const {
     return !(*this == other);
 }
 
+// Handle for a read that is only done once waited on
+class DeferredGet : public DbBlockIO {
+public:
+    DeferredGet(DbFile *file, BlockID block_id) : file(file), block_id(block_id) {}
+    virtual DbBlock* wait() {return this->file->get(this->block_id);}
+protected:
+    DbFile *file;
+    BlockID block_id;
+};
+
+// Handle for a write that is already done
+class DonePut : public DbBlockIO {
+public:
+    virtual DbBlock* wait() {return nullptr;}
+};
+
+DbBlockIO* DbFile::get_async(BlockID block_id) {
+    return new DeferredGet(this, block_id);
+}
+
+DbBlockIO* DbFile::put_async(DbBlock* block) {
+    put(block);
+    return new DonePut();
+}
+
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
 ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
     ColumnNames t;
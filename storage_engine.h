@@ -14,6 +14,7 @@
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
+#include "locks.h"
 
 /**
  * Global variable to hold dbenv.
@@ -55,7 +56,7 @@ public:
 class DbBlock {
 public:
     /**
-     * our blocks are 4kB
+     * our blocks are 4kB unless the table was created with another page size
      */
     static const uint BLOCK_SZ = 4096;
 
@@ -124,6 +125,20 @@ protected:
     BlockID block_id;
 };
 
+/**
+ * @class DbBlockIO - completion handle for an asynchronous DbFile::get_async or put_async
+ */
+class DbBlockIO {
+public:
+    virtual ~DbBlockIO() {}
+
+    /**
+     * Wait for the I/O to finish (at most once per handle).
+     * @returns  for get_async the block read (freed by caller), for put_async nullptr
+     */
+    virtual DbBlock* wait() = 0;
+};
+
 // convenience type alias
 typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an iterator at some point
 
@@ -183,6 +198,23 @@ public:
      */
     virtual void put(DbBlock* block) = 0;
 
+    /**
+     * Start reading a block, so that several reads can be in progress at once.
+     * By default the block is read with get() when the handle is waited on.
+     * @param block_id  which block to get
+     * @returns         handle to wait on for the block (freed by caller)
+     */
+    virtual DbBlockIO* get_async(BlockID block_id);
+
+    /**
+     * Start writing a block. The block may be changed or freed as soon as this
+     * returns, and a later get sees the new contents. By default the block is
+     * written with put() at once.
+     * @param block  block to write
+     * @returns      handle to wait on for the write (freed by caller)
+     */
+    virtual DbBlockIO* put_async(DbBlock* block);
+
     /**
      * Get a list of all the valid BlockID's in the file
      * FIXME - not a good long-term approach, but we'll do this until we put in iterators
@@ -219,16 +251,28 @@ protected:
 
 /**
  * @class Value - holds value for a field
+ * A BOOLEAN is kept in n (1 for true, 0 for false). A NULL has n 0 and s
+ * empty, whatever its type; it equals another NULL and nothing else (so a
+ * NULL in a where clause asks for IS NULL).
  */
 class Value {
 public:
     ColumnAttribute::DataType data_type;
     int32_t n;
     std::string s;
+    bool is_null;
 
-    Value() : n(0) {data_type = ColumnAttribute::INT;}
-    Value(int32_t n) : n(n) {data_type = ColumnAttribute::INT;}
-    Value(std::string s) : s(s) {data_type = ColumnAttribute::TEXT; }
+    Value() : n(0), is_null(false) {data_type = ColumnAttribute::INT;}
+    Value(int32_t n) : n(n), is_null(false) {data_type = ColumnAttribute::INT;}
+    Value(std::string s) : s(s), is_null(false) {data_type = ColumnAttribute::TEXT; }
+    Value(const char *s) : s(s), is_null(false) {data_type = ColumnAttribute::TEXT; }
+    Value(bool b) : n(b ? 1 : 0), is_null(false) {data_type = ColumnAttribute::BOOLEAN;}
+
+    /**
+     * NULL of a column type
+     * @param data_type  the column's type
+     */
+    static Value null(ColumnAttribute::DataType data_type);
 
     bool operator==(const Value &other) const;
     bool operator!=(const Value &other) const;
@@ -240,6 +284,7 @@ typedef std::vector<Identifier> ColumnNames;
 typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
 typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<std::pair<Handle, Handle>> HandleMoves;  // (old, new) handle of each row moved
 typedef std::map<Identifier, Value> ValueDict;
 typedef std::vector<ValueDict*> ValueDicts;
 
@@ -385,10 +430,45 @@ public:
    	virtual const ColumnAttributes get_column_attributes() const {
    	    return column_attributes;
    	}
+
+   	/**
+   	 * Physically remove row versions no running transaction can see any more.
+   	 * @returns  number of row versions removed
+   	 */
+   	virtual uint vacuum() {
+   	    return 0;
+   	}
+
+   	/**
+   	 * Move live rows out of the blocks at the end of the relation into room
+   	 * left in earlier ones, as new versions of them.
+   	 * @param moves  returned by reference: old and new handle of each row moved
+   	 * @returns      number of rows moved
+   	 */
+   	virtual uint compact(HandleMoves &moves) {
+   	    return 0;
+   	}
+
+   	/**
+   	 * Give back the empty blocks at the end of the relation.
+   	 * @returns  number of blocks freed
+   	 */
+   	virtual uint shrink() {
+   	    return 0;
+   	}
+
+   	/**
+   	 * Accessor for the relation-level lock (intention locks for row access).
+   	 * @returns table_lock  lock taken by every operation on this relation
+   	 */
+   	virtual TableLock& get_table_lock() {
+   	    return table_lock;
+   	}
 protected:
     Identifier table_name;
     ColumnNames column_names;
     ColumnAttributes column_attributes;
+    TableLock table_lock;
 };
 
 class DbIndex {
@@ -0,0 +1,277 @@
+/**
+ * @file thread_pool.cpp - implementation of ThreadPool and TaskGraph
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <iomanip>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include "thread_pool.h"
+using namespace std;
+
+/************************************************
+ *  Implementation of ThreadPool class
+ ***********************************************/
+
+thread_local ThreadPool *ThreadPool::current_pool = nullptr;
+thread_local int ThreadPool::current_worker = -1;
+
+/**
+ * Start the workers, pinned round-robin over the CPUs we may run on
+ * @param   uint n_workers  worker count, 0 for one per core
+ * @param   bool pin        pin each worker to one CPU
+ */
+ThreadPool::ThreadPool(uint n_workers, bool pin) : queued(0), next_victim(0), stopping(false),
+                                                   started(chrono::steady_clock::now()) {
+    if (n_workers == 0)
+        n_workers = thread::hardware_concurrency();
+    if (n_workers == 0)
+        n_workers = 1;
+    vector<int> cpus;
+    cpu_set_t allowed;
+    if (pin && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+    // every deque must exist before any worker looks for something to steal
+    for (uint i = 0; i < n_workers; i++)
+        this->workers.push_back(unique_ptr<Worker>(new Worker()));
+    for (uint i = 0; i < n_workers; i++) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        this->workers[i]->thread = thread(&ThreadPool::work, this, i, cpu);
+    }
+}
+
+// Let the workers drain their deques, then join them
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(this->idle_mutex);
+        this->stopping = true;
+    }
+    this->idle.notify_all();
+    for (auto &worker: this->workers)
+        worker->thread.join();
+}
+
+/**
+ * @return  ThreadPool&  the pool every query shares
+ */
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+/**
+ * Push onto the calling worker's own deque, or deal to the next worker
+ * @param   Task task  work to queue
+ */
+void ThreadPool::submit(Task task) {
+    uint target;
+    if (current_pool == this && current_worker >= 0)
+        target = (uint)current_worker;
+    else
+        target = (uint)(this->next_victim++ % this->workers.size());
+    {
+        lock_guard<mutex> guard(this->workers[target]->tasks_mutex);
+        this->workers[target]->tasks.push_back(task);
+    }
+    this->queued++;
+    {
+        lock_guard<mutex> guard(this->idle_mutex);
+    }
+    this->idle.notify_one();
+}
+
+/**
+ * Execute tasks on this thread until the condition holds
+ * @param   function<bool()> done  condition to wait for
+ */
+void ThreadPool::help_until(function<bool()> done) {
+    int self = current_pool == this ? current_worker : -1;
+    while (!done()) {
+        if (run_one(self))
+            continue;
+        unique_lock<mutex> lock(this->idle_mutex);
+        this->idle.wait(lock, [this, &done]() {return this->queued > 0 || done();});
+    }
+}
+
+/**
+ * Wake everyone waiting for tasks so they re-check what they wait for
+ */
+void ThreadPool::notify() {
+    {
+        lock_guard<mutex> guard(this->idle_mutex);
+    }
+    this->idle.notify_all();
+}
+
+// Queue depth, steals and utilization
+string ThreadPool::report() const {
+    size_t executed = 0, steals = 0;
+    double elapsed_ns = (double)chrono::duration_cast<chrono::nanoseconds>(
+                                    chrono::steady_clock::now() - this->started).count();
+    ostringstream utilization;
+    utilization << fixed << setprecision(1);
+    for (uint i = 0; i < this->workers.size(); i++) {
+        executed += this->workers[i]->executed;
+        steals += this->workers[i]->steals;
+        utilization << (i == 0 ? " " : ", ") << i << ": "
+                    << (elapsed_ns > 0 ? 100.0 * this->workers[i]->busy_ns / elapsed_ns : 0.0) << "%";
+    }
+    ostringstream out;
+    out << "thread pool: " << this->workers.size() << " workers, queue depth " << this->queued
+        << ", " << executed << " tasks run, " << steals << " steals" << endl;
+    out << "thread pool utilization:" << utilization.str() << endl;
+    return out.str();
+}
+
+// Worker thread: run tasks, sleeping while there are none
+void ThreadPool::work(uint index, int cpu) {
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    current_pool = this;
+    current_worker = (int)index;
+    while (true) {
+        if (run_one((int)index))
+            continue;
+        unique_lock<mutex> lock(this->idle_mutex);
+        this->idle.wait(lock, [this]() {return this->stopping || this->queued > 0;});
+        if (this->stopping && this->queued == 0)
+            return;
+    }
+}
+
+// Run one task from our own deque, or else stolen from another (self < 0: not a worker)
+bool ThreadPool::run_one(int self) {
+    Task task;
+    bool found = self >= 0 && take((uint)self, true, task);
+    uint n = (uint)this->workers.size();
+    uint first = self >= 0 ? (uint)self + 1 : (uint)(this->next_victim % n);
+    for (uint i = 0; !found && i < n; i++) {
+        uint victim = (first + i) % n;
+        if ((int)victim != self && take(victim, false, task)) {
+            found = true;
+            if (self >= 0)
+                this->workers[self]->steals++;
+        }
+    }
+    if (!found)
+        return false;
+    this->queued--;
+    auto start = chrono::steady_clock::now();
+    task();
+    if (self >= 0) {
+        this->workers[self]->busy_ns += chrono::duration_cast<chrono::nanoseconds>(
+                                            chrono::steady_clock::now() - start).count();
+        this->workers[self]->executed++;
+    }
+    return true;
+}
+
+// Pop a task from the back (owner) or the front (thief) of a worker's deque
+bool ThreadPool::take(uint index, bool from_back, Task &task) {
+    Worker &worker = *this->workers[index];
+    lock_guard<mutex> guard(worker.tasks_mutex);
+    if (worker.tasks.empty())
+        return false;
+    if (from_back) {
+        task = worker.tasks.back();
+        worker.tasks.pop_back();
+    } else {
+        task = worker.tasks.front();
+        worker.tasks.pop_front();
+    }
+    return true;
+}
+
+/************************************************
+ *  Implementation of TaskGraph class
+ ***********************************************/
+
+/**
+ * @param   Task task  work to do
+ * @return  Node       handle for depend()
+ */
+TaskGraph::Node TaskGraph::add(Task task) {
+    this->nodes.push_back(unique_ptr<TaskNode>(new TaskNode(task)));
+    return this->nodes.size() - 1;
+}
+
+/**
+ * @param   Node before  must finish first
+ * @param   Node after   starts once before (and its other predecessors) finish
+ */
+void TaskGraph::depend(Node before, Node after) {
+    this->nodes.at(before)->successors.push_back(after);
+    this->nodes.at(after)->waiting_for++;
+}
+
+/**
+ * Start the tasks that depend on nothing and help until every task is done
+ */
+void TaskGraph::run() {
+    vector<Node> roots;
+    for (Node node = 0; node < this->nodes.size(); node++)
+        if (this->nodes[node]->waiting_for == 0)
+            roots.push_back(node);
+    if (!acyclic(roots))
+        throw logic_error("task graph has a cycle");
+    this->remaining = this->nodes.size();
+    for (Node node: roots)
+        start(node);
+    this->pool.help_until([this]() {return this->remaining == 0;});
+    if (this->error)
+        rethrow_exception(this->error);
+}
+
+// Whether every task can be reached in dependency order from the roots (Kahn's algorithm)
+bool TaskGraph::acyclic(const vector<Node> &roots) const {
+    vector<uint> waiting_for;
+    for (auto const &node: this->nodes)
+        waiting_for.push_back(node->waiting_for);
+    vector<Node> ready(roots);
+    size_t visited = 0;
+    while (!ready.empty()) {
+        Node node = ready.back();
+        ready.pop_back();
+        visited++;
+        for (Node successor: this->nodes[node]->successors)
+            if (--waiting_for[successor] == 0)
+                ready.push_back(successor);
+    }
+    return visited == this->nodes.size();
+}
+
+// Submit a task whose predecessors have all finished
+void TaskGraph::start(Node node) {
+    this->pool.submit([this, node]() {
+        bool skip;
+        {
+            lock_guard<mutex> guard(this->error_mutex);
+            skip = this->error != nullptr;
+        }
+        if (!skip) {
+            try {
+                this->nodes[node]->task();
+            } catch (...) {
+                lock_guard<mutex> guard(this->error_mutex);
+                if (!this->error)
+                    this->error = current_exception();
+            }
+        }
+        for (Node successor: this->nodes[node]->successors)
+            if (--this->nodes[successor]->waiting_for == 0)
+                start(successor);
+        // run() may return, destroying the graph, as soon as remaining is 0
+        ThreadPool &pool = this->pool;
+        if (--this->remaining == 0)
+            pool.notify();
+    });
+}
@@ -0,0 +1,167 @@
+/**
+ * @file thread_pool.h - work-stealing thread pool and task graphs for intra-query parallelism
+ * ThreadPool
+ * TaskGraph
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A unit of work
+ */
+typedef std::function<void()> Task;
+
+/**
+ * @class ThreadPool - fixed set of workers, each with its own deque of tasks
+ *
+ * A worker pushes the tasks it submits onto the back of its own deque and
+ * takes work from the back too (most recently submitted first, while its data
+ * is still in cache). An idle worker steals from the front of another
+ * worker's deque. Tasks submitted from outside the pool are dealt round-robin.
+ * Workers can be pinned one per CPU, in the order the process may run on
+ * them (no attention is paid to NUMA nodes).
+ *
+ * Operators (scans today; joins, aggregation, sorts and index builds as they
+ * arrive) submit work through a TaskGraph rather than directly.
+ */
+class ThreadPool {
+public:
+    /**
+     * @param n_workers  number of worker threads (0 for one per core)
+     * @param pin        pin worker i to the i-th CPU available to the process
+     */
+    ThreadPool(uint n_workers=0, bool pin=true);
+    virtual ~ThreadPool();
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool(ThreadPool&& temp) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+    ThreadPool& operator=(ThreadPool&& temp) = delete;
+
+    /**
+     * The pool shared by every query, created on first use.
+     * @returns  the shared pool
+     */
+    static ThreadPool &shared();
+
+    /**
+     * Queue a task. Tasks must not throw (TaskGraph catches for them).
+     * @param task  work to run on some worker
+     */
+    virtual void submit(Task task);
+
+    /**
+     * Run queued tasks on the calling thread until done() is true, so that a
+     * thread waiting on the pool (a worker included) helps instead of blocking.
+     * @param done  checked after each task and on every wake-up
+     */
+    virtual void help_until(std::function<bool()> done);
+
+    /**
+     * Wake threads in help_until to re-check their condition.
+     */
+    virtual void notify();
+
+    virtual uint size() const {return (uint)workers.size();}
+
+    /**
+     * Queue depth, steals and per-worker utilization since the pool started.
+     * @returns  human-readable report, one counter per line
+     */
+    virtual std::string report() const;
+
+protected:
+    struct Worker {
+        std::deque<Task> tasks;
+        std::mutex tasks_mutex;
+        std::thread thread;
+        std::atomic<size_t> executed;
+        std::atomic<size_t> steals;
+        std::atomic<long long> busy_ns;
+        Worker() : executed(0), steals(0), busy_ns(0) {}
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> queued;      // tasks in all deques
+    std::atomic<size_t> next_victim;  // round-robin target for outside submissions
+    bool stopping;
+    std::mutex idle_mutex;
+    std::condition_variable idle;    // workers and helpers wait here for tasks
+    std::chrono::steady_clock::time_point started;
+    static thread_local ThreadPool *current_pool;
+    static thread_local int current_worker;  // index in current_pool, -1 if not a worker
+
+    virtual void work(uint index, int cpu);
+    virtual bool run_one(int self);
+    virtual bool take(uint index, bool from_back, Task &task);
+};
+
+/**
+ * @class TaskGraph - tasks with dependencies, run on a ThreadPool
+ *
+ * Add tasks, declare which must finish before which, then run(): each task is
+ * submitted as soon as everything it depends on has finished, and run()
+ * returns once all have, with the calling thread executing tasks meanwhile.
+ * The first exception thrown by a task is rethrown by run() after the
+ * remaining tasks have been skipped.
+ */
+class TaskGraph {
+public:
+    typedef size_t Node;
+
+    TaskGraph(ThreadPool &pool=ThreadPool::shared()) : pool(pool), remaining(0) {}
+    virtual ~TaskGraph() {}
+    TaskGraph(const TaskGraph& other) = delete;
+    TaskGraph(TaskGraph&& temp) = delete;
+    TaskGraph& operator=(const TaskGraph& other) = delete;
+    TaskGraph& operator=(TaskGraph&& temp) = delete;
+
+    /**
+     * Add a task to the graph.
+     * @param task  work to do
+     * @returns     its node, for depend()
+     */
+    virtual Node add(Task task);
+
+    /**
+     * Declare that one task may only start once another has finished.
+     * @param before  task to finish first
+     * @param after   task to start afterwards
+     */
+    virtual void depend(Node before, Node after);
+
+    /**
+     * Run every task and wait for all of them.
+     * @throws  std::logic_error if the dependencies form a cycle (nothing is run)
+     * @throws  the first exception thrown by a task
+     */
+    virtual void run();
+
+protected:
+    struct TaskNode {
+        Task task;
+        std::vector<Node> successors;
+        std::atomic<uint> waiting_for;  // unfinished predecessors
+        TaskNode(Task task) : task(task), waiting_for(0) {}
+    };
+    ThreadPool &pool;
+    std::vector<std::unique_ptr<TaskNode>> nodes;
+    std::atomic<size_t> remaining;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    virtual bool acyclic(const std::vector<Node> &roots) const;
+    virtual void start(Node node);
+};
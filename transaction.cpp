@@ -0,0 +1,270 @@
+/**
+ * @file transaction.cpp - implementation of TransactionManager and Transaction
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+#include "db_cxx.h"
+#include "transaction.h"
+#include "wal.h"
+using namespace std;
+
+extern DbEnv* _DB_ENV;
+
+/************************************************
+ *  Implementation of TransactionManager class
+ ***********************************************/
+
+mutex TransactionManager::mutex;
+TxnID TransactionManager::next = 1;
+TxnID TransactionManager::reserved = 1;
+map<TxnID, TxnID> TransactionManager::running;
+shared_ptr<const set<TxnID>> TransactionManager::aborted = make_shared<const set<TxnID>>();
+multiset<TxnID> TransactionManager::retained;
+string TransactionManager::state_path;
+
+/**
+ * Read the high water mark and aborted ids from <env home>/_txn.state
+ * State file layout: u32 high water mark, then one u32 per aborted transaction
+ */
+void TransactionManager::initialize() {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    const char *home;
+    _DB_ENV->get_home(&home);
+    state_path = string(home) + "/_txn.state";
+    next = reserved = 1;
+    set<TxnID> loaded;
+    int fd = ::open(state_path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        TxnID value;
+        if (read(fd, &value, sizeof(value)) == sizeof(value))
+            next = reserved = value;
+        while (read(fd, &value, sizeof(value)) == sizeof(value))
+            loaded.insert(value);
+        ::close(fd);
+    }
+    aborted = make_shared<const set<TxnID>>(move(loaded));
+}
+
+/**
+ * Hand out the next id and snapshot the running transactions
+ * @param   Snapshot &snapshot  returned by reference
+ * @return  TxnID               new transaction id
+ */
+TxnID TransactionManager::begin(Snapshot &snapshot) {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    TxnID txn = next++;
+    if (next >= reserved) {
+        reserved = next + RESERVE;
+        write_state();
+    }
+    snapshot.self = txn;
+    snapshot.xmax = txn;
+    snapshot.active.clear();
+    TxnID oldest = txn;
+    for (auto const &entry: running) {
+        snapshot.active.insert(entry.first);
+        if (entry.first < oldest)
+            oldest = entry.first;
+    }
+    snapshot.aborted = aborted;  // shared, not copied
+    running[txn] = oldest;
+    return txn;
+}
+
+/**
+ * Mark a transaction committed (it simply stops being active)
+ * @param   TxnID txn  transaction id
+ */
+void TransactionManager::commit(TxnID txn) {
+    // durable before anyone else can see it
+    WriteAheadLog::commit(txn);
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    running.erase(txn);
+}
+
+/**
+ * Mark a transaction aborted and record that durably
+ * @param   TxnID txn  transaction id
+ */
+void TransactionManager::abort(TxnID txn) {
+    WriteAheadLog::abort(txn);
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    running.erase(txn);
+    // snapshots already taken keep the set they were given
+    shared_ptr<set<TxnID>> changed = make_shared<set<TxnID>>(*aborted);
+    changed->insert(txn);
+    aborted = changed;
+    append_state(txn);
+}
+
+/**
+ * Mark several transactions aborted with one write of the state file
+ * @param   set<TxnID> txns  transactions to mark
+ */
+void TransactionManager::abort_all(const set<TxnID> &txns) {
+    if (txns.empty())
+        return;
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    shared_ptr<set<TxnID>> changed = make_shared<set<TxnID>>(*aborted);
+    changed->insert(txns.begin(), txns.end());
+    aborted = changed;
+    write_state();
+}
+
+/**
+ * Drop the aborted ids before the horizon and rewrite the state file without them
+ * @param   TxnID horizon  horizon taken before the vacuum pass that removed their traces
+ */
+void TransactionManager::forget_aborted(TxnID horizon) {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    auto first_kept = aborted->lower_bound(horizon);
+    if (first_kept == aborted->begin())
+        return;
+    aborted = make_shared<const set<TxnID>>(first_kept, aborted->end());
+    write_state();
+}
+
+/**
+ * Oldest id still considered active by some running transaction's snapshot
+ * @return  TxnID  vacuum horizon
+ */
+TxnID TransactionManager::horizon() {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    TxnID oldest = next;
+    for (auto const &entry: running)
+        if (entry.second < oldest)
+            oldest = entry.second;
+    if (!retained.empty() && *retained.begin() < oldest)
+        oldest = *retained.begin();
+    return oldest;
+}
+
+/**
+ * Hold the horizon at the oldest id the transaction's snapshot saw as active
+ * @param   TxnID txn  running transaction, or 0
+ * @return  TxnID      horizon held
+ */
+TxnID TransactionManager::retain(TxnID txn) {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    auto entry = running.find(txn);
+    TxnID held = next;
+    if (entry != running.end()) {
+        held = entry->second;
+    } else {
+        for (auto const &other: running)
+            if (other.second < held)
+                held = other.second;
+    }
+    retained.insert(held);
+    return held;
+}
+
+/**
+ * @param   TxnID held  horizon returned by retain
+ */
+void TransactionManager::release(TxnID held) {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    auto entry = retained.find(held);
+    if (entry != retained.end())
+        retained.erase(entry);
+}
+
+/**
+ * @param   TxnID txn  transaction id
+ * @return  bool       true if txn was rolled back
+ */
+bool TransactionManager::is_aborted(TxnID txn) {
+    lock_guard<std::mutex> guard(TransactionManager::mutex);
+    return aborted->count(txn) > 0;
+}
+
+// Rewrite the state file (caller holds the mutex)
+void TransactionManager::write_state() {
+    vector<TxnID> values;
+    values.push_back(reserved);
+    values.insert(values.end(), aborted->begin(), aborted->end());
+    string temp_path = state_path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw DbException("cannot write transaction state", errno);
+    ssize_t size = (ssize_t)(values.size() * sizeof(TxnID));
+    bool ok = write(fd, values.data(), size) == size && fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || rename(temp_path.c_str(), state_path.c_str()) != 0)
+        throw DbException("cannot write transaction state", errno);
+}
+
+// Add one aborted id to the end of the state file (caller holds the mutex)
+void TransactionManager::append_state(TxnID txn) {
+    int fd = ::open(state_path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        write_state();  // not written yet
+        return;
+    }
+    bool ok = write(fd, &txn, sizeof(txn)) == (ssize_t)sizeof(txn) && fdatasync(fd) == 0;
+    int error = errno;
+    ::close(fd);
+    if (!ok)
+        throw DbException("cannot write transaction state", error);
+}
+
+/************************************************
+ *  Implementation of Transaction class
+ ***********************************************/
+
+thread_local Transaction::State *Transaction::current = nullptr;
+
+/**
+ * Join the thread's transaction, or begin one
+ */
+Transaction::Transaction() : state(current), owner(current == nullptr) {
+    if (this->owner) {
+        this->state = new State();
+        this->state->id = TransactionManager::begin(this->state->snapshot);
+        current = this->state;
+    }
+}
+
+/**
+ * Commit a transaction we began, or abort it if the commit fails
+ */
+void Transaction::commit() {
+    if (!this->owner)
+        return;
+    this->owner = false;
+    current = nullptr;
+    unique_ptr<State> state(this->state);
+    try {
+        TransactionManager::commit(state->id);
+    } catch (...) {
+        TransactionManager::abort(state->id);
+        throw;
+    }
+}
+
+/**
+ * Commit (or abort, if unwinding from an exception) a transaction we began
+ * and have not committed yet; an error is reported, since it cannot be thrown
+ */
+Transaction::~Transaction() {
+    if (!this->owner)
+        return;
+    TxnID id = this->state->id;
+    try {
+        if (std::uncaught_exception()) {
+            this->owner = false;
+            current = nullptr;
+            unique_ptr<State> state(this->state);
+            TransactionManager::abort(id);
+        } else {
+            commit();
+        }
+    } catch (exception &e) {
+        cerr << "(sql5300: transaction " << id << ": " << e.what() << ")" << endl;
+    }
+}
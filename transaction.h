@@ -0,0 +1,198 @@
+/**
+ * @file transaction.h - transaction ids and snapshots for multi-version concurrency control
+ * Snapshot
+ * TransactionManager
+ * Transaction
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * Transaction id (0 means "none", e.g. a row version that was never deleted)
+ */
+typedef u_int32_t TxnID;
+
+/**
+ * @class Snapshot - which transactions' effects a reader can see
+ *
+ * A transaction's effects are visible if it committed before the snapshot
+ * was taken, or if it is the reader's own transaction. The set of aborted
+ * transactions is shared with TransactionManager rather than copied (one
+ * that aborts later was active when the snapshot was taken anyway).
+ */
+class Snapshot {
+public:
+    TxnID self;                // reader's own transaction
+    TxnID xmax;                // first id not yet handed out when taken
+    std::set<TxnID> active;    // in progress when taken
+    std::shared_ptr<const std::set<TxnID>> aborted;  // rolled back when taken
+
+    Snapshot() : self(0), xmax(0), aborted(std::make_shared<const std::set<TxnID>>()) {}
+
+    /**
+     * Are the effects of the given transaction visible to this snapshot?
+     * @param txn  transaction id
+     * @returns    true if committed as of the snapshot, or our own
+     */
+    bool sees(TxnID txn) const {
+        return txn == self || (txn < xmax && active.count(txn) == 0 && aborted->count(txn) == 0);
+    }
+
+    /**
+     * Is a row version created by xmin and deleted by xmax (0 if not) visible?
+     * @param xmin  creating transaction
+     * @param xmax  deleting transaction or 0
+     * @returns     true if the version belongs in this snapshot
+     */
+    bool visible(TxnID xmin, TxnID xmax) const {
+        return sees(xmin) && (xmax == 0 || !sees(xmax));
+    }
+};
+
+/**
+ * @class TransactionManager - hands out transaction ids and tracks their outcome
+ *
+ * Ids increase across restarts: they are reserved in batches, and the high
+ * water mark is kept in a small state file in the environment directory,
+ * together with the ids of aborted transactions (whose row versions must
+ * stay invisible until vacuum removes them). An abort appends its id to
+ * the file; the file is rewritten only when more ids are reserved or when
+ * vacuum has removed every trace of some aborted transactions, which are
+ * then forgotten, so neither the file nor the set grows without bound.
+ */
+class TransactionManager {
+public:
+    /**
+     * Load the state file. Must be called before any transaction begins.
+     */
+    static void initialize();
+
+    /**
+     * Start a transaction and take its snapshot.
+     * @param snapshot  returned by reference: the new transaction's snapshot
+     * @returns         the new transaction's id
+     */
+    static TxnID begin(Snapshot &snapshot);
+
+    /**
+     * Finish a transaction; its effects become visible to later snapshots.
+     * Waits until the commit is durable if the transaction changed anything.
+     * @param txn  transaction to commit
+     */
+    static void commit(TxnID txn);
+
+    /**
+     * Roll back a transaction; its effects are never visible.
+     * @param txn  transaction to abort
+     */
+    static void abort(TxnID txn);
+
+    /**
+     * Record transactions found unfinished by crash recovery as aborted.
+     * @param txns  transactions to mark
+     */
+    static void abort_all(const std::set<TxnID> &txns);
+
+    /**
+     * Oldest transaction any running transaction's snapshot might still
+     * consider in progress; versions deleted by committed transactions
+     * before this are invisible to everyone.
+     * @returns  the vacuum horizon
+     */
+    static TxnID horizon();
+
+    /**
+     * Was the given transaction rolled back?
+     * @param txn  transaction id
+     * @returns    true if aborted
+     */
+    static bool is_aborted(TxnID txn);
+
+    /**
+     * Forget the aborted transactions before a horizon, once vacuum has gone
+     * over every table since the horizon was taken (removing the row versions
+     * they created and clearing their marks on the ones they deleted).
+     * @param horizon  what horizon() returned before vacuum started
+     */
+    static void forget_aborted(TxnID horizon);
+
+    /**
+     * Hold the vacuum horizon where a running transaction holds it, even
+     * after the transaction ends, so the row versions its snapshot sees are
+     * kept (e.g. for rows read through a cursor after the statement).
+     * @param txn  running transaction (or 0 to hold the horizon as it is now)
+     * @returns    the horizon held, to be given to release()
+     */
+    static TxnID retain(TxnID txn);
+
+    /**
+     * Stop holding a horizon retain() returned.
+     * @param held  what retain() returned
+     */
+    static void release(TxnID held);
+
+protected:
+    static const TxnID RESERVE = 1024;  // ids reserved per write of the state file
+    static std::mutex mutex;
+    static TxnID next;                  // next id to hand out
+    static TxnID reserved;              // ids below this are recorded as used
+    static std::map<TxnID, TxnID> running;  // active transaction -> oldest id its snapshot saw as active
+    static std::shared_ptr<const std::set<TxnID>> aborted;  // replaced, never changed, once shared
+    static std::multiset<TxnID> retained;  // horizons held by retain()
+    static std::string state_path;
+
+    static void write_state();
+    static void append_state(TxnID txn);
+};
+
+/**
+ * @class Transaction - the calling thread's current transaction, as a scope
+ *
+ * If the thread is already in a transaction, this joins it; otherwise it
+ * begins one that commits when the scope ends normally and aborts if the
+ * scope is left by an exception. So each SQL statement is a transaction,
+ * and storage calls made outside of one run as their own. A caller that
+ * needs to hear about a commit that fails calls commit itself: the
+ * destructor cannot throw, so it only reports such a failure on stderr.
+ */
+class Transaction {
+public:
+    Transaction();
+    ~Transaction();
+    Transaction(const Transaction& other) = delete;
+    Transaction& operator=(const Transaction& other) = delete;
+
+    /**
+     * Commit now, if we began the transaction (joining one leaves it to its owner).
+     * The transaction is aborted if the commit fails.
+     * @throws DbException  the commit or abort could not be logged
+     */
+    void commit();
+
+    /**
+     * The calling thread's transaction.
+     * @returns  its id, or 0 if the thread is not in a transaction
+     */
+    static TxnID current_id() {return current == nullptr ? 0 : current->id;}
+
+    TxnID get_id() const {return state->id;}
+    const Snapshot &get_snapshot() const {return state->snapshot;}
+
+protected:
+    struct State {
+        TxnID id;
+        Snapshot snapshot;
+    };
+    static thread_local State *current;
+    State *state;
+    bool owner;  // began the transaction (rather than joined it) and has not finished it yet
+};
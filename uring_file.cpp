@@ -0,0 +1,513 @@
+/**
+ * @file uring_file.cpp - implementation of UringFile
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "uring_file.h"
+using namespace std;
+
+// Handle for a request on a UringFile's ring
+class UringFile::IO : public DbBlockIO {
+public:
+    IO(UringFile *file, Request *request) : file(file), request(request), waited(false) {}
+
+    virtual ~IO() {
+        if (!this->waited)
+            this->file->abandon(this->request);
+    }
+
+    virtual DbBlock* wait() {
+        unique_lock<mutex> lock(this->file->ring_mutex);
+        Request *request = this->request;
+        this->file->wait_until([request]() {return request->done;}, lock);
+        this->waited = true;
+        return this->file->collect(request);
+    }
+
+protected:
+    UringFile *file;
+    Request *request;
+    bool waited;
+};
+
+/**
+ * @param   string name       relation name
+ * @param   uint block_size   bytes in each block
+ */
+UringFile::UringFile(std::string name, uint block_size) :
+                     PageFile(name, block_size), fd(-1), ring_fd(-1), ring(nullptr), ring_sz(0),
+                     sqes(nullptr), sqes_sz(0), fixed_buffers(false),
+                     write_buffers(nullptr), pending(0), write_error(0), reaping(false), forced(0) {
+    this->filename = this->name + ".blocks";
+}
+
+UringFile::~UringFile() {
+    try {
+        close();
+    } catch (DbException &e) {
+        // nothing to be done about it now; the log still has the changes
+    }
+}
+
+/**
+ * Create the file with its first block
+ */
+void UringFile::create(void) {
+    file_open(O_RDWR | O_CREAT | O_EXCL);
+    SlottedPage *block = get_new();
+    delete block;
+}
+
+/**
+ * Close and remove the file
+ */
+void UringFile::drop(void) {
+    close();
+    WriteAheadLog::log_drop(this->filename);
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    unlink((string(env_home) + "/" + this->filename).c_str());
+}
+
+/**
+ * Open the existing file
+ */
+void UringFile::open(void) {
+    file_open(O_RDWR);
+}
+
+/**
+ * Finish every write and tear down the ring
+ */
+void UringFile::close(void) {
+    lock_guard<mutex> guard(this->open_mutex);
+    if (this->closed)
+        return;
+    {
+        lock_guard<mutex> files_guard(PageFile::open_files_mutex);
+        PageFile::open_files.erase(this);
+    }
+    sync();
+    ring_close();
+    // give back the free blocks of the last extent
+    int error = ftruncate(this->fd, (off_t)this->last * this->block_size) == 0 ? 0 : errno;
+    ::close(this->fd);
+    this->fd = -1;
+    this->closed = true;
+    if (error != 0)
+        throw DbException(("cannot cut back " + this->filename).c_str(), error);
+}
+
+/**
+ * Hand out the next free block, extending the file if there is none (written in the background)
+ * @return  SlottedPage*  the new block
+ */
+SlottedPage *UringFile::get_new(void) {
+    lock_guard<mutex> guard(this->alloc_mutex);
+    BlockID block_id = next_block();
+    void *buffer;
+    if (posix_memalign(&buffer, this->block_size, this->block_size) != 0)
+        throw bad_alloc();
+    memset(buffer, 0, this->block_size);
+    Dbt data(buffer, this->block_size);
+    data.set_flags(DB_DBT_MALLOC);  // the page frees it
+    SlottedPage *page = new SlottedPage(data, block_id, true);
+    put(page);
+    // only publish the new block once reads of it are served
+    this->last = block_id;
+    return page;
+}
+
+/**
+ * Read a block and wait for it
+ * @param   BlockID block_id  target block id
+ * @return  SlottedPage*      the block
+ */
+SlottedPage *UringFile::get(BlockID block_id) {
+    DbBlockIO *read = get_async(block_id);
+    DbBlock *block;
+    try {
+        block = read->wait();
+    } catch (...) {
+        delete read;
+        throw;
+    }
+    delete read;
+    return (SlottedPage *)block;
+}
+
+/**
+ * Queue a block to be written, without waiting for it
+ * @param   DbBlock *block  block to write
+ */
+void UringFile::put(DbBlock *block) {
+    delete put_async(block);
+}
+
+/**
+ * Queue a read of a block, served from the write buffer if a write of it
+ * is still in progress
+ * @param   BlockID block_id  block to read
+ * @return  DbBlockIO*        handle whose wait() returns the block
+ */
+DbBlockIO *UringFile::get_async(BlockID block_id) {
+    if (block_id == 0 || block_id > this->last)
+        throw DbBlockError("no block " + to_string(block_id) + " in " + this->filename);
+    void *buffer;
+    if (posix_memalign(&buffer, this->block_size, this->block_size) != 0)
+        throw bad_alloc();
+    Request *request = new Request{block_id, false, (char *)buffer, -1, false, false, 0, false, 0};
+    unique_lock<mutex> lock(this->ring_mutex);
+    auto write = this->writes.find(block_id);
+    if (write != this->writes.end()) {
+        memcpy(buffer, write->second->buffer, this->block_size);
+        request->submitted = request->done = true;
+        request->result = this->block_size;
+    } else {
+        this->reads.insert(block_id);
+        enqueue(request, lock);
+    }
+    return new IO(this, request);
+}
+
+/**
+ * Log a block and queue it to be written from a write buffer
+ * @param   DbBlock *block  block to write (may be reused once this returns)
+ * @return  DbBlockIO*      handle whose wait() returns once it is written
+ */
+DbBlockIO *UringFile::put_async(DbBlock *block) {
+    BlockID block_id = block->get_block_id();
+    LSN lsn = log_block(this->filename, block);
+    unique_lock<mutex> lock(this->ring_mutex);
+    auto write = this->writes.find(block_id);
+    if (write != this->writes.end() && write->second->abandoned && !write->second->submitted) {
+        // nobody is waiting on the queued write yet: just change what it writes
+        Request *request = write->second;
+        memcpy(request->buffer, block->get_data(), this->block_size);
+        request->abandoned = false;
+        request->lsn = max(request->lsn, lsn);
+        return new IO(this, request);
+    }
+    // keep writes of a block in order, and never write under a read of it
+    wait_until([this, block_id]() {
+        return this->writes.count(block_id) == 0 && this->reads.count(block_id) == 0 && !this->free_slots.empty();
+    }, lock);
+    int slot = this->free_slots.back();
+    this->free_slots.pop_back();
+    Request *request = new Request{block_id, true, this->write_buffers + (size_t)slot * this->block_size,
+                                   slot, false, false, 0, false, lsn};
+    memcpy(request->buffer, block->get_data(), this->block_size);
+    this->writes[block_id] = request;
+    enqueue(request, lock);
+    if (this->unsubmitted.size() >= SUBMIT_BATCH)
+        submit(lock);
+    return new IO(this, request);
+}
+
+/**
+ * Wait for every queued write, then for the disk
+ */
+void UringFile::sync() {
+    unique_lock<mutex> lock(this->ring_mutex);
+    wait_until([this]() {return this->pending == 0;}, lock);
+    int error = this->write_error;
+    this->write_error = 0;
+    lock.unlock();
+    if (error != 0)
+        throw DbException(("cannot write " + this->filename).c_str(), error);
+    if (fdatasync(this->fd) != 0)
+        throw DbException(("cannot sync " + this->filename).c_str(), errno);
+}
+
+/**
+ * Wait for the writes in progress and cut the file back
+ * @param   BlockID n_blocks  blocks to keep
+ */
+void UringFile::shrink(BlockID n_blocks) {
+    lock_guard<mutex> guard(this->alloc_mutex);
+    if (n_blocks >= this->last)
+        return;
+    WriteAheadLog::log_shrink(this->filename, n_blocks, this->block_size);
+    sync();
+    if (ftruncate(this->fd, (off_t)n_blocks * this->block_size) != 0)
+        throw DbException(("cannot shrink " + this->filename).c_str(), errno);
+    this->last = n_blocks;
+    this->allocated = n_blocks;
+    if (this->prefetched > n_blocks)
+        this->prefetched = n_blocks;
+}
+
+// Open the file (directly if the file system allows) and set up its ring
+void UringFile::file_open(int flags) {
+    lock_guard<mutex> guard(this->open_mutex);
+    if (!this->closed)
+        return;
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    string path = string(env_home) + "/" + this->filename;
+    this->fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    if (this->fd < 0 && errno == EINVAL)
+        this->fd = ::open(path.c_str(), flags, 0644);  // e.g. tmpfs
+    if (this->fd < 0)
+        throw DbException(("cannot open " + this->filename).c_str(), errno);
+    struct stat status;
+    if (fstat(this->fd, &status) != 0) {
+        int error = errno;
+        ::close(this->fd);
+        throw DbException(("cannot open " + this->filename).c_str(), error);
+    }
+    try {
+        ring_open();
+    } catch (DbException &e) {
+        ::close(this->fd);
+        throw;
+    }
+    try {
+        find_last((BlockID)(status.st_size / this->block_size));
+    } catch (DbException &e) {
+        ring_close();
+        ::close(this->fd);
+        throw;
+    }
+    this->closed = false;
+    lock_guard<mutex> files_guard(PageFile::open_files_mutex);
+    PageFile::open_files.insert(this);
+}
+
+// Allocate the file's blocks through the given one
+BlockID UringFile::extend(BlockID through) {
+    if (allocate_blocks(this->fd, this->allocated, through) != 0)
+        throw DbException(("cannot extend " + this->filename).c_str(), errno);
+    return through;
+}
+
+// Set up the rings and register the write buffers
+void UringFile::ring_open() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    this->ring_fd = (int)syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params);
+    if (this->ring_fd < 0)
+        throw DbException("cannot set up io_uring", errno);
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ::close(this->ring_fd);
+        throw DbException("io_uring is too old (needs Linux 5.4)", ENOSYS);
+    }
+    size_t sq_sz = params.sq_off.array + params.sq_entries * sizeof(u_int32_t);
+    size_t cq_sz = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    this->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    this->ring = mmap(nullptr, this->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      this->ring_fd, IORING_OFF_SQ_RING);
+    this->sqes_sz = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, this->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      this->ring_fd, IORING_OFF_SQES);
+    if (this->ring == MAP_FAILED || sqes == MAP_FAILED) {
+        int error = errno;
+        if (this->ring != MAP_FAILED)
+            munmap(this->ring, this->ring_sz);
+        if (sqes != MAP_FAILED)
+            munmap(sqes, this->sqes_sz);
+        ::close(this->ring_fd);
+        throw DbException("cannot map io_uring", error);
+    }
+    char *base = (char *)this->ring;
+    this->sqes = (io_uring_sqe *)sqes;
+    this->sq_head = (u_int32_t *)(base + params.sq_off.head);
+    this->sq_tail = (u_int32_t *)(base + params.sq_off.tail);
+    this->sq_mask = (u_int32_t *)(base + params.sq_off.ring_mask);
+    this->sq_array = (u_int32_t *)(base + params.sq_off.array);
+    this->cq_head = (u_int32_t *)(base + params.cq_off.head);
+    this->cq_tail = (u_int32_t *)(base + params.cq_off.tail);
+    this->cq_mask = (u_int32_t *)(base + params.cq_off.ring_mask);
+    this->cqes = (io_uring_cqe *)(base + params.cq_off.cqes);
+
+    void *buffers;
+    if (posix_memalign(&buffers, this->block_size, (size_t)WRITE_BUFFERS * this->block_size) != 0) {
+        munmap(this->sqes, this->sqes_sz);
+        munmap(this->ring, this->ring_sz);
+        ::close(this->ring_fd);
+        throw bad_alloc();
+    }
+    this->write_buffers = (char *)buffers;
+    iovec iovecs[WRITE_BUFFERS];
+    this->free_slots.clear();
+    for (uint slot = 0; slot < WRITE_BUFFERS; slot++) {
+        iovecs[slot].iov_base = this->write_buffers + (size_t)slot * this->block_size;
+        iovecs[slot].iov_len = this->block_size;
+        this->free_slots.push_back((int)slot);
+    }
+    // without registration (e.g. over the locked memory limit) plain writes still work
+    this->fixed_buffers = syscall(__NR_io_uring_register, this->ring_fd, IORING_REGISTER_BUFFERS,
+                                  iovecs, WRITE_BUFFERS) == 0;
+}
+
+// Unmap the rings and free the write buffers
+void UringFile::ring_close() {
+    munmap(this->sqes, this->sqes_sz);
+    munmap(this->ring, this->ring_sz);
+    ::close(this->ring_fd);  // unregisters the buffers
+    this->ring_fd = -1;
+    free(this->write_buffers);
+    this->write_buffers = nullptr;
+}
+
+// Fill in a submission queue entry for a request (submitting first if the queue is full)
+void UringFile::enqueue(Request *request, unique_lock<mutex> &lock) {
+    // keep completions within what the completion queue can hold
+    wait_until([this]() {return this->pending < QUEUE_DEPTH;}, lock);
+    u_int32_t tail = *this->sq_tail;
+    u_int32_t index = tail & *this->sq_mask;
+    io_uring_sqe *sqe = &this->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    if (!request->is_write)
+        sqe->opcode = IORING_OP_READ;
+    else if (this->fixed_buffers)
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+    else
+        sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = this->fd;
+    sqe->addr = (u_int64_t)(uintptr_t)request->buffer;
+    sqe->len = this->block_size;
+    sqe->off = (u_int64_t)(request->block_id - 1) * this->block_size;
+    if (request->is_write && this->fixed_buffers)
+        sqe->buf_index = (u_int16_t)request->slot;
+    sqe->user_data = (u_int64_t)(uintptr_t)request;
+    this->sq_array[index] = index;
+    __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    this->unsubmitted.push_back(request);
+    this->pending++;
+}
+
+// Hand the queued entries to the kernel, once the log is on disk as far as their writes need
+void UringFile::submit(unique_lock<mutex> &lock) {
+    while (true) {
+        LSN needed = 0;
+        for (auto const &request: this->unsubmitted)
+            needed = max(needed, request->lsn);
+        if (needed <= this->forced)
+            break;
+        // more may be queued meanwhile, so look again
+        lock.unlock();
+        WriteAheadLog::flush(needed);
+        lock.lock();
+        this->forced = max(this->forced, needed);
+    }
+    while (!this->unsubmitted.empty()) {
+        int n = (int)syscall(__NR_io_uring_enter, this->ring_fd, (unsigned)this->unsubmitted.size(), 0, 0,
+                             nullptr, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN || errno == EBUSY) && this->pending > this->unsubmitted.size()) {
+                // the kernel is out of room until some completions are reaped
+                reap();
+                continue;
+            }
+            throw DbException(("cannot submit I/O for " + this->filename).c_str(), errno);
+        }
+        for (int i = 0; i < n; i++) {
+            this->unsubmitted.front()->submitted = true;
+            this->unsubmitted.pop_front();
+        }
+    }
+}
+
+// Submit, then wait for completions until ready() holds; one thread at a time waits in the kernel
+void UringFile::wait_until(function<bool()> ready, unique_lock<mutex> &lock) {
+    submit(lock);
+    while (!ready()) {
+        if (this->reaping) {
+            this->completed.wait(lock);
+            continue;
+        }
+        this->reaping = true;
+        lock.unlock();
+        int n = (int)syscall(__NR_io_uring_enter, this->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        int error = errno;
+        lock.lock();
+        this->reaping = false;
+        reap();
+        this->completed.notify_all();
+        if (n < 0 && error != EINTR)
+            throw DbException(("cannot wait for I/O on " + this->filename).c_str(), error);
+        submit(lock);  // anything queued meanwhile by threads that are not waiting
+    }
+}
+
+// Take every completion off the completion queue
+void UringFile::reap() {
+    u_int32_t head = *this->cq_head;
+    u_int32_t tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        io_uring_cqe *cqe = &this->cqes[head & *this->cq_mask];
+        Request *request = (Request *)(uintptr_t)cqe->user_data;
+        request->result = cqe->res;
+        head++;
+        finish(request);
+    }
+    __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Record a completed request, freeing it if nobody will wait for it
+void UringFile::finish(Request *request) {
+    request->done = true;
+    this->pending--;
+    if (request->is_write) {
+        auto write = this->writes.find(request->block_id);
+        if (write != this->writes.end() && write->second == request)
+            this->writes.erase(write);
+        this->free_slots.push_back(request->slot);
+        if (request->abandoned && request->result != (int)this->block_size)
+            this->write_error = request->result < 0 ? -request->result : EIO;
+    } else {
+        this->reads.erase(this->reads.find(request->block_id));
+    }
+    if (request->abandoned) {
+        if (!request->is_write)
+            free(request->buffer);
+        delete request;
+    }
+}
+
+// Turn a completed request into its result
+DbBlock *UringFile::collect(Request *request) {
+    int result = request->result;
+    bool is_write = request->is_write;
+    BlockID block_id = request->block_id;
+    char *buffer = is_write ? nullptr : request->buffer;
+    delete request;
+    if (result != (int)this->block_size) {
+        free(buffer);
+        int error = result < 0 ? -result : EIO;
+        throw DbException(((is_write ? "cannot write block " : "cannot read block ") + to_string(block_id) +
+                           " of " + this->filename).c_str(), error);
+    }
+    if (is_write)
+        return nullptr;
+    Dbt data(buffer, this->block_size);
+    data.set_flags(DB_DBT_MALLOC);  // the page frees it
+    return new SlottedPage(data, block_id, false);
+}
+
+// A handle is going away without waiting: free the request now or once it completes
+void UringFile::abandon(Request *request) {
+    lock_guard<mutex> guard(this->ring_mutex);
+    if (!request->done) {
+        request->abandoned = true;
+        return;
+    }
+    if (!request->is_write)
+        free(request->buffer);
+    if (request->is_write && request->result != (int)this->block_size)
+        this->write_error = request->result < 0 ? -request->result : EIO;
+    delete request;
+}
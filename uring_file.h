@@ -0,0 +1,129 @@
+/**
+ * @file uring_file.h - heap table storage in a file read and written through io_uring
+ * UringFile: PageFile
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <linux/io_uring.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class UringFile - plain file of blocks with asynchronous I/O (implementation of PageFile)
+ *
+ * The file in the environment directory is just the blocks one after the
+ * other, opened with O_DIRECT where the file system allows it, so blocks go
+ * between our memory and the disk without passing through the page cache.
+ * Reads and writes are queued on an io_uring submission queue and handed to
+ * the kernel together: reads when someone waits for one, writes once
+ * SUBMIT_BATCH have been queued. Several reads and writes are thus in
+ * progress at once instead of one block at a time.
+ *
+ * put copies the block into one of WRITE_BUFFERS buffers registered with the
+ * kernel and returns at once; the buffer serves reads of that block until
+ * the write completes, and a block put again before its write was submitted
+ * is just copied over it. put waits only when every buffer is in use. Each
+ * put logs the bytes changed since the image get_for_update kept (the whole
+ * block if there is none) without waiting for the log, which is forced
+ * instead just before queued writes are handed to the kernel. The
+ * file grows a whole extent at a time, so appends do not extend it one
+ * block per write.
+ */
+class UringFile : public PageFile {
+public:
+    /**
+     * Submission queue entries
+     */
+    static const uint QUEUE_DEPTH = 128;
+
+    /**
+     * Registered buffers, i.e. writes that can be in progress at once
+     */
+    static const uint WRITE_BUFFERS = 64;
+
+    /**
+     * Queued writes handed to the kernel together
+     */
+    static const uint SUBMIT_BATCH = 16;
+
+    UringFile(std::string name, uint block_size=DbBlock::BLOCK_SZ);
+    virtual ~UringFile();
+    UringFile(const UringFile& other) = delete;
+    UringFile(UringFile&& temp) = delete;
+    UringFile& operator=(const UringFile& other) = delete;
+    UringFile& operator=(UringFile&& temp) = delete;
+
+    virtual void create(void);
+    virtual void drop(void);
+    virtual void open(void);
+    virtual void close(void);
+    virtual SlottedPage* get_new(void);
+    virtual SlottedPage* get(BlockID block_id);
+    virtual void put(DbBlock* block);
+    virtual DbBlockIO* get_async(BlockID block_id);
+    virtual DbBlockIO* put_async(DbBlock* block);
+    virtual void sync();
+    virtual void shrink(BlockID n_blocks);
+
+protected:
+    // one read or write queued on the ring
+    struct Request {
+        BlockID block_id;
+        bool is_write;
+        char *buffer;    // block read into (owned until waited on) or write buffer
+        int slot;        // write buffer index
+        bool submitted;  // handed to the kernel (write buffer no longer ours to change)
+        bool done;
+        int result;      // bytes transferred or -errno
+        bool abandoned;  // handle deleted without waiting: free on completion
+        LSN lsn;         // a write's change: the log must be on disk this far before it is submitted
+    };
+    class IO;
+    friend class IO;
+
+    std::string filename;  // in the environment directory
+    int fd;
+    int ring_fd;
+    void *ring;            // submission and completion rings, mapped together
+    size_t ring_sz;
+    io_uring_sqe *sqes;
+    size_t sqes_sz;
+    u_int32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+    u_int32_t *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+    bool fixed_buffers;    // write buffers registered with the kernel
+    char *write_buffers;
+    std::vector<int> free_slots;
+    std::deque<Request*> unsubmitted;    // in the submission queue, in order
+    uint pending;          // requests queued or in progress
+    int write_error;       // errno of a failed write nobody waited for
+    std::map<BlockID, Request*> writes;  // last write of each block not yet complete
+    std::multiset<BlockID> reads;        // blocks with reads in progress
+    std::mutex ring_mutex;
+    std::condition_variable completed;   // signalled after completions are reaped
+    bool reaping;          // a thread is waiting in the kernel for completions
+    LSN forced;            // the log is known to be on disk this far
+
+    virtual void file_open(int flags);
+    virtual void ring_open();
+    virtual void ring_close();
+    virtual void prefetch(BlockID first, BlockID last) {}
+    virtual BlockID extend(BlockID through);
+    virtual void enqueue(Request *request, std::unique_lock<std::mutex> &lock);
+    virtual void submit(std::unique_lock<std::mutex> &lock);
+    virtual void wait_until(std::function<bool()> ready, std::unique_lock<std::mutex> &lock);
+    virtual void reap();
+    virtual void finish(Request *request);
+    virtual DbBlock *collect(Request *request);
+    virtual void abandon(Request *request);
+};
@@ -0,0 +1,55 @@
+/**
+ * @file vacuum.cpp - implementation of Vacuum
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <chrono>
+#include <iostream>
+#include "vacuum.h"
+#include "SQLExec.h"
+using namespace std;
+
+/**
+ * Start the background thread
+ * @param   uint interval  seconds between passes
+ */
+Vacuum::Vacuum(uint interval) : interval(interval), stopping(false), passes(0), removed(0), freed(0) {
+    if (this->interval > 0)
+        this->worker = thread(&Vacuum::run, this);
+}
+
+Vacuum::~Vacuum() {
+    stop();
+}
+
+/**
+ * Wake the thread up and wait for it to exit
+ */
+void Vacuum::stop() {
+    {
+        lock_guard<mutex> guard(this->stop_mutex);
+        this->stopping = true;
+        this->stop_requested.notify_all();
+    }
+    if (this->worker.joinable())
+        this->worker.join();
+}
+
+// Vacuum every table once per interval until stopped
+void Vacuum::run() {
+    unique_lock<mutex> lock(this->stop_mutex);
+    while (!this->stop_requested.wait_for(lock, chrono::seconds(this->interval),
+                                          [this]() {return this->stopping;})) {
+        lock.unlock();
+        try {
+            uint blocks_freed;
+            this->removed += SQLExec::vacuum(blocks_freed);
+            this->freed += blocks_freed;
+            this->passes++;
+        } catch (exception &e) {
+            // try again next time, e.g. after a concurrent DROP
+            cerr << "(sql5300: vacuum: " << e.what() << ")" << endl;
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * @file vacuum.h - background garbage collection of dead row versions
+ * Vacuum
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * @class Vacuum - thread that periodically runs SQLExec::vacuum()
+ *
+ * Deleted rows stay in their blocks as long as some snapshot might still see
+ * them; this reclaims their space in the background, once every interval,
+ * compacting the tables and giving back the blocks that leaves empty.
+ */
+class Vacuum {
+public:
+    /**
+     * Default seconds between passes
+     */
+    static const uint DEFAULT_INTERVAL = 60;
+
+    /**
+     * @param interval  seconds between passes (0 never runs a pass)
+     */
+    Vacuum(uint interval=DEFAULT_INTERVAL);
+    virtual ~Vacuum();
+    Vacuum(const Vacuum& other) = delete;
+    Vacuum(Vacuum&& temp) = delete;
+    Vacuum& operator=(const Vacuum& other) = delete;
+    Vacuum& operator=(Vacuum&& temp) = delete;
+
+    /**
+     * Stop the thread, waiting for a pass in progress to finish.
+     */
+    virtual void stop();
+
+    // statistics
+    size_t get_passes() const {return passes;}
+    size_t get_removed() const {return removed;}
+    size_t get_freed() const {return freed;}
+
+protected:
+    uint interval;
+    bool stopping;
+    std::mutex stop_mutex;
+    std::condition_variable stop_requested;
+    std::atomic<size_t> passes;
+    std::atomic<size_t> removed;
+    std::atomic<size_t> freed;
+    std::thread worker;
+
+    virtual void run();
+};
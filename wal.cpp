@@ -0,0 +1,643 @@
+/**
+ * @file wal.cpp - implementation of WriteAheadLog
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include "db_cxx.h"
+#include "heap_storage.h"
+#include "page_codec.h"
+#include "wal.h"
+using namespace std;
+
+extern DbEnv* _DB_ENV;
+
+mutex WriteAheadLog::mutex;
+condition_variable WriteAheadLog::flush_needed;
+condition_variable WriteAheadLog::flushed;
+string WriteAheadLog::home;
+int WriteAheadLog::log_fd = -1;
+LSN WriteAheadLog::segment_start = 0;
+LSN WriteAheadLog::end_lsn = 0;
+LSN WriteAheadLog::durable_lsn = 0;
+LSN WriteAheadLog::redo_lsn = 0;
+vector<char> WriteAheadLog::pending;
+uint WriteAheadLog::waiting = 0;
+uint WriteAheadLog::commit_delay = 0;
+bool WriteAheadLog::stopping = false;
+set<TxnID> WriteAheadLog::writers;
+thread *WriteAheadLog::flusher_thread = nullptr;
+atomic<size_t> WriteAheadLog::commits(0);
+atomic<size_t> WriteAheadLog::fsyncs(0);
+atomic<size_t> WriteAheadLog::bytes(0);
+atomic<size_t> WriteAheadLog::checkpoints(0);
+
+/*
+ * Each record is [u32 payload size][u32 checksum of payload][payload] where the
+ * payload is [u8 type][u32 txn][body]. Bodies:
+ *   PAGE:       [u32 block id][u32 block size][u16 name size][name] then for each run
+ *               of changed bytes: [u32 offset][u32 length][data]
+ *   COMMIT:     (empty)
+ *   DROP:       [u16 name size][name]
+ *   SHRINK:     [u32 blocks kept][u32 block size][u16 name size][name]
+ *   CHECKPOINT: [u64 redo LSN][u32 writer count][u32 running writer txn]...
+ */
+static const size_t RECORD_HEADER_SZ = 2 * sizeof(u_int32_t);
+
+// changed runs closer than this are logged as one (a run costs 8 bytes)
+static const uint RUN_GAP = 8;
+
+// Append raw bytes of a fixed-size value to a record body
+template <typename T>
+static void put_value(string &body, T value) {
+    body.append((const char *)&value, sizeof(value));
+}
+
+// Read a fixed-size value from a record body, advancing the offset
+template <typename T>
+static T get_value(const string &body, size_t &offset) {
+    T value;
+    memcpy(&value, body.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return value;
+}
+
+// Append a name, prefixed with its size, to a record body
+static void put_name(string &body, const string &name) {
+    put_value<u_int16_t>(body, (u_int16_t)name.size());
+    body += name;
+}
+
+// Read a name written by put_name
+static string get_name(const string &body, size_t &offset) {
+    u_int16_t size = get_value<u_int16_t>(body, offset);
+    string name = body.substr(offset, size);
+    offset += size;
+    return name;
+}
+
+// Write all of data to fd
+static bool write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * Recover from the log left by the last run, then start a fresh segment
+ * beginning with a checkpoint and start the flusher thread
+ * @param   uint commit_delay  microseconds to wait for more commits per fsync
+ */
+void WriteAheadLog::open(uint commit_delay) {
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    WriteAheadLog::home = env_home;
+    WriteAheadLog::commit_delay = commit_delay;
+    recover();
+
+    // everything recovered is now in the heap files: begin the log afresh
+    for (LSN start: segments())
+        unlink(segment_path(start).c_str());
+    open_segment(end_lsn);
+    string body;
+    put_value<LSN>(body, end_lsn);
+    put_value<u_int32_t>(body, 0);
+    append(CHECKPOINT, 0, body);
+    if (!write_all(log_fd, pending.data(), pending.size()) || fdatasync(log_fd) != 0)
+        throw DbException("cannot write log", errno);
+    pending.clear();
+    durable_lsn = redo_lsn = end_lsn;
+    flusher_thread = new thread(&WriteAheadLog::flusher);
+    // before the statics the flusher waits on are destroyed
+    atexit(WriteAheadLog::close);
+}
+
+/**
+ * Flush the log and join the flusher thread
+ */
+void WriteAheadLog::close() {
+    {
+        lock_guard<std::mutex> guard(WriteAheadLog::mutex);
+        if (flusher_thread == nullptr)
+            return;
+        stopping = true;
+        flush_needed.notify_one();
+    }
+    flusher_thread->join();
+    delete flusher_thread;
+    flusher_thread = nullptr;
+    ::close(log_fd);
+    log_fd = -1;
+}
+
+/**
+ * Log the bytes of a block that changed
+ * @param   string file_name  heap file
+ * @param   u_int32_t block_id  block being written
+ * @param   void *before      old contents or nullptr to log the whole block
+ * @param   void *after       new contents
+ * @param   uint size         block size
+ * @return  LSN               end of the record, 0 if none
+ */
+LSN WriteAheadLog::log_page(const string &file_name, u_int32_t block_id,
+                            const void *before, const void *after, uint size) {
+    if (!is_open())
+        return 0;
+    const char *new_bytes = (const char *)after;
+    vector<char> zeros;
+    if (before == nullptr) {
+        zeros.assign(size, 0);
+        before = zeros.data();
+    }
+    const char *old_bytes = (const char *)before;
+    string body;
+    put_value<u_int32_t>(body, block_id);
+    put_value<u_int32_t>(body, size);
+    put_value<u_int8_t>(body, zeros.empty() ? 0 : 1);  // image: redo starts from zeros
+    put_name(body, file_name);
+    size_t header_size = body.size();
+    uint offset = 0;
+    while (offset < size) {
+        while (offset < size && old_bytes[offset] == new_bytes[offset])
+            offset++;
+        if (offset == size)
+            break;
+        // extend the run until RUN_GAP bytes in a row are unchanged
+        uint end = offset + 1, same = 0;
+        for (uint i = end; i < size && same < RUN_GAP; i++) {
+            if (old_bytes[i] == new_bytes[i]) {
+                same++;
+            } else {
+                same = 0;
+                end = i + 1;
+            }
+        }
+        put_value<u_int32_t>(body, offset);
+        put_value<u_int32_t>(body, end - offset);
+        body.append(new_bytes + offset, end - offset);
+        offset = end;
+    }
+    if (body.size() == header_size && zeros.empty())
+        return 0;  // nothing changed
+
+    TxnID txn = Transaction::current_id();
+    lock_guard<std::mutex> guard(WriteAheadLog::mutex);
+    LSN lsn = append(PAGE, txn, body);
+    if (txn != 0)
+        writers.insert(txn);
+    if (pending.size() >= FLUSH_SZ)
+        flush_needed.notify_one();
+    return lsn;
+}
+
+/**
+ * Wait for the flusher to get the log up to lsn onto disk
+ * @param   LSN lsn  what log_page returned
+ */
+void WriteAheadLog::flush(LSN lsn) {
+    if (lsn == 0 || !is_open())
+        return;
+    unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+    if (durable_lsn < lsn)
+        force(lsn, lock);
+}
+
+/**
+ * Wait for the flusher to get the whole log onto disk
+ */
+void WriteAheadLog::flush_all() {
+    if (!is_open())
+        return;
+    unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+    if (durable_lsn < end_lsn)
+        force(end_lsn, lock);
+}
+
+/**
+ * Log the removal of a heap file
+ * @param   string file_name  heap file
+ */
+void WriteAheadLog::log_drop(const string &file_name) {
+    if (!is_open())
+        return;
+    string body;
+    put_name(body, file_name);
+    TxnID txn = Transaction::current_id();
+    lock_guard<std::mutex> guard(WriteAheadLog::mutex);
+    append(DROP, txn, body);
+    if (txn != 0)
+        writers.insert(txn);
+}
+
+/**
+ * Log the cutting back of a heap file and wait for the flusher to get it to disk
+ * @param   string file_name  heap file
+ * @param   u_int32_t n_blocks  blocks kept
+ * @param   uint size         block size
+ */
+void WriteAheadLog::log_shrink(const string &file_name, u_int32_t n_blocks, uint size) {
+    if (!is_open())
+        return;
+    string body;
+    put_value<u_int32_t>(body, n_blocks);
+    put_value<u_int32_t>(body, size);
+    put_name(body, file_name);
+    TxnID txn = Transaction::current_id();
+    unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+    // recovery must not redo the earlier changes of the blocks cut off into a file without them
+    LSN lsn = append(SHRINK, txn, body);
+    if (txn != 0)
+        writers.insert(txn);
+    force(lsn, lock);
+}
+
+/**
+ * Log the commit and wait for the flusher to get it to disk
+ * @param   TxnID txn  committing transaction
+ */
+void WriteAheadLog::commit(TxnID txn) {
+    unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+    if (writers.erase(txn) == 0)
+        return;  // read-only (or the log is not open)
+    force(append(COMMIT, txn, ""), lock);
+    commits++;
+}
+
+/**
+ * Write back dirty blocks in steps, then log the checkpoint and drop the
+ * segments recovery no longer needs
+ * @param   uint spread  milliseconds to spread the writes over
+ */
+void WriteAheadLog::checkpoint(uint spread) {
+    if (!is_open())
+        return;
+    LSN start;
+    {
+        unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+        start = end_lsn;
+        if (durable_lsn < start)
+            force(start, lock);  // no block goes to disk ahead of its log record
+    }
+    // every change logged before start is in a block written back below, and
+    // the blocks changed since may go too, so the log is forced before each step
+    for (int step = 1; step <= CHECKPOINT_STEPS; step++) {
+        int written;
+        flush_all();
+        _DB_ENV->memp_trickle(100 * step / CHECKPOINT_STEPS, &written);
+        this_thread::sleep_for(chrono::milliseconds(spread / CHECKPOINT_STEPS));
+    }
+    flush_all();
+    _DB_ENV->memp_sync(nullptr);
+    PageFile::sync_all();
+
+    unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+    string body;
+    put_value<LSN>(body, start);
+    put_value<u_int32_t>(body, (u_int32_t)writers.size());
+    for (TxnID txn: writers)
+        put_value<TxnID>(body, txn);
+    force(append(CHECKPOINT, 0, body), lock);
+    redo_lsn = start;
+    checkpoints++;
+    lock.unlock();
+    truncate(start);
+}
+
+// Bytes of log that recovery would replay
+LSN WriteAheadLog::since_checkpoint() {
+    lock_guard<std::mutex> guard(WriteAheadLog::mutex);
+    return end_lsn - redo_lsn;
+}
+
+/**
+ * @param   TxnID txn  aborted transaction
+ */
+void WriteAheadLog::abort(TxnID txn) {
+    lock_guard<std::mutex> guard(WriteAheadLog::mutex);
+    writers.erase(txn);
+}
+
+// Commit and fsync counters
+string WriteAheadLog::report() {
+    size_t n_commits = commits, n_fsyncs = fsyncs;
+    ostringstream out;
+    out << "wal: " << n_commits << " commits in " << n_fsyncs << " fsyncs";
+    if (n_fsyncs > 0)
+        out << " (" << (double)n_commits / n_fsyncs << " per fsync)";
+    out << ", " << bytes << " bytes written, " << checkpoints << " checkpoints" << endl;
+    return out.str();
+}
+
+// Add a record to the pending buffer (caller holds the mutex), returning the LSN after it
+LSN WriteAheadLog::append(RecordType type, TxnID txn, const string &body) {
+    string payload;
+    put_value<u_int8_t>(payload, (u_int8_t)type);
+    put_value<TxnID>(payload, txn);
+    payload += body;
+    u_int32_t header[2] = {(u_int32_t)payload.size(), checksum(payload.data(), payload.size())};
+    pending.insert(pending.end(), (const char *)header, (const char *)header + sizeof(header));
+    pending.insert(pending.end(), payload.begin(), payload.end());
+    end_lsn += RECORD_HEADER_SZ + payload.size();
+    return end_lsn;
+}
+
+// Wait (holding the lock) for the flusher to get the log up to lsn onto disk
+void WriteAheadLog::force(LSN lsn, unique_lock<std::mutex> &lock) {
+    waiting++;
+    flush_needed.notify_one();
+    flushed.wait(lock, [lsn]() {return durable_lsn >= lsn;});
+    waiting--;
+}
+
+// Remove the segments that end at or before lsn
+void WriteAheadLog::truncate(LSN lsn) {
+    vector<LSN> starts = segments();
+    for (size_t i = 0; i + 1 < starts.size() && starts[i + 1] <= lsn; i++)
+        unlink(segment_path(starts[i]).c_str());
+}
+
+// Group commit: write and fsync everything pending each time a commit is waiting
+void WriteAheadLog::flusher() {
+    unique_lock<std::mutex> lock(WriteAheadLog::mutex);
+    while (true) {
+        flush_needed.wait(lock, []() {
+            return (waiting > 0 && durable_lsn < end_lsn) || pending.size() >= FLUSH_SZ || stopping;
+        });
+        if (stopping && pending.empty())
+            return;
+        if (commit_delay > 0 && !stopping) {
+            // let more sessions get their commits in before paying for the fsync
+            lock.unlock();
+            this_thread::sleep_for(chrono::microseconds(commit_delay));
+            lock.lock();
+        }
+        vector<char> batch;
+        batch.swap(pending);
+        LSN batch_end = end_lsn;
+        LSN batch_start = batch_end - batch.size();
+        if (batch_start - segment_start >= SEGMENT_SZ)
+            open_segment(batch_start);
+        int fd = log_fd;
+        lock.unlock();
+        if (!write_all(fd, batch.data(), batch.size()) || fdatasync(fd) != 0) {
+            // commits cannot be made durable: stop rather than lie to clients
+            cerr << "(sql5300: cannot write log: " << strerror(errno) << ")" << endl;
+            std::abort();
+        }
+        lock.lock();
+        durable_lsn = batch_end;
+        fsyncs++;
+        bytes += batch.size();
+        flushed.notify_all();
+    }
+}
+
+// Switch to a new segment file starting at the given LSN (caller holds the mutex)
+void WriteAheadLog::open_segment(LSN start) {
+    if (log_fd >= 0)
+        ::close(log_fd);
+    log_fd = ::open(segment_path(start).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd < 0)
+        throw DbException("cannot create log segment", errno);
+    segment_start = start;
+    // make the new file's directory entry durable too
+    int dir_fd = ::open(home.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+// Starting LSNs of the segment files in the environment, in order
+vector<LSN> WriteAheadLog::segments() {
+    vector<LSN> starts;
+    DIR *dir = opendir(home.c_str());
+    if (dir == nullptr)
+        return starts;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        unsigned long long start;
+        char tail;
+        if (sscanf(entry->d_name, "_wal.%16llx%c", &start, &tail) == 1)
+            starts.push_back((LSN)start);
+    }
+    closedir(dir);
+    sort(starts.begin(), starts.end());
+    return starts;
+}
+
+// Path of the segment file that starts at the given LSN
+string WriteAheadLog::segment_path(LSN start) {
+    char name[32];
+    snprintf(name, sizeof(name), "_wal.%016llx", (unsigned long long)start);
+    return home + "/" + name;
+}
+
+// Redo the log after its last checkpoint and abort the transactions that did not commit
+void WriteAheadLog::recover() {
+    auto started = chrono::steady_clock::now();
+    struct Record {
+        LSN lsn;
+        RecordType type;
+        TxnID txn;
+        string body;
+    };
+    // read every intact record, stopping at a torn or missing tail
+    vector<Record> records;
+    vector<LSN> starts = segments();
+    end_lsn = starts.empty() ? 0 : starts.front();
+    for (LSN start: starts) {
+        if (start != end_lsn)
+            break;  // gap: a later segment cannot follow on
+        int fd = ::open(segment_path(start).c_str(), O_RDONLY);
+        if (fd < 0)
+            break;
+        string contents;
+        char buffer[65536];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+            contents.append(buffer, (size_t)n);
+        ::close(fd);
+        size_t offset = 0;
+        while (offset + RECORD_HEADER_SZ <= contents.size()) {
+            u_int32_t size, sum;
+            memcpy(&size, contents.data() + offset, sizeof(size));
+            memcpy(&sum, contents.data() + offset + sizeof(size), sizeof(sum));
+            const char *payload = contents.data() + offset + RECORD_HEADER_SZ;
+            if (size < 5 || offset + RECORD_HEADER_SZ + size > contents.size() ||
+                checksum(payload, size) != sum)
+                break;
+            Record record;
+            record.lsn = end_lsn;
+            record.type = (RecordType)(u_int8_t)payload[0];
+            memcpy(&record.txn, payload + 1, sizeof(TxnID));
+            record.body.assign(payload + 5, size - 5);
+            records.push_back(record);
+            offset += RECORD_HEADER_SZ + size;
+            end_lsn += RECORD_HEADER_SZ + size;
+        }
+        if (offset != contents.size())
+            break;
+    }
+
+    // analysis: last checkpoint, writers that never committed, last drop of each file
+    const Record *checkpoint = nullptr;
+    set<TxnID> losers;
+    map<string, LSN> dropped;
+    for (auto const &record: records) {
+        if (record.type == CHECKPOINT) {
+            // writers that finished before the checkpoint are not listed in it
+            checkpoint = &record;
+            losers.clear();
+            size_t offset = sizeof(LSN);
+            u_int32_t n_writers = get_value<u_int32_t>(record.body, offset);
+            for (u_int32_t i = 0; i < n_writers; i++)
+                losers.insert(get_value<TxnID>(record.body, offset));
+        } else if (record.type == COMMIT) {
+            losers.erase(record.txn);
+        } else if (record.txn != 0) {
+            losers.insert(record.txn);
+        }
+        if (record.type == DROP) {
+            size_t offset = 0;
+            dropped[get_name(record.body, offset)] = record.lsn;
+        }
+    }
+    if (checkpoint == nullptr)
+        return;  // no log yet
+    size_t offset = 0;
+    LSN redo_from = get_value<LSN>(checkpoint->body, offset);
+
+    // redo: write back every logged change after the checkpoint, in order
+    map<string, Db*> files;
+    map<string, int> plain_files;
+    size_t redone = 0;
+    for (auto const &record: records) {
+        if ((record.type != PAGE && record.type != SHRINK) || record.lsn < redo_from)
+            continue;
+        offset = 0;
+        u_int32_t block_id = get_value<u_int32_t>(record.body, offset);  // blocks kept for SHRINK
+        u_int32_t block_size = get_value<u_int32_t>(record.body, offset);
+        bool image = record.type == PAGE && get_value<u_int8_t>(record.body, offset) != 0;
+        string file_name = get_name(record.body, offset);
+        auto drop = dropped.find(file_name);
+        if (drop != dropped.end() && record.lsn < drop->second)
+            continue;  // file was dropped later on
+        // a .zdb file is a Berkeley DB RECNO database of compressed blocks
+        bool compressed = file_name.size() > 4 && file_name.compare(file_name.size() - 4, 4, ".zdb") == 0;
+        bool is_db = compressed || (file_name.size() > 3 && file_name.compare(file_name.size() - 3, 3, ".db") == 0);
+        Db *db = nullptr;
+        int fd = -1;
+        if (is_db) {
+            db = files[file_name];
+            if (db == nullptr) {
+                db = files[file_name] = new Db(_DB_ENV, 0);
+                if (!compressed)
+                    db->set_re_len(block_size);
+                db->open(nullptr, file_name.c_str(), nullptr, DB_RECNO, DB_CREATE, 0644);
+            }
+        } else {
+            auto plain = plain_files.find(file_name);
+            if (plain == plain_files.end())
+                plain = plain_files.insert(make_pair(file_name,
+                            ::open((home + "/" + file_name).c_str(), O_RDWR | O_CREAT, 0644))).first;
+            fd = plain->second;
+            if (fd < 0)
+                throw DbException(("cannot open " + file_name + " for recovery").c_str(), errno);
+        }
+        if (record.type == SHRINK) {
+            // cut the blocks off again, whatever was redone to them before
+            if (is_db) {
+                for (u_int32_t cut = block_id + 1; ; cut++) {
+                    Dbt key(&cut, sizeof(cut));
+                    if (db->del(nullptr, &key, 0) != 0)
+                        break;
+                }
+            } else if (ftruncate(fd, (off_t)block_id * block_size) != 0) {
+                throw DbException(("cannot shrink " + file_name).c_str(), errno);
+            }
+            continue;
+        }
+        vector<char> block(block_size, 0);
+        Dbt key(&block_id, sizeof(block_id));
+        off_t position = (off_t)(block_id - 1) * block_size;
+        if (is_db && compressed) {
+            Dbt data;
+            data.set_flags(DB_DBT_MALLOC);
+            if (!image && db->get(nullptr, &key, &data, 0) == 0) {
+                try {
+                    PageCodec::decompress(data.get_data(), data.get_size(), block.data(), block_size);
+                } catch (DbException &e) {
+                    free(data.get_data());
+                    throw DbException(("cannot recover block of " + file_name).c_str(), EINVAL);
+                }
+                free(data.get_data());
+            }
+        } else if (is_db) {
+            Dbt data(block.data(), block_size);
+            data.set_ulen(block_size);
+            data.set_flags(DB_DBT_USERMEM);
+            if (!image)
+                db->get(nullptr, &key, &data, 0);  // DB_NOTFOUND leaves a zeroed block
+        } else if (!image && pread(fd, block.data(), block_size, position) < 0) {
+            throw DbException(("cannot read " + file_name).c_str(), errno);  // past the end leaves zeros
+        }
+        while (offset < record.body.size()) {
+            u_int32_t run_offset = get_value<u_int32_t>(record.body, offset);
+            u_int32_t run_size = get_value<u_int32_t>(record.body, offset);
+            memcpy(block.data() + run_offset, record.body.data() + offset, run_size);
+            offset += run_size;
+        }
+        if (is_db && compressed) {
+            string stored;
+            PageCodec::compress(block.data(), block_size, stored);
+            Dbt changed((void *)stored.data(), (u_int32_t)stored.size());
+            db->put(nullptr, &key, &changed, 0);
+        } else if (is_db) {
+            Dbt changed(block.data(), block_size);
+            db->put(nullptr, &key, &changed, 0);
+        } else if (pwrite(fd, block.data(), block_size, position) != (ssize_t)block_size) {
+            throw DbException(("cannot write " + file_name).c_str(), errno);
+        }
+        redone++;
+    }
+    for (auto const &entry: files) {
+        entry.second->close(0);
+        delete entry.second;
+    }
+    for (auto const &entry: plain_files) {
+        fsync(entry.second);
+        ::close(entry.second);
+    }
+    TransactionManager::abort_all(losers);
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started);
+    cout << "(sql5300: recovery replayed " << redone << " block changes from " << end_lsn - redo_from
+         << " bytes of log and rolled back " << losers.size() << " unfinished transactions in "
+         << elapsed.count() / 1000.0 << " ms)" << endl;
+}
+
+// FNV-1a hash, enough to recognize a torn record at the tail of the log
+u_int32_t WriteAheadLog::checksum(const char *data, size_t size) {
+    u_int32_t hash = 2166136261U;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (u_int8_t)data[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
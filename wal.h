@@ -0,0 +1,185 @@
+/**
+ * @file wal.h - write-ahead log of page changes, with group commit
+ * WriteAheadLog
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "transaction.h"
+
+/**
+ * Log sequence number: byte offset of a record in the (conceptually endless) log
+ */
+typedef u_int64_t LSN;
+
+/**
+ * @class WriteAheadLog - redo log for heap file blocks, shared by all sessions
+ *
+ * Every block written by a heap table's file is logged as the runs of bytes
+ * that changed, tagged with the writing transaction. A block may reach the
+ * disk only once the log is on disk that far, but a write does not wait for
+ * that: each file forces the log just before it lets blocks go to the disk
+ * (see flush and flush_all), so a session normally waits for one fsync, at
+ * commit. A transaction's commit record
+ * must be on disk before its commit returns; a flusher thread writes and
+ * fsyncs whatever has accumulated for all waiting sessions at once (group
+ * commit), optionally pausing first so that more commits can join.
+ *
+ * The log lives in the environment directory as segment files named by their
+ * first LSN. A checkpoint forces the log, then writes back the blocks
+ * Berkeley DB holds dirty a little at a time while sessions carry on
+ * (fuzzy), syncs the heap files kept outside Berkeley DB, then records the LSN
+ * recovery can start from and removes the segments before it. Opening the log
+ * recovers from a crash: changes after the last checkpoint are redone in
+ * order, and transactions that had not committed are recorded as aborted
+ * (which undoes them, since their row versions are then invisible and vacuum
+ * removes them).
+ */
+class WriteAheadLog {
+public:
+    /**
+     * Bytes per segment file before the log moves on to a new one
+     */
+    static const LSN SEGMENT_SZ = 16 * 1024 * 1024;
+
+    /**
+     * Recover and start logging. Call after TransactionManager::initialize()
+     * and before any block is written. Until then nothing is logged.
+     * @param commit_delay  microseconds the flusher waits for more commits
+     *                      before each fsync
+     */
+    static void open(uint commit_delay=0);
+
+    /**
+     * Write out what is pending and stop the flusher (run at exit).
+     */
+    static void close();
+
+    /**
+     * Is logging on?
+     * @returns  true once open() has been called
+     */
+    static bool is_open() {return log_fd >= 0;}
+
+    /**
+     * Log the change to a block (no-op if the log is not open).
+     * @param file_name  name of the file in the environment directory: a .db
+     *                   file is a Berkeley DB RECNO database (.zdb of
+     *                   compressed blocks), anything else a plain file of blocks
+     * @param block_id   block being written
+     * @param before     block contents before, nullptr if unknown (the whole
+     *                   block is logged and recovery starts it from zeros)
+     * @param after      block contents being written
+     * @param size       bytes in the block
+     * @returns          LSN the log must reach on disk before the block may
+     *                   (see flush), 0 if nothing was logged
+     */
+    static LSN log_page(const std::string &file_name, u_int32_t block_id,
+                        const void *before, const void *after, uint size);
+
+    /**
+     * Wait until the log is on disk up to an LSN log_page returned (the
+     * write-ahead rule: a block may be written back only after its change
+     * is). Sessions waiting at once share an fsync, as commits do.
+     * @param lsn  LSN to wait for (0 returns at once)
+     */
+    static void flush(LSN lsn);
+
+    /**
+     * Wait until everything logged so far is on disk, for writing back
+     * blocks without knowing which LSN each needs.
+     */
+    static void flush_all();
+
+    /**
+     * Log that a heap file was removed, so recovery skips its earlier changes.
+     * @param file_name  name of the file in the environment directory
+     */
+    static void log_drop(const std::string &file_name);
+
+    /**
+     * Log that a heap file was cut back to its first blocks, and wait for the
+     * record to reach the disk (the file may be cut once this returns).
+     * @param file_name  name of the file in the environment directory
+     * @param n_blocks   blocks kept
+     * @param size       bytes in each block
+     */
+    static void log_shrink(const std::string &file_name, u_int32_t n_blocks, uint size);
+
+    /**
+     * Take a fuzzy checkpoint and truncate the log before it.
+     * @param spread  milliseconds over which to spread writing back dirty blocks
+     */
+    static void checkpoint(uint spread=0);
+
+    /**
+     * How much log recovery would have to replay right now.
+     * @returns  bytes of log since the last checkpoint's redo point
+     */
+    static LSN since_checkpoint();
+
+    /**
+     * Log a transaction's commit and wait until it is on disk. Returns at once
+     * for transactions that changed nothing.
+     * @param txn  committing transaction
+     */
+    static void commit(TxnID txn);
+
+    /**
+     * Forget an aborted transaction (its outcome is kept by TransactionManager).
+     * @param txn  aborted transaction
+     */
+    static void abort(TxnID txn);
+
+    /**
+     * Counters for the shell's "stats" command.
+     * @returns  human-readable report, one line
+     */
+    static std::string report();
+
+protected:
+    enum RecordType {PAGE = 1, COMMIT = 2, DROP = 3, CHECKPOINT = 4, SHRINK = 5};
+    static const size_t FLUSH_SZ = 1024 * 1024;  // flush without a commit past this
+    static const int CHECKPOINT_STEPS = 10;      // increments of writing back dirty blocks
+
+    static std::mutex mutex;
+    static std::condition_variable flush_needed;  // signalled by commits
+    static std::condition_variable flushed;       // signalled after each fsync
+    static std::string home;
+    static int log_fd;                  // current segment
+    static LSN segment_start;           // first LSN of the current segment
+    static LSN end_lsn;                 // LSN of the next record
+    static LSN durable_lsn;             // everything before this is on disk
+    static LSN redo_lsn;                // recovery would start here
+    static std::vector<char> pending;   // records not yet written
+    static uint waiting;                // commits waiting for the flusher
+    static uint commit_delay;
+    static bool stopping;
+    static std::set<TxnID> writers;     // running transactions that logged changes
+    static std::thread *flusher_thread;
+
+    static std::atomic<size_t> commits;
+    static std::atomic<size_t> fsyncs;
+    static std::atomic<size_t> bytes;
+    static std::atomic<size_t> checkpoints;
+
+    static LSN append(RecordType type, TxnID txn, const std::string &body);
+    static void force(LSN lsn, std::unique_lock<std::mutex> &lock);
+    static void truncate(LSN lsn);
+    static void flusher();
+    static void open_segment(LSN start);
+    static std::vector<LSN> segments();
+    static std::string segment_path(LSN start);
+    static void recover();
+    static u_int32_t checksum(const char *data, size_t size);
+};
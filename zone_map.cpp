@@ -0,0 +1,308 @@
+/**
+ * @file zone_map.cpp - implementation of ZoneMap
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include "zone_map.h"
+using namespace std;
+
+atomic<size_t> ZoneMap::skipped(0);
+atomic<size_t> ZoneMap::considered(0);
+atomic<size_t> ZoneMap::bloom_skipped(0);
+
+// A TEXT value's first PREFIX_SZ bytes, padded with zeros (compared with memcmp, in the values' order)
+static void text_prefix(const string &s, char *prefix) {
+    memset(prefix, 0, ZoneMap::PREFIX_SZ);
+    memcpy(prefix, s.data(), min(s.size(), (size_t)ZoneMap::PREFIX_SZ));
+}
+
+// 64-bit FNV-1a hash of a value (the same in every build: the filters are saved)
+static u_int64_t value_hash(const Value &value) {
+    const char *data = value.data_type != ColumnAttribute::TEXT ? (const char *)&value.n : value.s.data();
+    size_t size = value.data_type != ColumnAttribute::TEXT ? sizeof(value.n) : value.s.size();
+    u_int64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (u_int8_t)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+ZoneMap::ZoneMap(string name, const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+                 const ColumnNames &bloom_columns, uint bloom_bits) :
+                 filename(name + ".zones"), column_names(column_names), bloom_words(bloom_bits / 64),
+                 changed(true) {
+    for (ColumnAttribute ca: column_attributes)
+        this->types.push_back(ca.get_data_type());
+    for (auto const &column_name: bloom_columns) {
+        auto position = find(column_names.begin(), column_names.end(), column_name);
+        if (position == column_names.end())
+            throw DbRelationError("table does not have column named '" + column_name + "'");
+        this->bloom_columns.push_back((uint)(position - column_names.begin()));
+    }
+    if (this->bloom_words == 0)
+        this->bloom_columns.clear();
+}
+
+/**
+ * File layout: u32 MAGIC, u32 1 if saved clean (0 once changed since), u32
+ * number of columns, u32 number of blocks, u32 number of Bloom columns, u32
+ * words in each filter, then for each block a u32 1 if it has rows, followed
+ * by a Zone per column and the filters if it does
+ */
+bool ZoneMap::load() {
+    ExclusiveGuard guard(this->lock);
+    this->summaries.clear();
+    this->changed = true;
+    int fd = ::open(path().c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    string bytes;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        bytes.append(buffer, (size_t)n);
+    ::close(fd);
+    const size_t header_sz = 6 * sizeof(u_int32_t);
+    if (n < 0 || bytes.size() < header_sz)
+        return false;
+    const u_int32_t *header = (const u_int32_t *)bytes.data();
+    if (header[0] != MAGIC || header[1] != 1 || header[2] != this->types.size() ||
+        header[4] != this->bloom_columns.size() || header[5] != this->bloom_words)
+        return false;
+    size_t offset = header_sz, zones_sz = this->types.size() * sizeof(Zone);
+    size_t bloom_sz = this->bloom_columns.size() * this->bloom_words * sizeof(u_int64_t);
+    for (u_int32_t block = 0; block < header[3]; block++) {
+        if (offset + sizeof(u_int32_t) > bytes.size()) {
+            this->summaries.clear();
+            return false;
+        }
+        u_int32_t has_rows = *(const u_int32_t *)(bytes.data() + offset);
+        offset += sizeof(u_int32_t);
+        this->summaries.push_back(Summary());
+        if (has_rows == 0)
+            continue;
+        if (offset + zones_sz + bloom_sz > bytes.size()) {
+            this->summaries.clear();
+            return false;
+        }
+        Summary &summary = this->summaries.back();
+        summary.zones.resize(this->types.size());
+        memcpy(summary.zones.data(), bytes.data() + offset, zones_sz);
+        offset += zones_sz;
+        summary.bloom.resize(this->bloom_columns.size() * this->bloom_words);
+        memcpy(summary.bloom.data(), bytes.data() + offset, bloom_sz);
+        offset += bloom_sz;
+    }
+    this->changed = false;
+    return true;
+}
+
+// Rewrite the file through a temporary one, so it is never seen half written
+void ZoneMap::save() {
+    ExclusiveGuard guard(this->lock);
+    if (!this->changed)
+        return;
+    string bytes;
+    u_int32_t header[6] = {MAGIC, 1, (u_int32_t)this->types.size(), (u_int32_t)this->summaries.size(),
+                           (u_int32_t)this->bloom_columns.size(), this->bloom_words};
+    bytes.append((const char *)header, sizeof(header));
+    for (auto const &summary: this->summaries) {
+        u_int32_t has_rows = summary.zones.empty() ? 0 : 1;
+        bytes.append((const char *)&has_rows, sizeof(has_rows));
+        bytes.append((const char *)summary.zones.data(), summary.zones.size() * sizeof(Zone));
+        if (has_rows)
+            bytes.append((const char *)summary.bloom.data(), summary.bloom.size() * sizeof(u_int64_t));
+    }
+    string temp_path = path() + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw DbException(("cannot write " + this->filename).c_str(), errno);
+    bool ok = write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size() && fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || rename(temp_path.c_str(), path().c_str()) != 0)
+        throw DbException(("cannot write " + this->filename).c_str(), errno);
+    this->changed = false;
+}
+
+void ZoneMap::drop() {
+    ExclusiveGuard guard(this->lock);
+    this->summaries.clear();
+    this->changed = true;
+    unlink(path().c_str());
+}
+
+void ZoneMap::widen(BlockID block_id, const ValueDict *row) {
+    ExclusiveGuard guard(this->lock);
+    mark_dirty();
+    if (this->summaries.size() < block_id)
+        this->summaries.resize(block_id);
+    widen_summary(this->summaries[block_id - 1], row);
+}
+
+void ZoneMap::replace(BlockID block_id, const ValueDicts &rows) {
+    Summary summary;
+    for (auto const &row: rows)
+        widen_summary(summary, row);
+    ExclusiveGuard guard(this->lock);
+    mark_dirty();
+    if (this->summaries.size() < block_id)
+        this->summaries.resize(block_id);
+    this->summaries[block_id - 1].zones.swap(summary.zones);
+    this->summaries[block_id - 1].bloom.swap(summary.bloom);
+}
+
+bool ZoneMap::may_match(BlockID block_id, const ValueDict *where, const IntPredicate *predicate,
+                        uint column) const {
+    SharedGuard guard(this->lock);
+    ZoneMap::considered++;
+    // rows are only ever added to a block after its summary takes them in
+    bool match = block_id <= this->summaries.size() && !this->summaries[block_id - 1].zones.empty();
+    if (match && predicate != nullptr) {
+        const Zone &zone = this->summaries[block_id - 1].zones[column];
+        int32_t low = predicate->low;
+        if (!zone.has_values)
+            match = false;  // NULL satisfies no comparison
+        else switch (predicate->op) {
+            case IntPredicate::EQ: match = zone.min <= low && low <= zone.max; break;
+            case IntPredicate::NE: match = zone.min != low || zone.max != low; break;
+            case IntPredicate::LT: match = zone.min < low; break;
+            case IntPredicate::LE: match = zone.min <= low; break;
+            case IntPredicate::GT: match = zone.max > low; break;
+            case IntPredicate::GE: match = zone.max >= low; break;
+            default: match = low <= predicate->high && low <= zone.max && zone.min <= predicate->high;
+        }
+    }
+    if (match && where != nullptr) {
+        const Summary &summary = this->summaries[block_id - 1];
+        for (auto const &condition: *where) {
+            auto position = find(this->column_names.begin(), this->column_names.end(), condition.first);
+            // an unknown column or a value of the wrong type is left to the scan to deal with
+            if (position == this->column_names.end())
+                break;
+            uint index = (uint)(position - this->column_names.begin());
+            const Zone &zone = summary.zones[index];
+            if (condition.second.is_null) {
+                match = zone.has_nulls;
+                if (!match)
+                    break;
+                continue;
+            }
+            if (condition.second.data_type != this->types[index])
+                continue;
+            if (!zone.has_values) {
+                match = false;
+            } else if (this->types[index] != ColumnAttribute::TEXT) {
+                match = zone.min <= condition.second.n && condition.second.n <= zone.max;
+            } else {
+                char prefix[PREFIX_SZ];
+                text_prefix(condition.second.s, prefix);
+                match = memcmp(zone.min_prefix, prefix, PREFIX_SZ) <= 0 &&
+                        memcmp(prefix, zone.max_prefix, PREFIX_SZ) <= 0;
+            }
+            auto bloom_index = find(this->bloom_columns.begin(), this->bloom_columns.end(), index);
+            if (match && bloom_index != this->bloom_columns.end() &&
+                !bloom_may_have(summary, (uint)(bloom_index - this->bloom_columns.begin()), condition.second)) {
+                ZoneMap::bloom_skipped++;
+                match = false;
+            }
+            if (!match)
+                break;
+        }
+    }
+    if (!match)
+        ZoneMap::skipped++;
+    return match;
+}
+
+string ZoneMap::report() {
+    ostringstream out;
+    out << "zone maps: " << ZoneMap::skipped << " of " << ZoneMap::considered
+        << " blocks skipped by filtered scans (" << ZoneMap::bloom_skipped << " by Bloom filters)" << endl;
+    return out.str();
+}
+
+string ZoneMap::path() const {
+    const char *env_home;
+    _DB_ENV->get_home(&env_home);
+    return string(env_home) + "/" + this->filename;
+}
+
+// Take a row's values into a block's summary (starting it if the block had no rows)
+void ZoneMap::widen_summary(Summary &summary, const ValueDict *row) const {
+    if (summary.zones.empty()) {
+        summary.zones.assign(this->types.size(), Zone());
+        summary.bloom.assign(this->bloom_columns.size() * this->bloom_words, 0);
+    }
+    for (uint column = 0; column < this->types.size(); column++) {
+        Zone &zone = summary.zones[column];
+        const Value &value = row->at(this->column_names[column]);
+        if (value.is_null) {
+            zone.has_nulls = 1;
+            continue;
+        }
+        bool first = !zone.has_values;
+        zone.has_values = 1;
+        if (this->types[column] != ColumnAttribute::TEXT) {
+            zone.min = first ? value.n : min(zone.min, value.n);
+            zone.max = first ? value.n : max(zone.max, value.n);
+        } else {
+            char prefix[PREFIX_SZ];
+            text_prefix(value.s, prefix);
+            if (first || memcmp(prefix, zone.min_prefix, PREFIX_SZ) < 0)
+                memcpy(zone.min_prefix, prefix, PREFIX_SZ);
+            if (first || memcmp(prefix, zone.max_prefix, PREFIX_SZ) > 0)
+                memcpy(zone.max_prefix, prefix, PREFIX_SZ);
+        }
+    }
+    // BLOOM_HASHES bits from two halves of one hash (Kirsch and Mitzenmacher)
+    uint bits = this->bloom_words * 64;
+    for (uint i = 0; i < this->bloom_columns.size(); i++) {
+        const Value &value = row->at(this->column_names[this->bloom_columns[i]]);
+        if (value.is_null)
+            continue;
+        u_int64_t hash = value_hash(value);
+        u_int64_t *filter = summary.bloom.data() + i * this->bloom_words;
+        u_int32_t h1 = (u_int32_t)hash, h2 = (u_int32_t)(hash >> 32) | 1;
+        for (uint k = 0; k < BLOOM_HASHES; k++) {
+            uint bit = (uint)((h1 + (u_int64_t)k * h2) % bits);
+            filter[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+}
+
+// Could a value be in one of a block's Bloom filters?
+bool ZoneMap::bloom_may_have(const Summary &summary, uint bloom_index, const Value &value) const {
+    uint bits = this->bloom_words * 64;
+    u_int64_t hash = value_hash(value);
+    const u_int64_t *filter = summary.bloom.data() + bloom_index * this->bloom_words;
+    u_int32_t h1 = (u_int32_t)hash, h2 = (u_int32_t)(hash >> 32) | 1;
+    for (uint k = 0; k < BLOOM_HASHES; k++) {
+        uint bit = (uint)((h1 + (u_int64_t)k * h2) % bits);
+        if (!(filter[bit / 64] >> (bit % 64) & 1))
+            return false;
+    }
+    return true;
+}
+
+// Before the first change since the file was saved clean, mark it dirty on disk (lock held)
+void ZoneMap::mark_dirty() {
+    if (this->changed)
+        return;
+    this->changed = true;
+    int fd = ::open(path().c_str(), O_WRONLY);
+    if (fd < 0)
+        return;  // nothing saved to distrust
+    u_int32_t clean = 0;
+    bool ok = pwrite(fd, &clean, sizeof(clean), sizeof(u_int32_t)) == sizeof(clean) && fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok)
+        unlink(path().c_str());
+}
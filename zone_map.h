@@ -0,0 +1,144 @@
+/**
+ * @file zone_map.h - per-block summaries of a table's values for skipping blocks in scans
+ * ZoneMap
+ *
+ * @group Dolphin
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "int_filter.h"
+#include "locks.h"
+#include "storage_engine.h"
+
+/**
+ * @class ZoneMap - smallest and largest value of each column in each block, and Bloom filters
+ *
+ * For an INT or BOOLEAN column the zone is the block's minimum and maximum;
+ * for a TEXT column the minimum and maximum of the values' first PREFIX_SZ
+ * bytes. NULLs are left out of the range and the filters; a zone only notes
+ * whether the block has any, so IS NULL skips the blocks without NULLs in
+ * the column and a comparison those with nothing else in it. The columns
+ * chosen for them also get a Bloom filter per block, which answers equality
+ * with a value between the block's minimum and maximum that no row has. A scan skips the blocks whose summaries show that no row in them can
+ * satisfy its where clause or predicate.
+ *
+ * Zones only ever widen as rows are added (before the row goes into the
+ * block), so deleted rows leave them loose until the block is summarized
+ * again with replace (which vacuum does). They are kept in memory and saved
+ * to <table>.zones in the environment directory, marked clean; the file is
+ * marked dirty before the first change after that, and a file that is
+ * missing or dirty when the table is opened is not trusted (the table
+ * rebuilds the map from its blocks).
+ */
+class ZoneMap {
+public:
+    /**
+     * Bytes of a TEXT value that are summarized
+     */
+    static const uint PREFIX_SZ = 8;
+
+    /**
+     * Bits of a Bloom filter set for each value
+     */
+    static const uint BLOOM_HASHES = 4;
+
+    /**
+     * @param name               table name (the file is <name>.zones)
+     * @param column_names       the table's columns
+     * @param column_attributes  their types
+     * @param bloom_columns      columns to keep Bloom filters of
+     * @param bloom_bits         bits in each block's filter of each of those (a multiple of 64)
+     */
+    ZoneMap(std::string name, const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+            const ColumnNames &bloom_columns=ColumnNames(), uint bloom_bits=0);
+    virtual ~ZoneMap() {}
+    ZoneMap(const ZoneMap& other) = delete;
+    ZoneMap(ZoneMap&& temp) = delete;
+    ZoneMap& operator=(const ZoneMap& other) = delete;
+    ZoneMap& operator=(ZoneMap&& temp) = delete;
+
+    /**
+     * Read the zones saved in the file.
+     * @returns  false if there is no file or it was not saved clean (the map is then empty)
+     */
+    virtual bool load();
+
+    /**
+     * Write the zones to the file, marked clean (if they changed since the last time).
+     */
+    virtual void save();
+
+    /**
+     * Forget the zones and remove the file.
+     */
+    virtual void drop();
+
+    /**
+     * Widen a block's zones to take in a row about to be added to it.
+     * @param block_id  block the row goes in
+     * @param row       all of its values
+     */
+    virtual void widen(BlockID block_id, const ValueDict *row);
+
+    /**
+     * Summarize a block again from the rows now in it.
+     * @param block_id  block
+     * @param rows      all of their values (none if the block is empty)
+     */
+    virtual void replace(BlockID block_id, const ValueDicts &rows);
+
+    /**
+     * Could a block hold a row that satisfies a where clause and a predicate?
+     * @param block_id   block
+     * @param where      column values rows must equal (or nullptr)
+     * @param predicate  comparison an INT column must satisfy (or nullptr)
+     * @param column     position of that column
+     * @returns          false only if no row in the block can
+     */
+    virtual bool may_match(BlockID block_id, const ValueDict *where, const IntPredicate *predicate,
+                           uint column) const;
+
+    /**
+     * Blocks scans have skipped and looked at, for the shell's "stats" command.
+     * @returns  human-readable report
+     */
+    static std::string report();
+
+protected:
+    // zone of one column: INT range, or range of TEXT prefixes, of its non-NULL values
+    struct Zone {
+        int32_t min;
+        int32_t max;
+        char min_prefix[PREFIX_SZ];
+        char max_prefix[PREFIX_SZ];
+        u_int8_t has_values;  // 0 while every row has NULL in the column (the range means nothing)
+        u_int8_t has_nulls;
+    };
+    // what is known of one block's rows
+    struct Summary {
+        std::vector<Zone> zones;      // per column, empty for a block without rows
+        std::vector<u_int64_t> bloom; // filter of each Bloom column, one after the other
+    };
+    static const u_int32_t MAGIC = 0x5a4f4e47;  // changes with Zone's layout, so older files are rebuilt
+    static std::atomic<size_t> skipped;
+    static std::atomic<size_t> considered;
+    static std::atomic<size_t> bloom_skipped;
+
+    std::string filename;
+    ColumnNames column_names;
+    std::vector<ColumnAttribute::DataType> types;
+    std::vector<uint> bloom_columns;   // positions of the columns with Bloom filters
+    uint bloom_words;                  // 64-bit words in a column's filter
+    std::vector<Summary> summaries;    // per block
+    bool changed;                      // since the file was saved clean
+    mutable RWLock lock;
+
+    virtual std::string path() const;
+    virtual void widen_summary(Summary &summary, const ValueDict *row) const;
+    virtual bool bloom_may_have(const Summary &summary, uint bloom_index, const Value &value) const;
+    virtual void mark_dirty();
+};